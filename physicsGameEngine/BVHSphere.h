@@ -57,6 +57,14 @@ namespace pe {
 			return ((real)1.333333) * PI * radius * radius * radius;
 		}
 
+		/*
+			Returns the surface area of the bounding volume sphere, used
+			to rate the quality of the hierarchy (surface area heuristic).
+		*/
+		real getSurfaceArea() const {
+			return 4 * PI * radius * radius;
+		}
+
 		// Returns true if the calling object overlaps with 
 		bool overlaps(const BVHSphere* sphere) const;
 
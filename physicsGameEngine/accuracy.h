@@ -3,31 +3,22 @@
 #ifndef ACCURACY_H
 #define ACCURACY_H
 
-// For GLEW static version (no dlls) and stb library
-// Note that they also need to be included in the preprocessor definitions
-// (We can also define these in the makefile)
-#define GLEW_STATIC
-#define _CRT_SECURE_NO_WARNINGS
-#define STB_IMAGE_IMPLEMENTATION
-#define STB_IMAGE_WRITE_IMPLEMENTATION
-
-// Can't have both Glew and Glad
-// Glew has to be included first
-#include <GL/glew.h>
-#include <GL/gl.h>
-#include <iostream>
-#include <fstream>
-#include <sstream>
-#include <GL/gl.h>
-
+/*
+	Note that this header is included by every physics header, so it must
+	not include any graphics library (GLEW, OpenGL, GLM, GLFW). Those are
+	included by the rendering module through graphicsLibraries.h, which
+	allows the physics core to be built on its own, without a graphics
+	stack.
+*/
+
+#include <cmath>
 #include <cfloat>
 #include <limits>
 #include <iostream>
+#include <fstream>
+#include <sstream>
 #include <vector>
 
-#include <glm.hpp>
-#include <gtc/matrix_transform.hpp>
-
 #define realSqrt sqrtf
 #define realPow powf
 #define realAbs fabs
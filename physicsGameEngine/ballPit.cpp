@@ -7,9 +7,7 @@
 #include "polyhedra.h"
 #include "rigidBodyGravity.h"
 #include "rigidBodySpringForce.h"
-#include "fineCollisionDetection.h"
-#include "collisionResolver.h"
-#include "boundingVolumeHierarchy.h"
+#include "rigidBodyWorld.h"
 #include "faceBufferGenerator.h"
 
 using namespace pe;
@@ -116,11 +114,17 @@ void pe::runBallPit() {
         )
     };
 
+    // World
+    RigidBodyWorld world(1, 0, 0.6, 0.0);
+    // The spheres dropped from high up don't go through the ground
+    world.setContinuousCollision(true);
+
     for (CuboidObject* o : walls) {
         o->body.inverseMass = 0;
         o->body.isAwake = false;
         o->faceRenderer.setColor(colorWhite);
         o->faceRenderer.setShader(&shader);
+        world.addObject(o);
     }
 
     // To be filled in real time
@@ -129,6 +133,7 @@ void pe::runBallPit() {
     // Forces
 
     RigidBodyGravity g(Vector3D(0, -10, 0));
+    world.addGlobalForce(&g);
 
     float deltaT = 0.0008;
 
@@ -181,6 +186,7 @@ void pe::runBallPit() {
                 s->faceRenderer.setColor(colorBlue);
                 s->faceRenderer.setShader(&shader);
                 spheres.push_back(s);
+                world.addObject(s);
             }
 
             isPressed = false;
@@ -191,53 +197,7 @@ void pe::runBallPit() {
         real substep = deltaT / numSteps;
 
         while (numSteps--) {
-
-            for (SphereObject* s : spheres) {
-                g.updateForce(&s->body, substep);
-            }
-
-            BoundingVolumeHierarchy BVH;
-            for (SphereObject* o : spheres) {
-                BVH.insert(
-                    o,
-                    o->boundingVolumeTransform.getTranslation(),
-                    o->boundingVolume->getBVHSphereRadius()
-                );
-            }
-            for (CuboidObject* o : walls) {
-                BVH.insert(
-                    o,
-                    o->boundingVolumeTransform.getTranslation(),
-                    o->boundingVolume->getBVHSphereRadius()
-                );
-            }
-
-            PotentialContact con[1000];
-            int size = BVH.getPotentialContacts(con, 1000);
-
-            // Fine collision detection/resolution
-
-            std::vector<Contact> contacts;
-            for (int i = 0; i < size; i++) {
-                // We only do the expensive fine collision detection phase
-                // if at least one body is awake (moving), otherwise it serves
-                // no purpose and wastes time.
-                if (con[i].object[0]->body.isAwake || con[i].object[1]->body.isAwake) {
-                    generateContacts(
-                        *con[i].object[0], *con[i].object[1], contacts, 0.6, 0.0
-                    );
-                }
-            }
-
-            CollisionResolver resolver(1, 0);
-            resolver.resolveContacts(contacts.data(), contacts.size(), substep);
-
-            for (SphereObject* s : spheres) {
-                s->body.integrate(substep);
-            }
-            for (SphereObject* s : spheres) {
-                s->update();
-            }
+            world.runPhysics(substep);
         }
 
         shader.setViewMatrix(camera.getViewMatrix());
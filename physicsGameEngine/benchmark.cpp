@@ -0,0 +1,11 @@
+#include "benchmarks.h"
+
+int main() {
+
+	pe::runBroadPhaseBenchmark();
+	pe::runParticleGridBenchmark();
+	pe::runNarrowPhaseBenchmark();
+	pe::runResolverBenchmark();
+
+	return 0;
+}
@@ -0,0 +1,49 @@
+/*
+	Header file for the benchmarks, which measure the performance of parts
+	of the physics core without any rendering, so they can be run on any
+	machine (using make benchmark, which builds them with optimizations).
+	Each benchmark prints its results to the standard output.
+*/
+
+#ifndef BENCHMARKS_H
+#define BENCHMARKS_H
+
+namespace pe {
+
+	/*
+		Compares the bounding volume hierarchy (updated each step, or
+		built again each step by the linear builder) and sweep and prune
+		broad phases on the ball pit and wrecking ball scenes, scaled up
+		to 1000, 10000 and 50000 bodies.
+	*/
+	void runBroadPhaseBenchmark();
+
+	/*
+		Measures the rebuild and the queries of the spatial hash grid on
+		clouds of 10000 to 500000 particles.
+	*/
+	void runParticleGridBenchmark();
+
+	/*
+		Compares the box and box narrow phase testing the separating axes
+		one at a time with the batch routine testing them together, at
+		each supported instruction set, on 2000 and 100000 random pairs
+		of boxes.
+		Then measures GJK with and without the cache of each pair on
+		2000 random pairs of convex hulls.
+	*/
+	void runNarrowPhaseBenchmark();
+
+	/*
+		Compares the worst first and sequential impulse solvers, at a
+		few iteration budgets, on 4 x 4 columns of 5 and 10 stacked
+		boxes, by the time per step and how far the stacks are from
+		resting after 300 steps, then runs the sequential impulse
+		solver on 8 x 8 columns with 1 to 8 threads, and the graph
+		colored solver on a pyramid of boxes (a single island) with
+		each instruction set and 1 to 8 threads.
+	*/
+	void runResolverBenchmark();
+}
+
+#endif
@@ -0,0 +1,189 @@
+/*
+	Header file for class representing a bounding capsule, which is the
+	set of points within a radius of a segment (a cylinder capped by two
+	half spheres). The segment lies along the y axis of the capsule, and
+	goes from -halfHeight to halfHeight.
+	It fits long and thin shapes, like limbs, much better than a sphere,
+	and its contacts only need the closest points of its segment to the
+	other shape, so they are much cheaper than those of a box.
+*/
+
+#ifndef BOUNDING_CAPSULE_H
+#define BOUNDING_CAPSULE_H
+
+#include "boundingVolume.h"
+
+namespace pe {
+
+	class BoundingCapsule : public BoundingVolume {
+
+	protected:
+
+		real radius;
+		real halfHeight;
+
+		/*
+			The ends of the segment in the coordinates of the capsule,
+			kept so that GJK can use them as the vertices of the capsule.
+		*/
+		Vector3D ends[2];
+
+
+		void updateEnds() {
+			ends[0] = Vector3D(0, -halfHeight, 0);
+			ends[1] = Vector3D(0, halfHeight, 0);
+		}
+
+	public:
+
+		BoundingCapsule() :
+			BoundingVolume(Vector3D::ZERO, Matrix3x3::IDENTITY),
+			radius{ 0 }, halfHeight{ 0 } {
+			updateEnds();
+		}
+
+
+		BoundingCapsule(
+			real radius,
+			real halfHeight,
+			const Vector3D& position = Vector3D::ZERO,
+			const Matrix3x3& orientation = Matrix3x3::IDENTITY
+		) : BoundingVolume(position, orientation),
+			radius{ radius }, halfHeight{ halfHeight } {
+			updateEnds();
+		}
+
+
+		TYPE getType() const override {
+			return TYPE::CAPSULE;
+		}
+
+
+		void fit(const std::vector<Vector3D>& vertices) {
+			/*
+				The segment is put along the direction in which the
+				vertices are the most spread out (the principal axis of
+				their covariance, found by power iteration, which is enough
+				for a 3x3 matrix), through their mean. The radius is then
+				the distance of the furthest vertex from that line, and the
+				segment is made as short as it can be while its ends still
+				cover the vertices beyond them.
+			*/
+
+			if (vertices.empty()) {
+				return;
+			}
+
+			Vector3D mean;
+			for (const Vector3D& vertex : vertices) {
+				mean += vertex;
+			}
+			mean *= (real)1.0 / vertices.size();
+
+			Vector3D covariance[3];
+			for (const Vector3D& vertex : vertices) {
+				Vector3D offset = vertex - mean;
+				covariance[0] += offset * offset.x;
+				covariance[1] += offset * offset.y;
+				covariance[2] += offset * offset.z;
+			}
+
+			/*
+				Starts from the column with the largest diagonal entry,
+				which can't be orthogonal to the principal axis.
+			*/
+			int start = 0;
+			for (int i = 1; i < 3; i++) {
+				if (covariance[i][i] > covariance[start][start]) {
+					start = i;
+				}
+			}
+			Vector3D axis = covariance[start];
+			if (axis.magnitudeSquared() == 0) {
+				axis = Vector3D::UP;
+			}
+			axis.normalize();
+			for (int i = 0; i < 16; i++) {
+				Vector3D next = covariance[0] * axis.x +
+					covariance[1] * axis.y + covariance[2] * axis.z;
+				if (next.magnitudeSquared() == 0) {
+					break;
+				}
+				next.normalize();
+				axis = next;
+			}
+
+			radius = 0;
+			for (const Vector3D& vertex : vertices) {
+				Vector3D offset = vertex - mean;
+				real along = offset * axis;
+				radius = std::max(
+					radius, offset.magnitudeSquared() - along * along
+				);
+			}
+			radius = realSqrt(radius);
+
+			/*
+				A vertex is covered if it is within the half sphere of the
+				closest end, so the ends only need to reach within the
+				half chord of that sphere at the distance of the vertex
+				from the line.
+			*/
+			real top = -REAL_MAX;
+			real bottom = REAL_MAX;
+			for (const Vector3D& vertex : vertices) {
+				Vector3D offset = vertex - mean;
+				real along = offset * axis;
+				real chord = realSqrt(std::max((real)0,
+					radius * radius - offset.magnitudeSquared() + along * along
+				));
+				top = std::max(top, along - chord);
+				bottom = std::min(bottom, along + chord);
+			}
+
+			halfHeight = std::max((real)0, (top - bottom) * (real)0.5);
+			position = mean + axis * ((top + bottom) * (real)0.5);
+
+			// Any two directions orthogonal to the axis complete the basis
+			Vector3D side = realAbs(axis.x) < (real)0.9 ?
+				Vector3D::RIGHT : Vector3D::UP;
+			side = side - axis * (side * axis);
+			side.normalize();
+			Vector3D front = side % axis;
+			orientation = Matrix3x3(
+				side.x, axis.x, front.x,
+				side.y, axis.y, front.y,
+				side.z, axis.z, front.z
+			);
+
+			updateEnds();
+		}
+
+
+		real getRadius() const {
+			return radius;
+		}
+
+
+		real getHalfHeight() const {
+			return halfHeight;
+		}
+
+
+		// Ends of the segment in the coordinates of the capsule
+		const Vector3D* getEnds() const {
+			return ends;
+		}
+
+
+		/*
+			The smallest sphere encompassing a capsule (centered at the
+			same place) reaches the tips of its half spheres.
+		*/
+		real getBVHSphereRadius() const override {
+			return halfHeight + radius;
+		}
+	};
+}
+
+#endif
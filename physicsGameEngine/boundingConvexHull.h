@@ -0,0 +1,122 @@
+/*
+	Header file for class representing a convex hull bounding volume,
+	which is the convex hull of the vertices of a mesh (usually the mesh
+	of the object, or a simpler mesh with fewer vertices made for its
+	collisions). Unlike the box and sphere, it fits convex shapes like
+	cones, pyramids and imported hulls exactly, and its contacts are
+	generated with GJK and EPA, which only need the vertex furthest along
+	a direction (the support point), so the faces of the mesh are never
+	used. A mesh that isn't convex collides as its convex hull.
+	The support point of a convex mesh can be found by walking from
+	vertex to adjacent vertex, always to one further along the direction,
+	which only visits a few vertices when starting from the support point
+	of the previous step. This misses the support point when the mesh
+	isn't convex (it can stop on a vertex that is only further than its
+	neighbours), so the hull finds whether its mesh is convex once, and
+	only convex meshes are walked.
+	Since the hull is made of the vertices themselves, it stays at the
+	origin of the local coordinates of the mesh, so the bounding volume
+	transform of the object is the transform of the mesh vertices.
+*/
+
+#ifndef BOUNDING_CONVEX_HULL_H
+#define BOUNDING_CONVEX_HULL_H
+
+#include "boundingVolume.h"
+
+namespace pe {
+
+	class BoundingConvexHull : public BoundingVolume {
+
+	protected:
+
+		// Mesh whose vertices make up the hull
+		const Mesh* mesh;
+
+		// Distance of the furthest vertex from the origin
+		real radius;
+
+		// Whether the support point can be found by walking the mesh
+		bool convex;
+
+
+		/*
+			A closed mesh is convex if each face has all the neighbours of
+			its vertices on the same side of it (the inside).
+			Checking the neighbours instead of all the vertices keeps this
+			linear in the size of the mesh.
+		*/
+		static bool isConvex(const Mesh* mesh, real radius) {
+
+			real tolerance = radius * (real)1e-4;
+
+			for (int i = 0; i < mesh->getFaceCount(); i++) {
+				const Face& face = mesh->getFace(i);
+				Vector3D normal = face.getNormal();
+				Vector3D centroid = face.getCentroid();
+
+				bool above = false, below = false;
+				for (int j = 0; j < face.getVertexCount(); j++) {
+					int index = face.getIndex(j);
+					for (int k = 0; k < mesh->getAdjacentVertexCount(index);
+						k++) {
+						real distance = (mesh->getVertex(
+							mesh->getAdjacentVertex(index, k)
+						) - centroid) * normal;
+						above = above || distance > tolerance;
+						below = below || distance < -tolerance;
+					}
+				}
+				if (above && below) {
+					return false;
+				}
+			}
+			return mesh->getFaceCount() > 0;
+		}
+
+	public:
+
+		BoundingConvexHull(const Mesh* mesh) :
+			BoundingVolume(Vector3D::ZERO, Matrix3x3::IDENTITY),
+			mesh{ mesh }, radius{ 0 } {
+			fit(mesh->getVertices());
+			mesh->buildAdjacency();
+			convex = isConvex(mesh, radius);
+		}
+
+
+		TYPE getType() const override {
+			return TYPE::CONVEX_HULL;
+		}
+
+
+		/*
+			The hull is always that of the vertices of its mesh, so this
+			only finds the radius of the bounding sphere, given the
+			vertices of the mesh.
+		*/
+		void fit(const std::vector<Vector3D>& vertices) {
+			radius = 0;
+			for (const Vector3D& vertex : vertices) {
+				radius = std::max(radius, vertex.magnitude());
+			}
+		}
+
+
+		real getBVHSphereRadius() const override {
+			return radius;
+		}
+
+
+		const Mesh* getMesh() const {
+			return mesh;
+		}
+
+
+		bool isConvex() const {
+			return convex;
+		}
+	};
+}
+
+#endif
@@ -45,9 +45,13 @@ namespace pe {
 		enum class TYPE {
 			BOX,
 			SPHERE,
-			CAPSULE
+			CAPSULE,
+			CONVEX_HULL
 		};
 
+		// Number of types, for the tables indexed by type
+		static const unsigned int TYPE_COUNT = 4;
+
 
 		BoundingVolume() :
 			position{ Vector3D::ZERO }, 
@@ -1,10 +1,84 @@
-
 #include "boundingVolumeHierarchy.h"
+#include <bit>
+#include <atomic>
+#include <memory>
 
 using namespace pe;
 
 
-void BoundingVolumeHierarchy::insert(
+namespace {
+
+	/*
+		Calls the function with consecutive ranges of the indices from 0
+		to the count, one range for each thread of the job system if
+		there is one and enough indices for each, and otherwise with the
+		whole range on the calling thread.
+	*/
+	template <typename Function>
+	void parallelFor(
+		JobSystem* jobSystem,
+		unsigned int count,
+		unsigned int parallelSize,
+		const Function& function
+	) {
+		unsigned int jobs = jobSystem ?
+			std::min(jobSystem->getThreadCount(), count / parallelSize) : 1;
+		if (jobs <= 1) {
+			function(0, count);
+			return;
+		}
+
+		unsigned int chunk = (count + jobs - 1) / jobs;
+		jobSystem->run(jobs, [&](unsigned int job, unsigned int) {
+			unsigned int begin = std::min(job * chunk, count);
+			function(begin, std::min(begin + chunk, count));
+		});
+	}
+
+
+	// Spreads the 10 lowest bits of the value two bits apart
+	unsigned int expandBits(unsigned int value) {
+		value = (value * 0x00010001u) & 0xFF0000FFu;
+		value = (value * 0x00000101u) & 0x0F00F00Fu;
+		value = (value * 0x00000011u) & 0xC30C30C3u;
+		value = (value * 0x00000005u) & 0x49249249u;
+		return value;
+	}
+}
+
+
+unsigned int BoundingVolumeHierarchy::allocateNode(
+	RigidObject* object,
+	const BVHSphere& sphere,
+	unsigned int parent
+) {
+	unsigned int node;
+
+	// The pool only grows when all of its nodes are in use
+	if (freeList == BVHNode::NULL_NODE) {
+		node = nodes.size();
+		nodes.push_back(BVHNode(sphere, parent));
+		nodeObjects.push_back(object);
+	}
+	else {
+		node = freeList;
+		freeList = nodes[node].parent;
+		nodes[node] = BVHNode(sphere, parent);
+		nodeObjects[node] = object;
+	}
+
+	return node;
+}
+
+
+void BoundingVolumeHierarchy::freeNode(unsigned int node) {
+	nodeObjects[node] = nullptr;
+	nodes[node].parent = freeList;
+	freeList = node;
+}
+
+
+unsigned int BoundingVolumeHierarchy::insert(
 	RigidObject* object,
 	const Vector3D& centre,
 	real radius
@@ -15,55 +89,916 @@ void BoundingVolumeHierarchy::insert(
 		bounding volume is. Its radius is the furthest point in the
 		bounding volume from that centre.
 	*/
-	BVHSphere sphere(centre, radius);
+	BVHSphere sphere(centre, radius * (1 + margin));
 
-	// If the tree is empty, create a root with the body in it, and no parent
-	if (root == nullptr) {
-		root = new BVHNode(object, sphere, nullptr);
+	/*
+		An object that is already in the tree keeps its leaf, which is
+		moved, so that it can never be found twice in the potential
+		contacts.
+	*/
+	auto existing = leaves.find(object);
+	if (existing != leaves.end()) {
+		removeLeaf(existing->second);
+		nodes[existing->second].boundingVolume = sphere;
+		insertLeaf(existing->second);
+		return existing->second;
+	}
+
+	unsigned int leaf = allocateNode(object, sphere, BVHNode::NULL_NODE);
+	leaves[object] = leaf;
+	insertLeaf(leaf);
+	return leaf;
+}
+
+
+unsigned int BoundingVolumeHierarchy::findBestSibling(
+	const BVHSphere& sphere
+) const {
+
+	unsigned int node = root;
+
+	while (!nodes[node].isLeaf()) {
+		const BVHNode& current = nodes[node];
+
+		/*
+			The cost of a tree is measured with the surface area
+			heuristic: the sum of the surface areas of its internal nodes,
+			as the probability of a query entering a node is proportional
+			to its area. If we pair the new leaf with this node, a new
+			parent is created with the area of the sphere encompassing
+			both.
+		*/
+		real combinedArea = BVHSphere(
+			current.boundingVolume, sphere
+		).getSurfaceArea();
+
+		/*
+			Pushing the leaf further down instead costs at least the
+			growth of this node, which then becomes an ancestor of the new
+			leaf, on top of the cost of pairing it with one of the children.
+		*/
+		real inheritanceCost = combinedArea
+			- current.boundingVolume.getSurfaceArea();
+
+		real childCost[2];
+		for (int i = 0; i < 2; i++) {
+			const BVHNode& child = nodes[current.children[i]];
+			real childCombinedArea = BVHSphere(
+				child.boundingVolume, sphere
+			).getSurfaceArea();
+			/*
+				A leaf child would get a new parent with the combined area,
+				while an internal child would only grow (at least).
+			*/
+			if (child.isLeaf()) {
+				childCost[i] = childCombinedArea + inheritanceCost;
+			}
+			else {
+				childCost[i] = childCombinedArea
+					- child.boundingVolume.getSurfaceArea()
+					+ inheritanceCost;
+			}
+		}
+
+		/*
+			We descend into the cheaper child, unless pairing the leaf
+			with this node directly is cheaper still.
+		*/
+		if (childCost[0] >= combinedArea && childCost[1] >= combinedArea) {
+			break;
+		}
+
+		/*
+			Near the top of the tree, the sphere is often inside both
+			children, which then cost nothing. Always taking the first
+			one would pile the leaves under it, so ties go to the child
+			whose centre is closest.
+		*/
+		unsigned int best = (childCost[0] < childCost[1]) ? 0 : 1;
+		if (childCost[0] == childCost[1]) {
+			real distance[2];
+			for (int i = 0; i < 2; i++) {
+				distance[i] = (nodes[current.children[i]].boundingVolume
+					.centre - sphere.centre).magnitudeSquared();
+			}
+			best = (distance[0] <= distance[1]) ? 0 : 1;
+		}
+		node = current.children[best];
+	}
+
+	return node;
+}
+
+
+void BoundingVolumeHierarchy::insertLeaf(unsigned int leaf) {
+
+	// If the tree is empty, the leaf becomes the root
+	if (root == BVHNode::NULL_NODE) {
+		root = leaf;
+		nodes[root].parent = BVHNode::NULL_NODE;
+		return;
+	}
+
+	unsigned int sibling = findBestSibling(nodes[leaf].boundingVolume);
+
+	/*
+		A new parent is created for the sibling (which can be a leaf or
+		not) and the new leaf, and takes the sibling's place under its old
+		parent, or becomes the root. Note that the sibling keeps its index,
+		so existing leaves never move to another node.
+	*/
+	unsigned int oldParent = nodes[sibling].parent;
+	unsigned int newParent = allocateNode(
+		nullptr,
+		BVHSphere(nodes[sibling].boundingVolume, nodes[leaf].boundingVolume),
+		oldParent
+	);
+
+	if (oldParent == BVHNode::NULL_NODE) {
+		root = newParent;
+	}
+	else if (nodes[oldParent].children[0] == sibling) {
+		nodes[oldParent].children[0] = newParent;
 	}
-	// Otherwise, call the insert function at the root
 	else {
-		root->insertInSubtree(object, sphere);
+		nodes[oldParent].children[1] = newParent;
 	}
+
+	nodes[newParent].children[0] = sibling;
+	nodes[newParent].children[1] = leaf;
+	nodes[sibling].parent = newParent;
+	nodes[leaf].parent = newParent;
+
+	// And we then recalculate the bounding volumes of all the ancestors
+	refit(newParent);
 }
 
 
-void BoundingVolumeHierarchy::removeSubtree(BVHNode* node) {
-	node->~BVHNode();
+void BoundingVolumeHierarchy::removeLeaf(unsigned int leaf) {
+
+	if (leaf == root) {
+		root = BVHNode::NULL_NODE;
+		return;
+	}
+
+	/*
+		Since the tree is always full, the leaf has a sibling, which
+		replaces their parent, so that the tree stays full.
+	*/
+	unsigned int parent = nodes[leaf].parent;
+	unsigned int grandParent = nodes[parent].parent;
+	unsigned int sibling = nodes[parent].children[0] == leaf ?
+		nodes[parent].children[1] : nodes[parent].children[0];
+
+	if (grandParent == BVHNode::NULL_NODE) {
+		root = sibling;
+		nodes[sibling].parent = BVHNode::NULL_NODE;
+	}
+	else {
+		if (nodes[grandParent].children[0] == parent) {
+			nodes[grandParent].children[0] = sibling;
+		}
+		else {
+			nodes[grandParent].children[1] = sibling;
+		}
+		nodes[sibling].parent = grandParent;
+
+		// And then recalculate the ancestors bounding volumes
+		refit(grandParent);
+	}
+
+	freeNode(parent);
 }
 
 
+void BoundingVolumeHierarchy::refit(unsigned int node) {
+	while (node != BVHNode::NULL_NODE) {
+		BVHNode& current = nodes[node];
+		/*
+			The new volume is then calculated by creating a new bounding
+			volume now encompassing its new children.
+		*/
+		current.boundingVolume = BVHSphere(
+			nodes[current.children[0]].boundingVolume,
+			nodes[current.children[1]].boundingVolume
+		);
 
-unsigned int BoundingVolumeHierarchy::auxGetPotentialContacts(
-	const BVHNode* node,
-	PotentialContact* contacts,
-	unsigned int limit
+		// The node is rebalanced before moving on to the ancestors
+		rotate(node);
+
+		node = current.parent;
+	}
+}
+
+
+void BoundingVolumeHierarchy::rotate(unsigned int node) {
+
+	BVHNode& current = nodes[node];
+
+	/*
+		The only internal node whose volume changes when a child swaps
+		places with a grandchild is the grandchild's old parent, so each
+		rotation is rated by how much it changes that node's area. The
+		best rotation is stored as the child that moves down, and the
+		grandchild that moves up.
+	*/
+	real bestChange = 0;
+	unsigned int down = BVHNode::NULL_NODE;
+	unsigned int up = BVHNode::NULL_NODE;
+
+	for (int i = 0; i < 2; i++) {
+		const BVHNode& child = nodes[current.children[i]];
+		const BVHNode& other = nodes[current.children[1 - i]];
+		if (other.isLeaf()) {
+			continue;
+		}
+		real otherArea = other.boundingVolume.getSurfaceArea();
+		for (int j = 0; j < 2; j++) {
+			// The child swaps places with the grandchild j
+			real change = BVHSphere(
+				child.boundingVolume,
+				nodes[other.children[1 - j]].boundingVolume
+			).getSurfaceArea() - otherArea;
+			if (change < bestChange) {
+				bestChange = change;
+				down = current.children[i];
+				up = other.children[j];
+			}
+		}
+	}
+
+	// If no rotation makes the tree cheaper, nothing is done
+	if (down == BVHNode::NULL_NODE) {
+		return;
+	}
+
+	unsigned int upParent = nodes[up].parent;
+	BVHNode& other = nodes[upParent];
+
+	if (current.children[0] == down) {
+		current.children[0] = up;
+	}
+	else {
+		current.children[1] = up;
+	}
+	nodes[up].parent = node;
+
+	if (other.children[0] == up) {
+		other.children[0] = down;
+	}
+	else {
+		other.children[1] = down;
+	}
+	nodes[down].parent = upParent;
+
+	other.boundingVolume = BVHSphere(
+		nodes[other.children[0]].boundingVolume,
+		nodes[other.children[1]].boundingVolume
+	);
+	current.boundingVolume = BVHSphere(
+		nodes[current.children[0]].boundingVolume,
+		nodes[current.children[1]].boundingVolume
+	);
+}
+
+
+void BoundingVolumeHierarchy::build(
+	std::span<RigidObject* const> objects,
+	std::span<const BVHSphere> spheres,
+	std::span<unsigned int> objectLeaves
+) {
+
+	assert(objects.size() == spheres.size()
+		&& "Each object needs exactly one sphere");
+	assert((objectLeaves.empty() || objectLeaves.size() == objects.size())
+		&& "Each object needs exactly one leaf");
+
+	clear();
+
+	if (objects.empty()) {
+		return;
+	}
+
+	// The spheres are enlarged by the margin, like inserted ones
+	std::vector<BVHSphere> fatSpheres;
+	fatSpheres.reserve(spheres.size());
+	for (const BVHSphere& sphere : spheres) {
+		fatSpheres.push_back(
+			BVHSphere(sphere.centre, sphere.radius * (1 + margin))
+		);
+	}
+
+	std::vector<unsigned int> order(objects.size());
+	for (unsigned int i = 0; i < order.size(); i++) {
+		order[i] = i;
+	}
+
+	/*
+		The tree is written directly into the pool, which is emptied
+		first. A full binary tree with n leaves has 2n - 1 nodes.
+	*/
+	unsigned int nodeCount = 2 * objects.size() - 1;
+	nodes.assign(
+		nodeCount,
+		BVHNode(BVHSphere(Vector3D(), 0), BVHNode::NULL_NODE)
+	);
+	nodeObjects.assign(nodeCount, nullptr);
+
+	/*
+		With threads, the top of the tree is built here, leaving the
+		subtrees under the parallel build size to the jobs (largest
+		first, as the job system deals them in order). The nodes above
+		them are then fitted around them, children first.
+	*/
+	bool deferred = jobSystem && jobSystem->getThreadCount() > 1 &&
+		objects.size() >= PARALLEL_BUILD_SIZE;
+	pendingSubtrees.clear();
+	pendingParents.clear();
+	buildRange(
+		0, BVHNode::NULL_NODE, order, 0, order.size(), objects, fatSpheres,
+		objectLeaves, deferred
+	);
+	if (deferred) {
+		std::sort(
+			pendingSubtrees.begin(),
+			pendingSubtrees.end(),
+			[](const PendingSubtree& one, const PendingSubtree& two) {
+				return one.end - one.begin > two.end - two.begin;
+			}
+		);
+		jobSystem->run(pendingSubtrees.size(),
+			[&](unsigned int job, unsigned int) {
+				const PendingSubtree& subtree = pendingSubtrees[job];
+				buildRange(
+					subtree.index, subtree.parent, order, subtree.begin,
+					subtree.end, objects, fatSpheres, objectLeaves, false
+				);
+			}
+		);
+		for (unsigned int node : pendingParents) {
+			nodes[node].boundingVolume = BVHSphere(
+				nodes[nodes[node].children[0]].boundingVolume,
+				nodes[nodes[node].children[1]].boundingVolume
+			);
+		}
+	}
+	root = 0;
+
+	for (unsigned int i = 0; i < nodeCount; i++) {
+		if (nodeObjects[i]) {
+			leaves[nodeObjects[i]] = i;
+		}
+	}
+}
+
+
+void BoundingVolumeHierarchy::buildRange(
+	unsigned int index,
+	unsigned int parent,
+	std::vector<unsigned int>& order,
+	unsigned int begin,
+	unsigned int end,
+	std::span<RigidObject* const> objects,
+	std::span<const BVHSphere> spheres,
+	std::span<unsigned int> objectLeaves,
+	bool deferred
+) {
+
+	unsigned int count = end - begin;
+
+	if (deferred && count < PARALLEL_BUILD_SIZE) {
+		pendingSubtrees.push_back({ index, parent, begin, end });
+		return;
+	}
+
+	if (count == 1) {
+		nodes[index] = BVHNode(spheres[order[begin]], parent);
+		nodeObjects[index] = objects[order[begin]];
+		if (!objectLeaves.empty()) {
+			objectLeaves[order[begin]] = index;
+		}
+		return;
+	}
+
+	// Finds the bounds of the centres, and the axis they spread most on
+	Vector3D minimum = spheres[order[begin]].centre;
+	Vector3D maximum = minimum;
+	for (unsigned int i = begin + 1; i < end; i++) {
+		const Vector3D& centre = spheres[order[i]].centre;
+		minimum.x = std::min(minimum.x, centre.x);
+		minimum.y = std::min(minimum.y, centre.y);
+		minimum.z = std::min(minimum.z, centre.z);
+		maximum.x = std::max(maximum.x, centre.x);
+		maximum.y = std::max(maximum.y, centre.y);
+		maximum.z = std::max(maximum.z, centre.z);
+	}
+	Vector3D extent = maximum - minimum;
+	int axis = 0;
+	if (extent.y > extent[axis]) axis = 1;
+	if (extent.z > extent[axis]) axis = 2;
+
+	unsigned int middle = begin + count / 2;
+	bool separated = false;
+
+	if (extent[axis] > 0) {
+		/*
+			Each centre falls into one of the bins along the axis, and
+			each bin gets the sphere encompassing the spheres in it.
+		*/
+		unsigned int binCount[BUILD_BINS] = {};
+		std::vector<BVHSphere> binSphere(BUILD_BINS, BVHSphere(Vector3D(), 0));
+		real scale = BUILD_BINS / extent[axis];
+
+		auto binOf = [&](unsigned int object) {
+			unsigned int bin = (unsigned int)(
+				(spheres[object].centre[axis] - minimum[axis]) * scale
+			);
+			return std::min(bin, BUILD_BINS - 1);
+		};
+
+		for (unsigned int i = begin; i < end; i++) {
+			unsigned int bin = binOf(order[i]);
+			if (binCount[bin] == 0) {
+				binSphere[bin] = spheres[order[i]];
+			}
+			else {
+				binSphere[bin] = BVHSphere(binSphere[bin], spheres[order[i]]);
+			}
+			binCount[bin]++;
+		}
+
+		/*
+			The cost of splitting after a bin is the area of each side
+			times the number of objects in it. The areas of the left sides
+			are accumulated in a first sweep, and those of the right sides
+			in a second sweep in the other direction.
+		*/
+		real leftCost[BUILD_BINS];
+		unsigned int leftCount = 0;
+		BVHSphere leftSphere(Vector3D(), 0);
+		for (unsigned int i = 0; i < BUILD_BINS - 1; i++) {
+			if (binCount[i] > 0) {
+				leftSphere = (leftCount == 0) ? binSphere[i]
+					: BVHSphere(leftSphere, binSphere[i]);
+				leftCount += binCount[i];
+			}
+			leftCost[i] = leftSphere.getSurfaceArea() * leftCount;
+		}
+
+		real bestCost = REAL_MAX;
+		unsigned int bestBin = BUILD_BINS;
+		unsigned int rightCount = 0;
+		BVHSphere rightSphere(Vector3D(), 0);
+		for (unsigned int i = BUILD_BINS - 1; i > 0; i--) {
+			if (binCount[i] > 0) {
+				rightSphere = (rightCount == 0) ? binSphere[i]
+					: BVHSphere(rightSphere, binSphere[i]);
+				rightCount += binCount[i];
+			}
+			// Splitting between bin i - 1 and i, with both sides non empty
+			if (rightCount > 0 && rightCount < count) {
+				real cost = leftCost[i - 1]
+					+ rightSphere.getSurfaceArea() * rightCount;
+				if (cost < bestCost) {
+					bestCost = cost;
+					bestBin = i - 1;
+				}
+			}
+		}
+
+		if (bestBin < BUILD_BINS) {
+			middle = std::partition(
+				order.begin() + begin,
+				order.begin() + end,
+				[&](unsigned int object) {
+					return binOf(object) <= bestBin;
+				}
+			) - order.begin();
+			separated = true;
+		}
+	}
+
+	/*
+		If the centres could not be separated (they are all in the same
+		place or bin), the objects are simply split in two halves.
+	*/
+	if (!separated) {
+		std::nth_element(
+			order.begin() + begin,
+			order.begin() + middle,
+			order.begin() + end,
+			[&](unsigned int one, unsigned int two) {
+				return spheres[one].centre[axis] < spheres[two].centre[axis];
+			}
+		);
+	}
+
+	/*
+		The left subtree takes the entries right after this node, and the
+		right subtree starts after the 2n - 1 entries of the left one.
+	*/
+	unsigned int left = index + 1;
+	unsigned int right = index + 2 * (middle - begin);
+
+	buildRange(
+		left, index, order, begin, middle, objects, spheres, objectLeaves,
+		deferred
+	);
+	buildRange(
+		right, index, order, middle, end, objects, spheres, objectLeaves,
+		deferred
+	);
+
+	// A deferred node is fitted once the subtrees under it are built
+	nodes[index] = BVHNode(
+		BVHSphere(nodes[left].boundingVolume, nodes[right].boundingVolume),
+		parent
+	);
+	nodes[index].children[0] = left;
+	nodes[index].children[1] = right;
+	if (deferred) {
+		pendingParents.push_back(index);
+	}
+}
+
+
+unsigned int BoundingVolumeHierarchy::getMortonCode(
+	unsigned int x,
+	unsigned int y,
+	unsigned int z
+) {
+	return (expandBits(x) << 2) | (expandBits(y) << 1) | expandBits(z);
+}
+
+
+void BoundingVolumeHierarchy::radixSort(
+	std::vector<unsigned int>& codes,
+	std::vector<unsigned int>& values
+) {
+	// The codes have 30 bits, sorted 10 bits at a time
+	const unsigned int DIGIT_BITS = 10;
+	const unsigned int DIGITS = 1 << DIGIT_BITS;
+
+	std::vector<unsigned int> sortedCodes(codes.size());
+	std::vector<unsigned int> sortedValues(values.size());
+	std::vector<unsigned int> start(DIGITS);
+
+	for (unsigned int shift = 0; shift < 30; shift += DIGIT_BITS) {
+		std::fill(start.begin(), start.end(), 0);
+		for (unsigned int code : codes) {
+			start[(code >> shift) & (DIGITS - 1)]++;
+		}
+
+		unsigned int sum = 0;
+		for (unsigned int& digitStart : start) {
+			unsigned int count = digitStart;
+			digitStart = sum;
+			sum += count;
+		}
+
+		for (unsigned int i = 0; i < codes.size(); i++) {
+			unsigned int position = start[(codes[i] >> shift) & (DIGITS - 1)]++;
+			sortedCodes[position] = codes[i];
+			sortedValues[position] = values[i];
+		}
+		codes.swap(sortedCodes);
+		values.swap(sortedValues);
+	}
+}
+
+
+void BoundingVolumeHierarchy::linkLinearNode(
+	unsigned int index,
+	const std::vector<unsigned int>& codes
+) {
+	long long count = codes.size();
+	long long i = index;
+
+	/*
+		Length of the prefix shared by the codes at two positions (-1
+		outside of the array). Equal codes are told apart by their
+		positions, as if those were appended to the codes.
+	*/
+	auto prefix = [&](long long j) -> int {
+		if (j < 0 || j >= count) {
+			return -1;
+		}
+		unsigned int difference = codes[i] ^ codes[j];
+		if (difference == 0) {
+			return 32 + std::countl_zero((unsigned int)(i ^ j));
+		}
+		return std::countl_zero(difference);
+	};
+
+	/*
+		The range of the node extends in the direction of the neighbour
+		sharing the longer prefix, and ends where the prefix becomes
+		shorter than the one shared with the other neighbour.
+	*/
+	long long direction = prefix(i + 1) > prefix(i - 1) ? 1 : -1;
+	int minimumPrefix = prefix(i - direction);
+
+	long long maximumLength = 2;
+	while (prefix(i + maximumLength * direction) > minimumPrefix) {
+		maximumLength *= 2;
+	}
+	long long length = 0;
+	for (long long step = maximumLength / 2; step > 0; step /= 2) {
+		if (prefix(i + (length + step) * direction) > minimumPrefix) {
+			length += step;
+		}
+	}
+	long long end = i + length * direction;
+
+	/*
+		The split is the last position sharing more than the prefix of
+		the whole range with the first position.
+	*/
+	int nodePrefix = prefix(end);
+	long long split = 0;
+	long long step = length;
+	do {
+		step = (step + 1) / 2;
+		if (prefix(i + (split + step) * direction) > nodePrefix) {
+			split += step;
+		}
+	} while (step > 1);
+	split = i + split * direction + std::min(direction, 0LL);
+
+	/*
+		The internal nodes are at the start of the pool, and the leaves
+		after them, so a child covering a single position is a leaf.
+	*/
+	unsigned int firstLeaf = count - 1;
+	unsigned int left = std::min(i, end) == split ?
+		firstLeaf + split : split;
+	unsigned int right = std::max(i, end) == split + 1 ?
+		firstLeaf + split + 1 : split + 1;
+
+	nodes[index].children[0] = left;
+	nodes[index].children[1] = right;
+	nodes[left].parent = index;
+	nodes[right].parent = index;
+}
+
+
+void BoundingVolumeHierarchy::buildLinear(
+	std::span<RigidObject* const> objects,
+	std::span<const BVHSphere> spheres,
+	std::span<unsigned int> objectLeaves
+) {
+
+	assert(objects.size() == spheres.size()
+		&& "Each object needs exactly one sphere");
+	assert((objectLeaves.empty() || objectLeaves.size() == objects.size())
+		&& "Each object needs exactly one leaf");
+
+	clear();
+
+	if (objects.empty()) {
+		return;
+	}
+	unsigned int count = objects.size();
+
+	// The centres are quantised inside the box containing all of them
+	Vector3D minimum = spheres[0].centre;
+	Vector3D maximum = spheres[0].centre;
+	for (const BVHSphere& sphere : spheres) {
+		for (int axis = 0; axis < 3; axis++) {
+			minimum[axis] = std::min(minimum[axis], sphere.centre[axis]);
+			maximum[axis] = std::max(maximum[axis], sphere.centre[axis]);
+		}
+	}
+	real scale[3];
+	for (int axis = 0; axis < 3; axis++) {
+		real extent = maximum[axis] - minimum[axis];
+		scale[axis] = extent > 0 ? 1023 / extent : 0;
+	}
+
+	std::vector<unsigned int> codes(count);
+	std::vector<unsigned int> order(count);
+	parallelFor(jobSystem, count, PARALLEL_BUILD_SIZE,
+		[&](unsigned int begin, unsigned int end) {
+			for (unsigned int i = begin; i < end; i++) {
+				unsigned int cell[3];
+				for (int axis = 0; axis < 3; axis++) {
+					cell[axis] = (unsigned int)(
+						(spheres[i].centre[axis] - minimum[axis])
+						* scale[axis]
+					);
+				}
+				codes[i] = getMortonCode(cell[0], cell[1], cell[2]);
+				order[i] = i;
+			}
+		}
+	);
+	radixSort(codes, order);
+
+	/*
+		The n - 1 internal nodes come first, starting with the root, and
+		the n leaves follow in the order of the codes.
+	*/
+	unsigned int nodeCount = 2 * count - 1;
+	unsigned int firstLeaf = count - 1;
+	nodes.assign(
+		nodeCount,
+		BVHNode(BVHSphere(Vector3D(), 0), BVHNode::NULL_NODE)
+	);
+	nodeObjects.assign(nodeCount, nullptr);
+
+	for (unsigned int i = 0; i < count; i++) {
+		const BVHSphere& sphere = spheres[order[i]];
+		nodes[firstLeaf + i].boundingVolume = BVHSphere(
+			sphere.centre, sphere.radius * (1 + margin)
+		);
+		nodeObjects[firstLeaf + i] = objects[order[i]];
+	}
+
+	parallelFor(jobSystem, count - 1, PARALLEL_BUILD_SIZE,
+		[&](unsigned int begin, unsigned int end) {
+			for (unsigned int i = begin; i < end; i++) {
+				linkLinearNode(i, codes);
+			}
+		}
+	);
+
+	/*
+		Each leaf climbs the tree, stopping at the nodes its sibling
+		hasn't reached yet. The last child to arrive at a node knows
+		both volumes are ready.
+	*/
+	std::unique_ptr<std::atomic<unsigned int>[]> arrivals(
+		new std::atomic<unsigned int>[nodeCount]()
+	);
+	parallelFor(jobSystem, count, PARALLEL_BUILD_SIZE,
+		[&](unsigned int begin, unsigned int end) {
+			for (unsigned int i = begin; i < end; i++) {
+				unsigned int node = nodes[firstLeaf + i].parent;
+				while (node != BVHNode::NULL_NODE &&
+					arrivals[node].fetch_add(1) == 1) {
+					nodes[node].boundingVolume = BVHSphere(
+						nodes[nodes[node].children[0]].boundingVolume,
+						nodes[nodes[node].children[1]].boundingVolume
+					);
+					node = nodes[node].parent;
+				}
+			}
+		}
+	);
+	root = 0;
+
+	for (unsigned int i = 0; i < count; i++) {
+		leaves[objects[order[i]]] = firstLeaf + i;
+	}
+	if (!objectLeaves.empty()) {
+		for (unsigned int i = 0; i < count; i++) {
+			objectLeaves[order[i]] = firstLeaf + i;
+		}
+	}
+}
+
+
+unsigned int BoundingVolumeHierarchy::countMoved(
+	std::span<const unsigned int> objectLeaves,
+	std::span<const BVHSphere> spheres
 ) const {
-	if (node == nullptr || limit == 0) return 0;
+	unsigned int moved = 0;
+	for (unsigned int i = 0; i < objectLeaves.size(); i++) {
+		if (objectLeaves[i] == BVHNode::NULL_NODE) {
+			moved++;
+			continue;
+		}
+		const BVHSphere& fat = nodes[objectLeaves[i]].boundingVolume;
+		if ((spheres[i].centre - fat.centre).magnitude()
+			+ spheres[i].radius > fat.radius) {
+			moved++;
+		}
+	}
+	return moved;
+}
 
-	unsigned int count = 0;
 
-	// Traversing left subtree
-	count += auxGetPotentialContacts(node->children[0], contacts, limit);
-	limit -= count;
+void BoundingVolumeHierarchy::remove(RigidObject* object) {
+	auto leaf = leaves.find(object);
+	if (leaf != leaves.end()) {
+		removeLeaf(leaf->second);
+		freeNode(leaf->second);
+		leaves.erase(leaf);
+	}
+}
+
+
+bool BoundingVolumeHierarchy::update(
+	RigidObject* object,
+	const Vector3D& centre,
+	real radius
+) {
+	auto leaf = leaves.find(object);
+	if (leaf == leaves.end()) {
+		return false;
+	}
+	return updateLeaf(leaf->second, centre, radius);
+}
+
+
+bool BoundingVolumeHierarchy::updateLeaf(
+	unsigned int leaf,
+	const Vector3D& centre,
+	real radius
+) {
 
-	// Current node
-	if (limit > 0) {
-		count += node->getPotentialContacts(contacts + count, limit);
-		limit -= count;
+	/*
+		The object's sphere is inside the fat sphere if the distance
+		between the centres plus its radius doesn't exceed the fat radius.
+	*/
+	BVHSphere& fat = nodes[leaf].boundingVolume;
+	if ((centre - fat.centre).magnitude() + radius <= fat.radius) {
+		return false;
 	}
 
-	// Traversing the right subtree
-	count += auxGetPotentialContacts(node->children[1], contacts + count, limit);
+	// The same node is reinserted with its new fat sphere
+	removeLeaf(leaf);
+	fat = BVHSphere(centre, radius * (1 + margin));
+	insertLeaf(leaf);
+	return true;
+}
+
 
+void BoundingVolumeHierarchy::clear() {
+	nodes.clear();
+	nodeObjects.clear();
+	leaves.clear();
+	root = BVHNode::NULL_NODE;
+	freeList = BVHNode::NULL_NODE;
+}
+
+
+unsigned int BoundingVolumeHierarchy::getPotentialContacts(
+	std::vector<PotentialContact>& contacts
+) const {
+	unsigned int count = 0;
+	forEachPotentialContact([&](RigidObject* one, RigidObject* two) {
+		contacts.push_back(PotentialContact{ { one, two } });
+		count++;
+	});
 	return count;
 }
 
 
 unsigned int BoundingVolumeHierarchy::getPotentialContacts(
-	PotentialContact* contacts, 
-	unsigned int limit
+	PotentialContact* contacts,
+	unsigned int limit,
+	unsigned int* overflow
 ) const {
-	// Calling the auxiliary function with the root node
-	return auxGetPotentialContacts(root, contacts, limit);
-}
\ No newline at end of file
+	/*
+		The whole tree is still traversed once the array is full, so that
+		the number of lost pairs can be reported.
+	*/
+	unsigned int count = 0;
+	unsigned int lost = 0;
+	forEachPotentialContact([&](RigidObject* one, RigidObject* two) {
+		if (count < limit) {
+			contacts[count].object[0] = one;
+			contacts[count].object[1] = two;
+			count++;
+		}
+		else {
+			lost++;
+		}
+	});
+	if (overflow) {
+		*overflow = lost;
+	}
+	return count;
+}
+
+
+unsigned int BoundingVolumeHierarchy::auxGetHeight(
+	unsigned int node
+) const {
+	if (node == BVHNode::NULL_NODE) return 0;
+	unsigned int left = auxGetHeight(nodes[node].children[0]);
+	unsigned int right = auxGetHeight(nodes[node].children[1]);
+	return 1 + (left > right ? left : right);
+}
+
+
+real BoundingVolumeHierarchy::auxGetInternalArea(
+	unsigned int node
+) const {
+	if (node == BVHNode::NULL_NODE || nodes[node].isLeaf()) return 0;
+	return nodes[node].boundingVolume.getSurfaceArea()
+		+ auxGetInternalArea(nodes[node].children[0])
+		+ auxGetInternalArea(nodes[node].children[1]);
+}
+
+
+unsigned int BoundingVolumeHierarchy::getHeight() const {
+	return auxGetHeight(root);
+}
+
+
+real BoundingVolumeHierarchy::getSAHCost() const {
+	if (root == BVHNode::NULL_NODE || nodes[root].isLeaf()) return 0;
+	return auxGetInternalArea(root) / nodes[root].boundingVolume.getSurfaceArea();
+}
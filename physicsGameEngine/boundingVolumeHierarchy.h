@@ -32,34 +32,83 @@
 	tree dynamically (e.g. there is no need to build the tree during a
 	loading time before the physics can be rendered). It also allows us to
 	add and remove objects from the hierarchy in real time.
-	The insertion and removal of a node are already functions in the BHVNode
-	class (the removal is just the destructor, although it also handles things
-	like recalculating the bounding volumes of the ancestors of the node,
-	just like the insertion function), where they operate on inserting nodes
-	only in the subtree descending from the calling object node, or removing
-	the calling object node itself. This class provides the ability to add
-	and remove nodes from the entire tree, so the insertion function always
-	calls the insert function of the root node, while the remove function
-	calls whichever node (or entire subtree for non-leaf nodes) we want
-	removed. So this class is little more than a wrapper for the root node
-	of the tree.
-	Note that because we always replace a leaf by a parent of the old
-	leaf and the new node, and because we always replace a parent by the
-	remaining node whenever we remove a node, the hierarchy is always a
+	Objects added in a line or a grid would quickly turn such a tree into
+	something closer to a linked list, so the insertion uses the surface
+	area heuristic to choose where to place a new leaf, and the ancestors
+	of an inserted or removed node are rotated on the way up to keep the
+	tree balanced.
+	The top-down approach is also available through the build function,
+	for when many objects are known at once (like the static props of a
+	level, which would give a poor tree and many allocations if they were
+	inserted one by one), or to periodically rebuild the whole dynamic
+	tree. The objects are split recursively along the longest axis of
+	their centres, at the position chosen by the surface area heuristic
+	among a fixed number of bins. The nodes are laid out in a flat array
+	in depth first order, where a node with n objects in its subtree
+	always takes 2n - 1 entries, so the index of each child is known
+	before its sibling is built, and the subtrees below the top of the
+	tree can be built in parallel.
+	When nearly every object moves each step (explosions, avalanches),
+	reinserting them one by one costs more than building a new tree, and
+	the linear builder is faster still than the top-down one. Each centre
+	is given a Morton code, interleaving the bits of its quantised
+	coordinates, so that sorting the codes (with a radix sort) places
+	objects close in space next to each other, along a curve filling the
+	space. The sorted codes define the tree: each internal node covers a
+	range of codes sharing a prefix, split where the next bit changes,
+	and each node finds its own range and split with binary searches,
+	independently of the others, so all of them can be built in
+	parallel. The volumes are then refitted from the leaves up, also in
+	parallel,
+	where the second of the two children to reach a node computes its
+	volume and carries on upwards. The tree is worse than one built with
+	the surface area heuristic, but it takes linear time to build.
+	Both builders only work in parallel on the threads of the job system
+	given to the tree (the world gives it its own), and build on the
+	calling thread otherwise. The tree they build is the same either way.
+	The nodes are stored in a pool (a contiguous array) owned by this
+	class, and link to each other by index, so inserting and removing
+	nodes reuses the unused entries of the pool instead of allocating
+	memory, and a tree built top-down is written directly into the pool.
+	The object of each leaf is kept in a separate array, at the index of
+	its node, so that the traversal only touches the small nodes until a
+	pair of leaves is found.
+	Note that because we always replace a node by a parent of the old
+	node and the new leaf, and because we always replace a parent by the
+	remaining node whenever we remove a leaf, the hierarchy is always a
 	full binary tree where each node has 0 or 2 children, but never 1.
 
 	Another advantage of a BVH is that it ensures each pair of objects
 	in potential contacts are considered once. If we were to simply
 	check each pair of objects, we might by mistake repeat each pair
-	twice, once in each order.
+	twice, once in each order. Since an object is only ever held by one
+	leaf (inserting an object that is already in the tree just moves its
+	leaf), no pair can be found twice, and no object is paired with
+	itself.
+	The pairs are found by traversing the tree with an explicit stack of
+	node pairs instead of recursion, so a degenerate tree can't overflow
+	the call stack, and the stack's memory is reused between queries.
+
+	The tree is meant to persist from one step to the next rather than be
+	rebuilt every time. Each leaf is stored with a fattened sphere, whose
+	radius is the object's radius enlarged by a margin, and the update
+	function is called with the object's new sphere each step. As long as
+	the object's sphere is still inside its fat sphere, nothing is done,
+	so static and slow objects cost nothing. Otherwise, the leaf is
+	removed and inserted again with a new fat sphere, and the volumes of
+	the ancestors are refitted bottom-up using the parent pointers.
+	A larger margin means fewer reinsertions, but also looser spheres and
+	so more potential contacts for the fine collision detection.
 */
 
 #ifndef BOUNDING_VOLUME_HIERARCHY_H
 #define BOUNDING_VOLUME_HIERARCHY_H
 
 #include "BVHNode.h"
-#include <iostream>
-#include <iomanip>
+#include "jobSystem.h"
+#include <unordered_map>
+#include <algorithm>
+#include <span>
 
 namespace pe {
 
@@ -67,75 +116,431 @@ namespace pe {
 
 	private:
 
-		// Represents the root of the tree
-		BVHNode* root;
+		// Pool of nodes, some of which are unused
+		std::vector<BVHNode> nodes;
 
+		/*
+			Object held by each node of the pool, stored apart from the
+			nodes as only the leaves have one (nullptr otherwise).
+		*/
+		std::vector<RigidObject*> nodeObjects;
 
-		// Auxiliary function for inorder traversal
-		unsigned int auxGetPotentialContacts(
-			const BVHNode* node,
-			PotentialContact* contacts,
-			unsigned int limit
-		) const;
+		// Index of the root of the tree
+		unsigned int root;
+
+		/*
+			Index of the first unused node of the pool. The unused nodes
+			form a linked list through their parent index.
+		*/
+		unsigned int freeList;
+
+		/*
+			Fraction of the radius by which the spheres of the leaves are
+			enlarged (0.1 means a fat sphere 10% larger than the object's).
+		*/
+		real margin;
+
+		/*
+			Leaf node holding each object, used to find it when it moves.
+			Callers that keep the leaves of their objects themselves (see
+			the functions taking leaves) don't need to look them up here.
+		*/
+		std::unordered_map<RigidObject*, unsigned int> leaves;
+
+
+		/*
+			Takes an unused node from the pool (growing it if there are
+			none) and initialises it as a leaf, or an internal node if
+			the object is nullptr.
+		*/
+		unsigned int allocateNode(
+			RigidObject* object,
+			const BVHSphere& sphere,
+			unsigned int parent
+		);
+
+		// Returns a node to the pool
+		void freeNode(unsigned int node);
+
+		/*
+			Finds the node (leaf or not) with which a new leaf with the
+			given sphere should be paired, by descending the tree using
+			the surface area heuristic, choosing at each node whichever
+			child adds the least surface area to the tree, and stopping
+			when pairing the leaf with the node itself is cheaper.
+		*/
+		unsigned int findBestSibling(const BVHSphere& sphere) const;
+
+		/*
+			Places the given leaf in the tree, as the sibling of the node
+			chosen by the surface area heuristic.
+		*/
+		void insertLeaf(unsigned int leaf);
+
+		/*
+			Takes the given leaf out of the tree, without freeing it. Its
+			parent is removed and its sibling takes its parent's place.
+		*/
+		void removeLeaf(unsigned int leaf);
+
+		/*
+			Recalculates the bounding volume of the given node and of all
+			of its ancestors, rotating each of them on the way up, which
+			keeps the tree balanced after insertions and removals.
+		*/
+		void refit(unsigned int node);
+
+		/*
+			Swaps one of the children of the node with one of the children
+			of its other child (a grandchild), if that reduces the surface
+			area of the tree. Only the volumes of the node and of the
+			grandchild's old parent change, and the node stays in place,
+			so the root of the tree is never rotated away.
+		*/
+		void rotate(unsigned int node);
+
+		// Auxiliary functions for the height and cost of the tree
+		unsigned int auxGetHeight(unsigned int node) const;
+		real auxGetInternalArea(unsigned int node) const;
+
+
+		// Number of bins along which the split positions are evaluated
+		static constexpr unsigned int BUILD_BINS = 16;
+
+		/*
+			Fewest objects for a build to be spread among the threads, and
+			for the top-down builder, the size under which a subtree is
+			built by a job of its own.
+		*/
+		static constexpr unsigned int PARALLEL_BUILD_SIZE = 4096;
+
+		/*
+			Threads the builds are spread among, or null to build on the
+			calling thread.
+		*/
+		JobSystem* jobSystem;
+
+		// A subtree left for a job, with its range of the order array
+		struct PendingSubtree {
+			unsigned int index;
+			unsigned int parent;
+			unsigned int begin;
+			unsigned int end;
+		};
+
+		/*
+			Subtrees the top-down builder left for the jobs, and the
+			nodes above them, children first, whose volumes are fitted
+			once the jobs are done.
+		*/
+		std::vector<PendingSubtree> pendingSubtrees;
+		std::vector<unsigned int> pendingParents;
+
+		/*
+			Builds the subtree of the objects in the given range of the
+			order array at the given index of the pool, with the given
+			parent. The order array is partitioned in place. Subtrees only
+			write to their own range of the pool, so they can be built in
+			parallel: if the build is deferred, the subtrees under the
+			parallel build size are left in the pending subtrees instead.
+		*/
+		void buildRange(
+			unsigned int index,
+			unsigned int parent,
+			std::vector<unsigned int>& order,
+			unsigned int begin,
+			unsigned int end,
+			std::span<RigidObject* const> objects,
+			std::span<const BVHSphere> spheres,
+			std::span<unsigned int> objectLeaves,
+			bool deferred
+		);
+
+
+		/*
+			Returns the Morton code of a point whose coordinates have been
+			quantised to 10 bits each, with the bits of the three
+			coordinates interleaved.
+		*/
+		static unsigned int getMortonCode(
+			unsigned int x,
+			unsigned int y,
+			unsigned int z
+		);
+
+		/*
+			Sorts the codes in increasing order with a radix sort, moving
+			the values along with them. The sort is stable.
+		*/
+		static void radixSort(
+			std::vector<unsigned int>& codes,
+			std::vector<unsigned int>& values
+		);
+
+		/*
+			Sets the children of the internal node of the given index in a
+			linear build, from the sorted codes of the objects.
+		*/
+		void linkLinearNode(
+			unsigned int index,
+			const std::vector<unsigned int>& codes
+		);
+
+
+		// Checks if the bounding volumes of two nodes overlap
+		bool overlaps(unsigned int one, unsigned int two) const {
+			return nodes[one].boundingVolume.overlaps(
+				&nodes[two].boundingVolume
+			);
+		}
+
+		/*
+			Pair of nodes on the traversal stack. When both are the same
+			node, the pair stands for the potential contacts inside that
+			node's subtree, otherwise for those between the two subtrees.
+		*/
+		struct NodePair {
+			unsigned int one;
+			unsigned int two;
+		};
+
+		/*
+			Stack used by the traversal, kept as a member so that its
+			memory is reused from one query to the next.
+		*/
+		mutable std::vector<NodePair> traversalStack;
+
+		/*
+			Traverses the tree and calls the given function with the two
+			objects of each potential contact.
+		*/
+		template <typename Function>
+		void forEachPotentialContact(Function function) const;
 
 	public:
 
-		BoundingVolumeHierarchy() : root {nullptr} {}
+		/*
+			The margin defaults to 0, so that a tree built once and thrown
+			away has tight spheres.
+		*/
+		BoundingVolumeHierarchy(real margin = 0) :
+			root{ BVHNode::NULL_NODE }, freeList{ BVHNode::NULL_NODE },
+			margin{ margin }, jobSystem{ nullptr } {}
+
+
+		/*
+			Sets the job system the builds are spread on (none by
+			default), which must not be running a batch when the tree is
+			built.
+		*/
+		void setJobSystem(JobSystem* jobSystem) {
+			this->jobSystem = jobSystem;
+		}
+
 
 		/*
 			Inserts an index corresponding to a body accompanied by its
-			bounding volume into the tree.
+			bounding volume into the tree. The stored sphere is enlarged
+			by the margin. Returns the leaf holding the object, which
+			keeps its index until the object is removed or the tree is
+			built again.
 		*/
-		void insert(
+		unsigned int insert(
 			RigidObject* object,
 			const Vector3D& centre,
 			real radius
 		);
 
 		/*
-			Removes an entire subtree (could just be a leaf) from the tree by
-			calling its destructor, which handles all other changes like
-			recalculating the bounding volumes for the ancestors and making
-			the sibling the parent.
+			Replaces the whole tree by one built top-down from the given
+			objects and their spheres (given in the same order), which
+			are enlarged by the margin just like inserted ones. Gives a
+			better tree than inserting the objects one by one.
+			If given, the leaf of each object is written to the array of
+			leaves, in the same order.
 		*/
-		void removeSubtree(BVHNode* node);
+		void build(
+			std::span<RigidObject* const> objects,
+			std::span<const BVHSphere> spheres,
+			std::span<unsigned int> objectLeaves = {}
+		);
 
-		
-		// Remove later
-		void displayAux(std::ostream& out, BVHNode* ptr, int indent) {
-			if (ptr == NULL)
-				return;
-			displayAux(out, ptr->children[0], indent + 8);
-			Vector3D centre = ptr->boundingVolume.centre;
-			real radius = ptr->boundingVolume.radius;
-			std::cout << std::setw(indent) << " " << ptr->object << "\n";
-			displayAux(out, ptr->children[1], indent + 8);
-		}
+		/*
+			Replaces the whole tree by one built from the Morton codes of
+			the centres of the given objects, enlarged by the margin. The
+			tree is built in linear time, and is meant to be rebuilt when
+			most objects have moved.
+		*/
+		void buildLinear(
+			std::span<RigidObject* const> objects,
+			std::span<const BVHSphere> spheres,
+			std::span<unsigned int> objectLeaves = {}
+		);
 
+		/*
+			Returns the number of the given leaves (with the current
+			spheres of their objects, in the same order) whose objects
+			have left their fat spheres, counting NULL_NODE as an object
+			that is not in the tree. Used to choose between updating the
+			tree and building it again.
+		*/
+		unsigned int countMoved(
+			std::span<const unsigned int> objectLeaves,
+			std::span<const BVHSphere> spheres
+		) const;
+
+		/*
+			Removes the leaf holding the given object, if there is one,
+			and refits the volumes of its ancestors.
+		*/
+		void remove(RigidObject* object);
 
-		BVHNode* getRoot() {
-			return root;
+		/*
+			Gives the tree the current sphere of an object already in it.
+			If the sphere has left the fat sphere of the object's leaf, the
+			leaf is reinserted with a new fat sphere, and true is returned.
+			Otherwise the tree is left untouched and false is returned.
+		*/
+		bool update(
+			RigidObject* object,
+			const Vector3D& centre,
+			real radius
+		);
+
+		// Same, given the leaf of the object instead
+		bool updateLeaf(
+			unsigned int leaf,
+			const Vector3D& centre,
+			real radius
+		);
+
+		// Removes all the objects (the pool keeps its memory)
+		void clear();
+
+		// Number of objects in the tree
+		unsigned int getObjectCount() const {
+			return leaves.size();
+		}
+
+		// Number of nodes the pool can hold without growing
+		unsigned int getNodeCapacity() const {
+			return nodes.size();
 		}
 
+		/*
+			Returns the number of nodes on the longest path from the root
+			to a leaf (0 for an empty tree). A balanced tree of n objects
+			has a height close to log2(n) + 1.
+		*/
+		unsigned int getHeight() const;
+
+		/*
+			Returns the cost of the tree according to the surface area
+			heuristic: the sum of the surface areas of the internal nodes,
+			divided by that of the root. Lower is better, and it can be
+			used to compare trees holding the same objects, for instance
+			to make sure the tree remains good after objects are added,
+			removed and moved around.
+		*/
+		real getSAHCost() const;
+
+
+		/*
+			Appends all potential contacts in all of the BVH tree to the
+			given buffer, which grows as needed, so no pair is ever lost.
+			Returns the number of potential contacts added.
+			Note that it is not enough to just check the two children of
+			the root against each other, because that only finds the
+			collisions between any nodes in the left subtree with nodes in
+			the right subtree, but not the collisions internally in the
+			left and right subtree. To get those, we need to traverse the
+			tree, and check the children of each internal node.
+		*/
+		unsigned int getPotentialContacts(
+			std::vector<PotentialContact>& contacts
+		) const;
 
 		/*
-			Returns all potential contacts in all of the BVH tree.
-			Note that it is not enough to just call
-			root->getPotentialContacts(), because the getPotentialContacts
-			of the BVHNode just checks for collisions between any nodes in the
-			left subtree with nodes in the right subtree, but does not check
-			for collisions internally in the left and right subtree.
-			To get those, we need to traverse the tree, and call
-			the function on each node that isn't null.
+			Fills the given array with potential contacts, up to the limit,
+			and returns the number written. The number of potential
+			contacts that didn't fit is stored in the overflow parameter
+			if it isn't nullptr, so that the caller knows pairs were lost.
 		*/
 		unsigned int getPotentialContacts(
 			PotentialContact* contacts,
-			unsigned int  limit
+			unsigned int  limit,
+			unsigned int* overflow = nullptr
 		) const;
+	};
 
 
-	};
+	template <typename Function>
+	void BoundingVolumeHierarchy::forEachPotentialContact(
+		Function function
+	) const {
+
+		traversalStack.clear();
+		if (root == BVHNode::NULL_NODE) {
+			return;
+		}
+		traversalStack.push_back(NodePair{ root, root });
+
+		while (!traversalStack.empty()) {
+			NodePair pair = traversalStack.back();
+			traversalStack.pop_back();
 
+			const BVHNode& one = nodes[pair.one];
+			const BVHNode& two = nodes[pair.two];
+
+			/*
+				The potential contacts inside a subtree are those inside
+				each of its children, and those between its two children.
+				A leaf has none.
+			*/
+			if (pair.one == pair.two) {
+				if (!one.isLeaf()) {
+					traversalStack.push_back(
+						NodePair{ one.children[0], one.children[0] }
+					);
+					traversalStack.push_back(
+						NodePair{ one.children[1], one.children[1] }
+					);
+					traversalStack.push_back(
+						NodePair{ one.children[0], one.children[1] }
+					);
+				}
+				continue;
+			}
+
+			/*
+				If the bounding volumes of the two nodes don't overlap,
+				then none of the bodies in the first subtree will overlap
+				with a body in the second subtree.
+			*/
+			if (!overlaps(pair.one, pair.two)) {
+				continue;
+			}
+
+			// If both nodes are leaves, then they are a potential contact
+			if (one.isLeaf() && two.isLeaf()) {
+				function(nodeObjects[pair.one], nodeObjects[pair.two]);
+			}
+			/*
+				Otherwise, we descend into the non-leaf node, or into the
+				larger one if neither is a leaf, until we always end up
+				comparing two leaves.
+			*/
+			else if (two.isLeaf() || (!one.isLeaf() &&
+				one.boundingVolume.getSize() >= two.boundingVolume.getSize())) {
+				traversalStack.push_back(NodePair{ one.children[0], pair.two });
+				traversalStack.push_back(NodePair{ one.children[1], pair.two });
+			}
+			else {
+				traversalStack.push_back(NodePair{ pair.one, two.children[0] });
+				traversalStack.push_back(NodePair{ pair.one, two.children[1] });
+			}
+		}
+	}
 }
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,483 @@
+/*
+	Benchmark of the broad phases (coarse collision detection) on scaled up
+	versions of the ball pit and wrecking ball scenes.
+	Only the broad phase is measured, so the bodies are moved with a simple
+	kinematic update instead of the whole pipeline (there is no collision
+	response), which keeps the motion the same for both broad phases and
+	lets the scenes reach 50000 bodies.
+		The ball pit has the 13 static walls, pillars, planks and floor of
+		the simulation, spread out so that the balls have about the same
+		density, and the balls are dropped into it from random heights,
+		bouncing off the floor and walls.
+		The wrecking ball has a lattice of touching cubes on a large
+		ground, through which a swinging ball pushes the cubes it hits,
+		so most of the cubes don't move at any given time.
+	The bodies are first given to the broad phase all at once (the hierarchy
+	is built top-down, like a level being loaded). Then each step, every
+	body gives its new sphere to the broad phase, and the potential contacts
+	are collected in a reused buffer, like in the world.
+	The quality of the hierarchy is also checked on the ball pit: the tree
+	built top-down is compared with one made by inserting the objects one
+	by one in a random order, and with that tree after many objects have
+	been removed and inserted elsewhere, as in a world where objects are
+	added and leave their fat spheres. The height, the cost of the tree
+	(see getSAHCost) and the time of a query should stay close to those
+	of the built tree.
+*/
+
+#include "benchmarks.h"
+#include "boundingVolumeHierarchy.h"
+#include "sweepAndPrune.h"
+#include "boundingSphere.h"
+#include "sphere.h"
+#include <chrono>
+#include <random>
+#include <functional>
+#include <deque>
+#include <numeric>
+#include <algorithm>
+#include <iomanip>
+
+using namespace pe;
+
+
+namespace {
+
+	// Number of steps simulated before, and while, measuring
+	const int WARMUP_STEPS = 5;
+	const int MEASURED_STEPS = 20;
+
+	const real STEP = 1.0 / 60.0;
+
+
+	/*
+		Bodies of a scene. The rigid objects are only used for their body
+		(position and velocity) and as the identity of the potential
+		contacts, so they all share a mesh. The bounding volumes are kept
+		in a deque, which doesn't move them as it grows.
+	*/
+	struct BenchmarkScene {
+		std::vector<RigidObject*> objects;
+		std::vector<real> radii;
+		std::deque<BoundingSphere> boundingVolumes;
+
+		// Moves the bodies during one step of the given index
+		std::function<void(BenchmarkScene&, int)> step;
+
+		~BenchmarkScene() {
+			for (RigidObject* object : objects) {
+				delete object;
+			}
+		}
+
+		void add(Mesh* mesh, const Vector3D& position, real radius) {
+			boundingVolumes.emplace_back(radius);
+			objects.push_back(
+				new RigidObject(mesh, &boundingVolumes.back(), position)
+			);
+			radii.push_back(radius);
+		}
+	};
+
+
+	/*
+		Fills the scene with the ball pit, made for the given number of
+		balls.
+	*/
+	void createBallPit(BenchmarkScene& scene, Mesh* mesh, int balls) {
+
+		const real ballRadius = 70;
+
+		/*
+			The pit of the simulation is 1000 units wide for about 50 balls,
+			so it is scaled so that each ball has the same room.
+		*/
+		real scale = std::max((real)1, realSqrt(balls / (real)50));
+		real half = 550 * scale;
+
+		// Static walls, pillars, planks and floor (width, height, depth)
+		auto addBox = [&](real x, real y, real z, real w, real h, real d) {
+			scene.add(
+				mesh,
+				Vector3D(x, y, z),
+				realSqrt(w * w + h * h + d * d) * 0.5
+			);
+		};
+		addBox(-half, 250, 0, 100, 400, 1200 * scale);
+		addBox(half, 250, 0, 100, 400, 1200 * scale);
+		addBox(0, 250, half, 1200 * scale, 400, 100);
+		addBox(0, 250, -half, 1200 * scale, 400, 100);
+		for (int i = -1; i <= 1; i += 2) {
+			for (int j = -1; j <= 1; j += 2) {
+				addBox(400 * scale * i, 250, 400 * scale * j,
+					400 * scale, 400, 400 * scale);
+			}
+		}
+		addBox(325 * scale, 210, 0, 580 * scale, 10, 400 * scale);
+		addBox(-325 * scale, 210, 0, 580 * scale, 10, 400 * scale);
+		addBox(0, 210, 325 * scale, 400 * scale, 10, 580 * scale);
+		addBox(0, 210, -325 * scale, 400 * scale, 10, 580 * scale);
+		addBox(0, 0, 0, 1200 * scale, 100, 1200 * scale);
+
+		std::mt19937 generator(1);
+		std::uniform_real_distribution<real> horizontal(
+			-half + ballRadius, half - ballRadius
+		);
+		std::uniform_real_distribution<real> height(500, 2500);
+		std::uniform_real_distribution<real> speed(-100, 100);
+
+		for (int i = 0; i < balls; i++) {
+			scene.add(
+				mesh,
+				Vector3D(horizontal(generator), height(generator),
+					horizontal(generator)),
+				ballRadius
+			);
+			scene.objects.back()->body.linearVelocity =
+				Vector3D(speed(generator), 0, speed(generator));
+		}
+
+		// The first 13 objects are static
+		scene.step = [half, ballRadius](BenchmarkScene& scene, int) {
+			for (unsigned int i = 13; i < scene.objects.size(); i++) {
+				RigidBody& body = scene.objects[i]->body;
+				body.linearVelocity.y -= 1000 * STEP;
+				body.position += body.linearVelocity * STEP;
+
+				// Bounces off the floor and walls
+				if (body.position.y < 50 + ballRadius) {
+					body.position.y = 50 + ballRadius;
+					body.linearVelocity.y = -body.linearVelocity.y * 0.6;
+				}
+				if (realAbs(body.position.x) > half - ballRadius) {
+					body.linearVelocity.x = -body.linearVelocity.x;
+				}
+				if (realAbs(body.position.z) > half - ballRadius) {
+					body.linearVelocity.z = -body.linearVelocity.z;
+				}
+			}
+		};
+	}
+
+
+	/*
+		Fills the scene with the wrecking ball, with a lattice of the
+		given number of cubes.
+	*/
+	void createWreckingBall(BenchmarkScene& scene, Mesh* mesh, int cubes) {
+
+		const real cubeRadius = realSqrt(3 * 100 * 100);
+		const real ballRadius = 200;
+
+		int side = 1;
+		while (side * side * side < cubes) {
+			side++;
+		}
+		real width = side * 200;
+
+		// Ground, and then the ball
+		scene.add(
+			mesh,
+			Vector3D(width * 0.5, -150, width * 0.5),
+			realSqrt(2 * (width + 2000) * (width + 2000) + 100 * 100) * 0.5
+		);
+		scene.add(mesh, Vector3D(0, 0, 0), ballRadius);
+
+		for (int i = 0; i < cubes; i++) {
+			int x = i % side;
+			int z = (i / side) % side;
+			int y = i / (side * side);
+			scene.add(
+				mesh,
+				Vector3D(x * 200 + 100, y * 200 + 100, z * 200 + 100),
+				cubeRadius
+			);
+		}
+
+		scene.step = [width, side, cubeRadius, ballRadius](
+			BenchmarkScene& scene,
+			int stepIndex
+			) {
+			/*
+				The ball swings back and forth along the lattice, on a
+				line that moves across it a little every swing.
+			*/
+			real time = stepIndex * STEP;
+			RigidBody& ball = scene.objects[1]->body;
+			ball.position = Vector3D(
+				width * 0.5 * (1 + sin(time * 2)),
+				std::min(side * 100, 300),
+				width * (0.5 + 0.4 * sin(time * 0.3))
+			);
+
+			// Cubes hit by the ball are pushed away, then slow down
+			for (unsigned int i = 2; i < scene.objects.size(); i++) {
+				RigidBody& body = scene.objects[i]->body;
+				Vector3D offset = body.position - ball.position;
+				if (offset.magnitudeSquared() <
+					(cubeRadius + ballRadius) * (cubeRadius + ballRadius)) {
+					body.linearVelocity += offset.normalized() * 300;
+				}
+				body.position += body.linearVelocity * STEP;
+				body.linearVelocity *= 0.95;
+			}
+		};
+	}
+
+
+	/*
+		Runs the scene with the given broad phase, which is given as the
+		functions loading all the objects, updating one object and
+		collecting the potential contacts. Returns the average time of a step in
+		milliseconds, and the average number of potential contacts.
+	*/
+	void measure(
+		BenchmarkScene& scene,
+		const std::function<void(const BenchmarkScene&)>& load,
+		const std::function<void(RigidObject*, const Vector3D&, real)>& update,
+		const std::function<void(std::vector<PotentialContact>&)>& collect,
+		double& milliseconds,
+		double& potentialContacts
+	) {
+		std::vector<PotentialContact> buffer;
+
+		load(scene);
+
+		milliseconds = 0;
+		potentialContacts = 0;
+
+		for (int step = 0; step < WARMUP_STEPS + MEASURED_STEPS; step++) {
+
+			scene.step(scene, step);
+
+			auto start = std::chrono::steady_clock::now();
+
+			for (unsigned int i = 0; i < scene.objects.size(); i++) {
+				update(scene.objects[i], scene.objects[i]->body.position,
+					scene.radii[i]);
+			}
+			buffer.clear();
+			collect(buffer);
+
+			auto end = std::chrono::steady_clock::now();
+
+			if (step >= WARMUP_STEPS) {
+				milliseconds += std::chrono::duration<double, std::milli>(
+					end - start
+				).count();
+				potentialContacts += buffer.size();
+			}
+		}
+
+		milliseconds /= MEASURED_STEPS;
+		potentialContacts /= MEASURED_STEPS;
+	}
+
+
+	// Prints the quality of the tree, and the time of a query on it
+	void printTreeQuality(
+		const char* name,
+		const BoundingVolumeHierarchy& hierarchy
+	) {
+		std::vector<PotentialContact> buffer;
+		auto start = std::chrono::steady_clock::now();
+		hierarchy.getPotentialContacts(buffer);
+		auto end = std::chrono::steady_clock::now();
+
+		std::cout << "    " << std::left << std::setw(25) << name
+			<< std::right << "height " << hierarchy.getHeight()
+			<< ", cost " << std::fixed << std::setprecision(1)
+			<< hierarchy.getSAHCost() << ", " << std::setprecision(3)
+			<< std::chrono::duration<double, std::milli>(end - start).count()
+			<< " ms per query, " << buffer.size()
+			<< " potential contacts\n";
+	}
+
+
+	void benchmarkTreeQuality(Mesh* mesh, int bodies) {
+
+		// Number of rounds of churn, and the fraction moved in each
+		const int CHURN_ROUNDS = 10;
+		const real CHURN_FRACTION = 0.2;
+
+		BenchmarkScene scene;
+		createBallPit(scene, mesh, bodies);
+		std::vector<BVHSphere> spheres;
+		for (unsigned int i = 0; i < scene.objects.size(); i++) {
+			spheres.push_back(BVHSphere(
+				scene.objects[i]->body.position, scene.radii[i]
+			));
+		}
+
+		std::cout << "Ball pit hierarchy, " << bodies << " bodies\n";
+
+		BoundingVolumeHierarchy built(0.1);
+		built.build(scene.objects, spheres);
+		printTreeQuality("built top-down:", built);
+
+		std::mt19937 generator(2);
+		std::vector<unsigned int> order(scene.objects.size());
+		std::iota(order.begin(), order.end(), 0);
+		std::shuffle(order.begin(), order.end(), generator);
+
+		BoundingVolumeHierarchy inserted(0.1);
+		for (unsigned int i : order) {
+			inserted.insert(
+				scene.objects[i], spheres[i].centre, spheres[i].radius
+			);
+		}
+		printTreeQuality("inserted one by one:", inserted);
+
+		// The balls taken out are put back anywhere in the pit
+		Vector3D low = spheres[0].centre;
+		Vector3D high = spheres[0].centre;
+		for (const BVHSphere& sphere : spheres) {
+			for (unsigned int i = 0; i < 3; i++) {
+				low[i] = std::min(low[i], sphere.centre[i]);
+				high[i] = std::max(high[i], sphere.centre[i]);
+			}
+		}
+		std::uniform_real_distribution<real> unit(0, 1);
+		std::uniform_int_distribution<unsigned int> ball(
+			13, scene.objects.size() - 1
+		);
+		for (int round = 0; round < CHURN_ROUNDS; round++) {
+			for (int moved = 0; moved < bodies * CHURN_FRACTION; moved++) {
+				unsigned int i = ball(generator);
+				for (unsigned int j = 0; j < 3; j++) {
+					spheres[i].centre[j] = low[j] +
+						(high[j] - low[j]) * unit(generator);
+				}
+				inserted.remove(scene.objects[i]);
+				inserted.insert(
+					scene.objects[i], spheres[i].centre, spheres[i].radius
+				);
+			}
+		}
+		printTreeQuality("after churn:", inserted);
+
+		built.build(scene.objects, spheres);
+		printTreeQuality("built after churn:", built);
+	}
+
+
+	void benchmarkScene(
+		const char* name,
+		void (*create)(BenchmarkScene&, Mesh*, int),
+		Mesh* mesh,
+		int bodies
+	) {
+		double milliseconds;
+		double potentialContacts;
+
+		std::cout << name << ", " << bodies << " bodies\n";
+
+		{
+			BenchmarkScene scene;
+			create(scene, mesh, bodies);
+			BoundingVolumeHierarchy hierarchy(0.1);
+			measure(
+				scene,
+				[&](const BenchmarkScene& scene) {
+					std::vector<BVHSphere> spheres;
+					for (unsigned int i = 0; i < scene.objects.size(); i++) {
+						spheres.push_back(BVHSphere(
+							scene.objects[i]->body.position, scene.radii[i]
+						));
+					}
+					hierarchy.build(scene.objects, spheres);
+				},
+				[&](RigidObject* object, const Vector3D& centre, real radius) {
+					hierarchy.update(object, centre, radius);
+				},
+				[&](std::vector<PotentialContact>& buffer) {
+					hierarchy.getPotentialContacts(buffer);
+				},
+				milliseconds,
+				potentialContacts
+			);
+			std::cout << "    bounding volume hierarchy:   " << std::fixed
+				<< std::setprecision(3) << milliseconds << " ms per step, "
+				<< std::setprecision(0) << potentialContacts
+				<< " potential contacts\n";
+		}
+
+		/*
+			The linear builder is measured the way the world uses it when
+			most objects move, building a new tree every step.
+		*/
+		{
+			BenchmarkScene scene;
+			create(scene, mesh, bodies);
+			BoundingVolumeHierarchy hierarchy(0.1);
+			std::vector<BVHSphere> spheres;
+			measure(
+				scene,
+				[&](const BenchmarkScene& scene) {
+					spheres.reserve(scene.objects.size());
+				},
+				[&](RigidObject*, const Vector3D& centre, real radius) {
+					spheres.push_back(BVHSphere(centre, radius));
+				},
+				[&](std::vector<PotentialContact>& buffer) {
+					hierarchy.buildLinear(scene.objects, spheres);
+					hierarchy.getPotentialContacts(buffer);
+					spheres.clear();
+				},
+				milliseconds,
+				potentialContacts
+			);
+			std::cout << "    linear hierarchy (rebuilt):  " << std::fixed
+				<< std::setprecision(3) << milliseconds << " ms per step, "
+				<< std::setprecision(0) << potentialContacts
+				<< " potential contacts\n";
+		}
+
+		{
+			BenchmarkScene scene;
+			create(scene, mesh, bodies);
+			SweepAndPrune sweepAndPrune;
+			measure(
+				scene,
+				[&](const BenchmarkScene& scene) {
+					for (unsigned int i = 0; i < scene.objects.size(); i++) {
+						sweepAndPrune.insert(
+							scene.objects[i],
+							scene.objects[i]->body.position,
+							scene.radii[i]
+						);
+					}
+				},
+				[&](RigidObject* object, const Vector3D& centre, real radius) {
+					sweepAndPrune.update(object, centre, radius);
+				},
+				[&](std::vector<PotentialContact>& buffer) {
+					sweepAndPrune.getPotentialContacts(buffer);
+				},
+				milliseconds,
+				potentialContacts
+			);
+			std::cout << "    sweep and prune:             " << std::fixed
+				<< std::setprecision(3) << milliseconds << " ms per step, "
+				<< std::setprecision(0) << potentialContacts
+				<< " potential contacts\n";
+		}
+	}
+}
+
+
+void pe::runBroadPhaseBenchmark() {
+
+	// Shared by all the bodies, as only their spheres matter
+	Sphere mesh(1, 4, 4);
+
+	for (int bodies : { 1000, 10000, 50000 }) {
+		benchmarkScene("Ball pit", createBallPit, &mesh, bodies);
+	}
+	for (int bodies : { 1000, 10000, 50000 }) {
+		benchmarkScene("Wrecking ball", createWreckingBall, &mesh, bodies);
+	}
+	for (int bodies : { 1000, 10000, 50000 }) {
+		benchmarkTreeQuality(&mesh, bodies);
+	}
+}
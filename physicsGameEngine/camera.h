@@ -2,7 +2,7 @@
 #ifndef CAMERA_H
 #define CAMERA_H
 
-#include <GL/gl.h>
+#include "graphicsLibraries.h"
 #include <GLFW/glfw3.h>
 #include "accuracy.h"
 
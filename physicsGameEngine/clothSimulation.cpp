@@ -68,6 +68,12 @@ void pe::runClothSimulation() {
 
     CuboidObject cube(100, 100, 100, Vector3D(0, 0, 200), Quaternion::IDENTITY, 20);
 
+    /*
+        Finds the particles near the cube, with cells about as large as the
+        space between two particles.
+    */
+    SpatialHashGrid grid(400.0 / (size - 1), size * size);
+
     // The first row of particles is suspended
     for (int i = 0; i < size; i++) {
         cloth.body.particles[i].setAwake(false);
@@ -151,10 +157,9 @@ void pe::runClothSimulation() {
         while (numSteps--) {
 
             std::vector<ParticleContact> contacts;
-            for (int i = 0; i < cloth.body.particles.size(); i++) {
-                generateContactParticleAndObject(
-                    &cloth.body.particles[i], cube, contacts, 1.0);
-            }
+            grid.build(cloth.body.particles, 0);
+            generateContactParticlesAndObject(
+                cloth.body.particles, grid, cube, contacts, 1.0);
             ParticleContactResolver resolver(contacts.size());
             resolver.resolveContacts(contacts, substep);
 
@@ -1,9 +1,179 @@
 
 #include "collisionResolver.h"
+#include <algorithm>
 
 using namespace pe;
 
 
+/*
+	Fraction of the penetration (beyond the position epsilon) that the
+	sequential impulse solver removes each step, which is kept low so
+	that the bodies don't jump apart.
+*/
+static const real POSITION_CORRECTION_FACTOR = (real)0.2;
+
+/*
+	Number of blocks of a color each job of the graph colored solver
+	takes, so that a job is long enough to be worth handing to a thread.
+*/
+static const unsigned int BLOCKS_PER_JOB = 4;
+
+/*
+	Fewest blocks a color needs for its jobs to be handed to the threads.
+	Waking the threads and waiting for them costs more than solving a
+	smaller color on the calling thread, which is most colors of an
+	island of a few thousand contacts.
+*/
+static const unsigned int MIN_THREADED_BLOCKS = 64;
+
+
+/*
+	Whether a color of the given number of blocks is spread among the
+	threads of the job system, which needs a job for each thread, or
+	some of them wait idle.
+*/
+static bool isColorThreaded(
+	unsigned int blockCount,
+	const JobSystem* jobSystem
+) {
+	unsigned int jobCount = (blockCount + BLOCKS_PER_JOB - 1) / BLOCKS_PER_JOB;
+	return jobSystem && jobSystem->getThreadCount() > 1 &&
+		jobCount >= jobSystem->getThreadCount() &&
+		blockCount >= MIN_THREADED_BLOCKS;
+}
+
+// Number of colors kept in the bits of a body
+static const unsigned int COLOR_BITS = 64;
+
+
+// Axis of the contact basis (the normal for 0, then the two tangents)
+static Vector3D getContactAxis(const Contact& contact, unsigned int axis) {
+	return Vector3D(
+		contact.contactToWorld.data[axis],
+		contact.contactToWorld.data[axis + 3],
+		contact.contactToWorld.data[axis + 6]
+	);
+}
+
+
+/*
+	Velocity of the first body relative to the second at the contact,
+	in world coordinates.
+*/
+static Vector3D getRelativeVelocity(const Contact& contact) {
+	const RigidBody* one = contact.body[0];
+	Vector3D velocity = one->linearVelocity +
+		one->angularVelocity.vectorProduct(contact.relativeContactPosition[0]);
+	if (const RigidBody* two = contact.body[1]) {
+		velocity -= two->linearVelocity + two->angularVelocity.vectorProduct(
+			contact.relativeContactPosition[1]
+		);
+	}
+	return velocity;
+}
+
+
+/*
+	Applies an impulse along a direction to the first body of the contact
+	and its opposite to the second, given the change in angular velocity
+	of each for a unit impulse. Bodies with infinite mass are left as
+	they are.
+*/
+static void applyAxisImpulse(
+	Contact& contact,
+	const Vector3D& direction,
+	const Vector3D& angularChangeOne,
+	const Vector3D& angularChangeTwo,
+	real amount
+) {
+	if (amount == 0) {
+		return;
+	}
+	RigidBody* one = contact.body[0];
+	if (one->hasFiniteMass()) {
+		one->linearVelocity.linearCombination(
+			direction, amount * one->inverseMass
+		);
+		one->angularVelocity.linearCombination(angularChangeOne, amount);
+	}
+	RigidBody* two = contact.body[1];
+	if (two && two->hasFiniteMass()) {
+		two->linearVelocity.linearCombination(
+			direction, -amount * two->inverseMass
+		);
+		two->angularVelocity.linearCombination(angularChangeTwo, -amount);
+	}
+}
+
+
+void ContactQueue::build(
+	const Contact* contacts,
+	unsigned int contactNumber,
+	real Contact::* key
+) {
+	this->contacts = contacts;
+	this->key = key;
+
+	heap.resize(contactNumber);
+	places.resize(contactNumber);
+	for (unsigned int i = 0; i < contactNumber; i++) {
+		heap[i] = i;
+		places[i] = i;
+	}
+	for (unsigned int place = contactNumber / 2; place-- > 0;) {
+		siftDown(place);
+	}
+}
+
+
+void ContactQueue::swap(unsigned int one, unsigned int two) {
+	std::swap(heap[one], heap[two]);
+	places[heap[one]] = one;
+	places[heap[two]] = two;
+}
+
+
+void ContactQueue::siftUp(unsigned int place) {
+	while (place > 0) {
+		unsigned int parent = (place - 1) / 2;
+		if (!isBefore(heap[place], heap[parent])) {
+			break;
+		}
+		swap(place, parent);
+		place = parent;
+	}
+}
+
+
+void ContactQueue::siftDown(unsigned int place) {
+	while (true) {
+		unsigned int first = place;
+		unsigned int left = 2 * place + 1;
+		unsigned int right = left + 1;
+		if (left < heap.size() && isBefore(heap[left], heap[first])) {
+			first = left;
+		}
+		if (right < heap.size() && isBefore(heap[right], heap[first])) {
+			first = right;
+		}
+		if (first == place) {
+			break;
+		}
+		swap(place, first);
+		place = first;
+	}
+}
+
+
+void ContactQueue::update(unsigned int contact) {
+	unsigned int place = places[contact];
+	siftUp(place);
+	if (places[contact] == place) {
+		siftDown(place);
+	}
+}
+
+
 CollisionResolver::CollisionResolver(
 	unsigned int velocityIterations,
 	unsigned int positionIterations,
@@ -26,6 +196,43 @@ void CollisionResolver::prepareContacts(
 		// Calculate the internal contact data (inertia, basis, etc).
 		contacts[i].calculateInternals(duration);
 	}
+
+	indexBodies(contacts, contactNumber);
+}
+
+
+void CollisionResolver::indexBodies(
+	const Contact* contacts,
+	unsigned contactNumber
+) {
+	/*
+		The entries are sorted by body (after the bodies of the contacts
+		are put in their final order), so that those of each body are
+		next to each other, in the order of the contacts.
+	*/
+	bodyEntries.clear();
+	for (unsigned int i = 0; i < contactNumber; i++) {
+		for (unsigned int b = 0; b < 2; b++) {
+			if (contacts[i].body[b]) {
+				bodyEntries.push_back({ contacts[i].body[b], 2 * i + b });
+			}
+		}
+	}
+	std::sort(bodyEntries.begin(), bodyEntries.end());
+
+	contactBodies.resize(2 * contactNumber);
+	bodyContactOffsets.clear();
+	bodyContacts.clear();
+	bodies.clear();
+	for (unsigned int i = 0; i < bodyEntries.size(); i++) {
+		if (i == 0 || bodyEntries[i].first != bodyEntries[i - 1].first) {
+			bodyContactOffsets.push_back(i);
+			bodies.push_back(bodyEntries[i].first);
+		}
+		contactBodies[bodyEntries[i].second] = bodyContactOffsets.size() - 1;
+		bodyContacts.push_back(bodyEntries[i].second);
+	}
+	bodyContactOffsets.push_back(bodyEntries.size());
 }
 
 
@@ -36,25 +243,19 @@ void CollisionResolver::adjustPositions(
 ) {
 	unsigned int i, index;
 	Vector3D velocityChange[2], rotationChange[2];
-	real rotationAmount[2];
 	real max;
 	Vector3D cp;
 
+	queue.build(c, numContacts, &Contact::penetration);
+
 	// Iteratively resolve interpenetration in order of severity.
 	positionIterationsUsed = 0;
 	while (positionIterationsUsed < positionIterations) {
 
 		// Find biggest penetration.
-		max = positionEpsilon;
-		index = numContacts;
-		for (i = 0; i < numContacts; i++) {
-			if (c[i].penetration > max)
-			{
-				max = c[i].penetration;
-				index = i;
-			}
-		}
-		if (index == numContacts) break;
+		index = queue.top();
+		max = c[index].penetration;
+		if (max <= positionEpsilon) break;
 
 		// Resolve the penetration.
 		c[index].applyPositionChange(
@@ -64,53 +265,73 @@ void CollisionResolver::adjustPositions(
 		);
 		//-positionEpsilon);
 		// Again this action may have changed the penetration of other
-		// bodies, so we update contacts.
-		for (i = 0; i < numContacts; i++) {
+		// bodies, so we update the contacts of the two bodies.
+		for (unsigned int d = 0; d < 2; d++) {
 
-			if (c[i].body[0]) {
+			// Bodies that didn't move (like immovable ones) are skipped
+			if (!c[index].body[d] ||
+				(velocityChange[d].magnitudeSquared() == 0 &&
+				rotationChange[d].magnitudeSquared() == 0)) {
+				continue;
+			}
 
-				if (c[i].body[0] == c[index].body[0]) {
+			unsigned int body = contactBodies[2 * index + d];
+			for (unsigned int entry = bodyContactOffsets[body];
+				entry < bodyContactOffsets[body + 1]; entry++) {
 
-					cp = rotationChange[0].vectorProduct(c[i].
-						relativeContactPosition[0]);
-					cp += velocityChange[0];
-					c[i].penetration -=
-						rotationAmount[0] * cp.scalarProduct(c[i].
-							contactNormal);
-				}
-				else if (c[i].body[0] == c[index].body[1]) {
+				i = bodyContacts[entry] / 2;
+				unsigned int b = bodyContacts[entry] % 2;
 
-					cp = rotationChange[1].vectorProduct(c[i].
-						relativeContactPosition[0]);
-					cp += velocityChange[1];
+				cp = rotationChange[d].vectorProduct(c[i].
+					relativeContactPosition[b]);
+				cp += velocityChange[d];
+				if (b == 0) {
 					c[i].penetration -=
-						rotationAmount[1] * cp.scalarProduct(c[i].
-							contactNormal);
+						cp.scalarProduct(c[i].contactNormal);
+				}
+				else {
+					c[i].penetration +=
+						cp.scalarProduct(c[i].contactNormal);
 				}
+				queue.update(i);
 			}
-			if (c[i].body[1]) {
+		}
+		positionIterationsUsed++;
+	}
+}
 
-				if (c[i].body[1] == c[index].body[0]) {
 
-					cp = rotationChange[0].vectorProduct(c[i].
-						relativeContactPosition[1]);
-					cp += velocityChange[0];
-					c[i].penetration +=
-						rotationAmount[0] * cp.scalarProduct(c[i].
-							contactNormal);
-				}
-				else if (c[i].body[1] == c[index].body[1]) {
+void CollisionResolver::applyWarmStart(
+	Contact* c,
+	unsigned numContacts,
+	real duration
+) {
+	Vector3D velocityChange[2], rotationChange[2];
+	bool warmStarted = false;
 
-					cp = rotationChange[1].vectorProduct(c[i].
-						relativeContactPosition[1]);
-					cp += velocityChange[1];
-					c[i].penetration +=
-						rotationAmount[1] * cp.scalarProduct(c[i].
-							contactNormal);
-				}
+	for (unsigned int i = 0; i < numContacts; i++) {
+		if (c[i].impulse.magnitudeSquared() > 0) {
+			// The impulse is added back to the contact as it is applied
+			Vector3D impulse = c[i].impulse;
+			c[i].impulse.clear();
+			c[i].applyImpulse(impulse, velocityChange, rotationChange);
+			warmStarted = true;
+		}
+	}
+
+	/*
+		Each impulse changes the velocity of every contact sharing one of
+		its bodies, so they are simply all calculated again.
+	*/
+	if (warmStarted) {
+		for (unsigned int i = 0; i < numContacts; i++) {
+			c[i].contactVelocity = c[i].calculateLocalVelocity(0, duration);
+			if (c[i].body[1]) {
+				c[i].contactVelocity -= 
+					c[i].calculateLocalVelocity(1, duration);
 			}
+			c[i].calculateDesiredDeltaVelocity(duration);
 		}
-		positionIterationsUsed++;
 	}
 }
 
@@ -123,19 +344,16 @@ void CollisionResolver::adjustVelocities(
 	Vector3D velocityChange[2], rotationChange[2];
 	Vector3D deltaVel;
 
+	applyWarmStart(c, numContacts, duration);
+
+	queue.build(c, numContacts, &Contact::desiredDeltaVelocity);
+
 	// iteratively handle impacts in order of severity.
 	velocityIterationsUsed = 0;
 	while (velocityIterationsUsed < velocityIterations){
 		// Find contact with maximum magnitude of probable velocity change.
-		real max = velocityEpsilon;
-		unsigned int index = numContacts;
-		for (unsigned int i = 0; i < numContacts; i++){
-			if (c[i].desiredDeltaVelocity > max){
-				max = c[i].desiredDeltaVelocity;
-				index = i;
-			}
-		}
-		if (index == numContacts) break;
+		unsigned int index = queue.top();
+		if (c[index].desiredDeltaVelocity <= velocityEpsilon) break;
 
 
 		// Do the resolution on the contact that came out top.
@@ -143,47 +361,608 @@ void CollisionResolver::adjustVelocities(
 
 		// With the change in velocity of the two bodies, the update of
 		// contact velocities means that some of the relative closing
-		// velocities need recomputing.
-		for (unsigned int i = 0; i < numContacts; i++)
+		// velocities of the contacts of these bodies need recomputing.
+		for (unsigned int d = 0; d < 2; d++)
 		{
-			// Check each body in the contact
-			for (unsigned int b = 0; b < 2; b++) if (c[i].body[b])
+			// Bodies whose velocity didn't change are skipped
+			if (!c[index].body[d] ||
+				(velocityChange[d].magnitudeSquared() == 0 &&
+				rotationChange[d].magnitudeSquared() == 0)) {
+				continue;
+			}
+
+			unsigned int body = contactBodies[2 * index + d];
+			for (unsigned int entry = bodyContactOffsets[body];
+				entry < bodyContactOffsets[body + 1]; entry++)
 			{
-				// Check for a match with each body in the newly
-				// resolved contact
-				for (unsigned int d = 0; d < 2; d++)
-				{
-					if (c[i].body[b] == c[index].body[d])
-					{
-						deltaVel = velocityChange[d] +
-							rotationChange[d].vectorProduct(
-								c[i].relativeContactPosition[b]);
-
-						// The sign of the change is negative if we're dealing
-						// with the second body in a contact.
-						Matrix3x3 inverse = c[i].contactToWorld.transpose();
-						c[i].contactVelocity +=
-							inverse.transform(deltaVel)
-							* (b ? -1 : 1);
-						c[i].calculateDesiredDeltaVelocity(duration);
-					}
+				unsigned int i = bodyContacts[entry] / 2;
+				unsigned int b = bodyContacts[entry] % 2;
+
+				deltaVel = velocityChange[d] +
+					rotationChange[d].vectorProduct(
+						c[i].relativeContactPosition[b]);
+
+				// The sign of the change is negative if we're dealing
+				// with the second body in a contact.
+				Matrix3x3 inverse = c[i].contactToWorld.transpose();
+				c[i].contactVelocity +=
+					inverse.transform(deltaVel)
+					* (b ? -1 : 1);
+				c[i].calculateDesiredDeltaVelocity(duration);
+				queue.update(i);
+			}
+		}
+		velocityIterationsUsed++;
+	}
+}
+
+
+void CollisionResolver::prepareConstraints(
+	Contact* c,
+	unsigned numContacts,
+	real duration
+) {
+	constraints.resize(numContacts);
+	for (unsigned int i = 0; i < numContacts; i++) {
+		ImpulseConstraint& constraint = constraints[i];
+
+		/*
+			Unlike the worst first solver, the inertia tensors are taken
+			in world coordinates, as the bodies may be rotated.
+		*/
+		for (unsigned int axis = 0; axis < 3; axis++) {
+			Vector3D direction = getContactAxis(c[i], axis);
+			real inverseMass = 0;
+			for (unsigned int b = 0; b < 2; b++) {
+				if (!c[i].body[b] || !c[i].body[b]->hasFiniteMass()) {
+					constraint.angularChange[b][axis].clear();
+					continue;
+				}
+				Vector3D torque = c[i].relativeContactPosition[b].
+					vectorProduct(direction);
+				constraint.angularChange[b][axis] =
+					c[i].body[b]->inverseInertiaTensorWorld.transform(torque);
+				inverseMass += c[i].body[b]->inverseMass +
+					constraint.angularChange[b][axis].scalarProduct(torque);
+			}
+			constraint.effectiveMass[axis] =
+				inverseMass > 0 ? 1 / inverseMass : 0;
+		}
+
+		/*
+			The contact should end with the velocity its desired change
+			in velocity leads to (with the restitution of collisions).
+			With Baumgarte stabilization, some of the penetration is
+			removed by an extra separating velocity.
+		*/
+		constraint.targetVelocity =
+			c[i].contactVelocity.x + c[i].desiredDeltaVelocity;
+		if (positionCorrection == POSITION_CORRECTION::BAUMGARTE &&
+			c[i].penetration > positionEpsilon) {
+			constraint.targetVelocity += POSITION_CORRECTION_FACTOR *
+				(c[i].penetration - positionEpsilon) / duration;
+		}
+
+		/*
+			The warm start impulse is applied right away, within the
+			limits of the contact.
+		*/
+		Matrix3x3 toContact = c[i].contactToWorld.transpose();
+		Vector3D impulse = toContact.transform(c[i].impulse);
+		impulse.x = std::max(impulse.x, (real)0);
+		real planarImpulse = realSqrt(
+			impulse.y * impulse.y + impulse.z * impulse.z
+		);
+		real maxPlanarImpulse = c[i].friction * impulse.x;
+		if (planarImpulse > maxPlanarImpulse) {
+			impulse.y *= maxPlanarImpulse / planarImpulse;
+			impulse.z *= maxPlanarImpulse / planarImpulse;
+		}
+		constraint.impulse = impulse;
+		constraint.splitImpulse = 0;
+
+		real inverseMass = c[i].body[0]->inverseMass;
+		if (c[i].body[1]) {
+			inverseMass += c[i].body[1]->inverseMass;
+		}
+		constraint.linearEffectiveMass =
+			inverseMass > 0 ? 1 / inverseMass : 0;
+
+		for (unsigned int axis = 0; axis < 3; axis++) {
+			applyAxisImpulse(
+				c[i], getContactAxis(c[i], axis),
+				constraint.angularChange[0][axis],
+				constraint.angularChange[1][axis], impulse[axis]
+			);
+		}
+	}
+}
+
+
+void CollisionResolver::solveVelocities(
+	Contact* c,
+	unsigned numContacts
+) {
+	velocityIterationsUsed = 0;
+	while (velocityIterationsUsed < velocityIterations) {
+
+		// Largest change in velocity the iteration made at a contact
+		real largestChange = 0;
+
+		for (unsigned int i = 0; i < numContacts; i++) {
+			ImpulseConstraint& constraint = constraints[i];
+
+			/*
+				The friction comes first, limited by the normal impulse so
+				far, so that the normal impulse then accounts for it.
+			*/
+			Vector3D tangentOne = getContactAxis(c[i], 1);
+			Vector3D tangentTwo = getContactAxis(c[i], 2);
+			Vector3D velocity = getRelativeVelocity(c[i]);
+			real velocityOne = velocity.scalarProduct(tangentOne);
+			real velocityTwo = velocity.scalarProduct(tangentTwo);
+
+			real impulseOne = constraint.impulse.y -
+				constraint.effectiveMass[1] * velocityOne;
+			real impulseTwo = constraint.impulse.z -
+				constraint.effectiveMass[2] * velocityTwo;
+			real planarImpulse = realSqrt(
+				impulseOne * impulseOne + impulseTwo * impulseTwo
+			);
+			real maxPlanarImpulse = c[i].friction * constraint.impulse.x;
+			if (planarImpulse > maxPlanarImpulse) {
+				impulseOne *= maxPlanarImpulse / planarImpulse;
+				impulseTwo *= maxPlanarImpulse / planarImpulse;
+			}
+
+			Vector3D change(0, impulseOne - constraint.impulse.y,
+				impulseTwo - constraint.impulse.z);
+			applyAxisImpulse(
+				c[i], tangentOne, constraint.angularChange[0][1],
+				constraint.angularChange[1][1], change.y
+			);
+			applyAxisImpulse(
+				c[i], tangentTwo, constraint.angularChange[0][2],
+				constraint.angularChange[1][2], change.z
+			);
+			constraint.impulse.y = impulseOne;
+			constraint.impulse.z = impulseTwo;
+
+			// The normal impulse can only push the bodies apart
+			Vector3D normal = getContactAxis(c[i], 0);
+			real normalVelocity = getRelativeVelocity(c[i]).
+				scalarProduct(normal);
+			real normalImpulse = std::max((real)0, constraint.impulse.x +
+				constraint.effectiveMass[0] *
+				(constraint.targetVelocity - normalVelocity));
+
+			change.x = normalImpulse - constraint.impulse.x;
+			applyAxisImpulse(
+				c[i], normal, constraint.angularChange[0][0],
+				constraint.angularChange[1][0], change.x
+			);
+			constraint.impulse.x = normalImpulse;
+
+			// An impulse changes the velocity by itself over the mass
+			for (unsigned int axis = 0; axis < 3; axis++) {
+				if (constraint.effectiveMass[axis] > 0) {
+					largestChange = std::max(largestChange,
+						std::abs(change[axis]) / constraint.effectiveMass[axis]
+					);
 				}
 			}
 		}
+
 		velocityIterationsUsed++;
+		if (largestChange < velocityEpsilon) {
+			break;
+		}
+	}
+
+	// The total impulses warm start the contacts of the next step
+	for (unsigned int i = 0; i < numContacts; i++) {
+		c[i].impulse = c[i].contactToWorld.transform(constraints[i].impulse);
+	}
+}
+
+
+real CollisionResolver::solveSplitImpulse(
+	Contact* c,
+	unsigned int index,
+	real duration
+) {
+	Contact& contact = c[index];
+	ImpulseConstraint& constraint = constraints[index];
+	if (contact.penetration <= positionEpsilon ||
+		constraint.linearEffectiveMass == 0) {
+		return 0;
+	}
+	Vector3D normal = getContactAxis(contact, 0);
+
+	// Relative split velocity of the bodies along the normal
+	unsigned int bodyOne = contactBodies[2 * index];
+	unsigned int bodyTwo = contactBodies[2 * index + 1];
+	Vector3D velocity = splitVelocities[bodyOne];
+	if (contact.body[1]) {
+		velocity -= splitVelocities[bodyTwo];
+	}
+	real normalVelocity = velocity.scalarProduct(normal);
+
+	real targetVelocity = POSITION_CORRECTION_FACTOR *
+		(contact.penetration - positionEpsilon) / duration;
+	real splitImpulse = std::max((real)0, constraint.splitImpulse +
+		constraint.linearEffectiveMass *
+		(targetVelocity - normalVelocity));
+	real change = splitImpulse - constraint.splitImpulse;
+	constraint.splitImpulse = splitImpulse;
+
+	// Bodies with infinite mass are left as they are
+	if (contact.body[0]->hasFiniteMass()) {
+		splitVelocities[bodyOne].linearCombination(
+			normal, change * contact.body[0]->inverseMass
+		);
+	}
+	if (contact.body[1] && contact.body[1]->hasFiniteMass()) {
+		splitVelocities[bodyTwo].linearCombination(
+			normal, -change * contact.body[1]->inverseMass
+		);
+	}
+
+	return std::abs(change) / constraint.linearEffectiveMass;
+}
+
+
+void CollisionResolver::applySplitVelocities(real duration) {
+	for (unsigned int i = 0; i < bodies.size(); i++) {
+		if (splitVelocities[i].magnitudeSquared() == 0) {
+			continue;
+		}
+		bodies[i]->position.linearCombination(splitVelocities[i], duration);
+		if (!bodies[i]->isAwake) {
+			bodies[i]->calculateDerivedData();
+		}
+	}
+}
+
+
+void CollisionResolver::solvePositions(
+	Contact* c,
+	unsigned numContacts,
+	real duration
+) {
+	splitVelocities.assign(bodies.size(), Vector3D());
+
+	positionIterationsUsed = 0;
+	while (positionIterationsUsed < positionIterations) {
+
+		real largestChange = 0;
+		for (unsigned int i = 0; i < numContacts; i++) {
+			largestChange = std::max(largestChange,
+				solveSplitImpulse(c, i, duration)
+			);
+		}
+
+		positionIterationsUsed++;
+		if (largestChange < velocityEpsilon) {
+			break;
+		}
 	}
+
+	applySplitVelocities(duration);
+}
+
+
+void CollisionResolver::assignColors(
+	const Contact* c,
+	unsigned numContacts
+) {
+	/*
+		The colors a body is in are kept as bits, so when a contact
+		finds all of them taken, it is left for a second round, with
+		the next colors, and so on.
+	*/
+	contactColors.resize(numContacts);
+	uncolored.resize(numContacts);
+	for (unsigned int i = 0; i < numContacts; i++) {
+		uncolored[i] = i;
+	}
+	unsigned int colorCount = 0;
+	for (unsigned int firstColor = 0; !uncolored.empty();
+		firstColor += COLOR_BITS) {
+		bodyColors.assign(bodies.size(), 0);
+
+		unsigned int left = 0;
+		for (unsigned int i : uncolored) {
+			std::uint64_t taken = 0;
+			for (unsigned int b = 0; b < 2; b++) {
+				if (c[i].body[b] && c[i].body[b]->hasFiniteMass()) {
+					taken |= bodyColors[contactBodies[2 * i + b]];
+				}
+			}
+			if (taken == ~(std::uint64_t)0) {
+				uncolored[left++] = i;
+				continue;
+			}
+
+			unsigned int color = 0;
+			while (taken & ((std::uint64_t)1 << color)) {
+				color++;
+			}
+			for (unsigned int b = 0; b < 2; b++) {
+				if (c[i].body[b] && c[i].body[b]->hasFiniteMass()) {
+					bodyColors[contactBodies[2 * i + b]] |=
+						(std::uint64_t)1 << color;
+				}
+			}
+			contactColors[i] = firstColor + color;
+			colorCount = std::max(colorCount, firstColor + color + 1);
+		}
+		uncolored.resize(left);
+	}
+
+	// Each color takes as many blocks as its contacts fill
+	colorSizes.assign(colorCount, 0);
+	for (unsigned int i = 0; i < numContacts; i++) {
+		colorSizes[contactColors[i]]++;
+	}
+	colorBlocks.resize(colorCount + 1);
+	colorBlocks[0] = 0;
+	for (unsigned int color = 0; color < colorCount; color++) {
+		colorBlocks[color + 1] = colorBlocks[color] +
+			(colorSizes[color] + CONSTRAINT_LANES - 1) / CONSTRAINT_LANES;
+	}
+}
+
+
+void CollisionResolver::colorContacts(
+	Contact* c,
+	unsigned numContacts
+) {
+	assignColors(c, numContacts);
+	unsigned int colorCount = colorBlocks.size() - 1;
+
+	/*
+		The contacts are placed in the order they come in, the unused
+		lanes staying zero. The bodies of the unused lanes and missing
+		bodies take the zero velocity after those of the bodies.
+	*/
+	blocks.assign(colorBlocks[colorCount], ConstraintBlock{});
+	for (ConstraintBlock& block : blocks) {
+		for (unsigned int b = 0; b < 2; b++) {
+			for (unsigned int lane = 0; lane < CONSTRAINT_LANES; lane++) {
+				block.body[b][lane] = bodies.size();
+			}
+		}
+	}
+	colorSizes.assign(colorCount, 0);
+	for (unsigned int i = 0; i < numContacts; i++) {
+		unsigned int color = contactColors[i];
+		ConstraintBlock& block = blocks[
+			colorBlocks[color] + colorSizes[color] / CONSTRAINT_LANES
+		];
+		unsigned int lane = colorSizes[color] % CONSTRAINT_LANES;
+		colorSizes[color]++;
+
+		const ImpulseConstraint& constraint = constraints[i];
+		block.contact[lane] = i;
+		block.count = lane + 1;
+		for (unsigned int axis = 0; axis < 3; axis++) {
+			Vector3D direction = getContactAxis(c[i], axis);
+			block.axis[axis][0][lane] = direction.x;
+			block.axis[axis][1][lane] = direction.y;
+			block.axis[axis][2][lane] = direction.z;
+			block.effectiveMass[axis][lane] = constraint.effectiveMass[axis];
+			block.impulse[axis][lane] = constraint.impulse[axis];
+		}
+		block.friction[lane] = c[i].friction;
+		block.targetVelocity[lane] = constraint.targetVelocity;
+
+		for (unsigned int b = 0; b < 2; b++) {
+			RigidBody* body = c[i].body[b];
+			if (!body) {
+				continue;
+			}
+
+			// A body that can't move may still have a velocity
+			block.body[b][lane] = contactBodies[2 * i + b];
+			block.isMovable[b][lane] = body->hasFiniteMass();
+			block.inverseMass[b][lane] = body->inverseMass;
+			for (unsigned int axis = 0; axis < 3; axis++) {
+				Vector3D torque = c[i].relativeContactPosition[b].
+					vectorProduct(getContactAxis(c[i], axis));
+				const Vector3D& change = constraint.angularChange[b][axis];
+				for (unsigned int j = 0; j < 3; j++) {
+					block.torque[b][axis][j][lane] = torque[j];
+					block.angularChange[b][axis][j][lane] = change[j];
+				}
+			}
+		}
+	}
+}
+
+
+real CollisionResolver::solveColors(
+	JobSystem* jobSystem,
+	const std::function<real(ConstraintBlock& block)>& task
+) {
+	unsigned int color = 0;
+	JobSystem::Task solveJob = [this, &task, &color](
+		unsigned int job,
+		unsigned int
+	) {
+		unsigned int first = colorBlocks[color] + job * BLOCKS_PER_JOB;
+		unsigned int last = std::min(
+			first + BLOCKS_PER_JOB, colorBlocks[color + 1]
+		);
+		real largestChange = 0;
+		for (unsigned int i = first; i < last; i++) {
+			largestChange = std::max(largestChange, task(blocks[i]));
+		}
+		jobChanges[job] = largestChange;
+	};
+
+	real largestChange = 0;
+	for (; color + 1 < colorBlocks.size(); color++) {
+		unsigned int blockCount = colorBlocks[color + 1] - colorBlocks[color];
+		unsigned int jobCount =
+			(blockCount + BLOCKS_PER_JOB - 1) / BLOCKS_PER_JOB;
+		jobChanges.resize(jobCount);
+		if (isColorThreaded(blockCount, jobSystem)) {
+			jobSystem->run(jobCount, solveJob);
+		}
+		else {
+			for (unsigned int job = 0; job < jobCount; job++) {
+				solveJob(job, 0);
+			}
+		}
+		for (unsigned int job = 0; job < jobCount; job++) {
+			largestChange = std::max(largestChange, jobChanges[job]);
+		}
+	}
+	return largestChange;
+}
+
+
+void CollisionResolver::solveColoredVelocities(
+	Contact* c,
+	JobSystem* jobSystem
+) {
+	// The warm start impulses were applied before the velocities are taken
+	velocities.resize(bodies.size() + 1);
+	for (unsigned int i = 0; i < bodies.size(); i++) {
+		velocities[i].linear = bodies[i]->linearVelocity;
+		velocities[i].angular = bodies[i]->angularVelocity;
+	}
+	velocities[bodies.size()] = BodyVelocity{};
+
+	BodyVelocity* velocityData = velocities.data();
+	std::function<real(ConstraintBlock&)> solveBlock =
+		[velocityData](ConstraintBlock& block) {
+		return solveConstraintBlock(block, velocityData);
+	};
+
+	velocityIterationsUsed = 0;
+	while (velocityIterationsUsed < velocityIterations) {
+		real largestChange = solveColors(jobSystem, solveBlock);
+		velocityIterationsUsed++;
+		if (largestChange < velocityEpsilon) {
+			break;
+		}
+	}
+
+	for (unsigned int i = 0; i < bodies.size(); i++) {
+		if (bodies[i]->hasFiniteMass()) {
+			bodies[i]->linearVelocity = velocities[i].linear;
+			bodies[i]->angularVelocity = velocities[i].angular;
+		}
+	}
+
+	// The total impulses warm start the contacts of the next step
+	for (const ConstraintBlock& block : blocks) {
+		for (unsigned int lane = 0; lane < block.count; lane++) {
+			unsigned int i = block.contact[lane];
+			c[i].impulse = c[i].contactToWorld.transform(Vector3D(
+				block.impulse[0][lane],
+				block.impulse[1][lane],
+				block.impulse[2][lane]
+			));
+		}
+	}
+}
+
+
+void CollisionResolver::solveColoredPositions(
+	Contact* c,
+	real duration,
+	JobSystem* jobSystem
+) {
+	splitVelocities.assign(bodies.size(), Vector3D());
+
+	/*
+		The split impulses only move the bodies along the normals,
+		which is too little work for the blocks to be worth gathering,
+		so the contacts of a block are solved one by one.
+	*/
+	std::function<real(ConstraintBlock&)> solveBlock =
+		[this, c, duration](ConstraintBlock& block) {
+		real largestChange = 0;
+		for (unsigned int lane = 0; lane < block.count; lane++) {
+			largestChange = std::max(largestChange,
+				solveSplitImpulse(c, block.contact[lane], duration)
+			);
+		}
+		return largestChange;
+	};
+
+	positionIterationsUsed = 0;
+	while (positionIterationsUsed < positionIterations) {
+		real largestChange = solveColors(jobSystem, solveBlock);
+		positionIterationsUsed++;
+		if (largestChange < velocityEpsilon) {
+			break;
+		}
+	}
+
+	applySplitVelocities(duration);
+}
+
+
+bool CollisionResolver::isThreaded(
+	const Contact* contacts,
+	unsigned int contactNumber,
+	const JobSystem* jobSystem
+) {
+	// Too few contacts for any color to have enough blocks
+	if (solver != SOLVER::GRAPH_COLORED ||
+		!isColorThreaded(
+			(contactNumber + CONSTRAINT_LANES - 1) / CONSTRAINT_LANES,
+			jobSystem
+		)) {
+		return false;
+	}
+
+	indexBodies(contacts, contactNumber);
+	assignColors(contacts, contactNumber);
+	for (unsigned int color = 0; color + 1 < colorBlocks.size(); color++) {
+		if (isColorThreaded(
+			colorBlocks[color + 1] - colorBlocks[color], jobSystem
+		)) {
+			return true;
+		}
+	}
+	return false;
 }
 
 
 void CollisionResolver::resolveContacts(
 	Contact* contacts,
 	unsigned int contactNumber,
-	real duration
+	real duration,
+	JobSystem* jobSystem
 ) {
 	if (contactNumber == 0) return;
 
 	prepareContacts(contacts, contactNumber, duration);
 
+	if (solver == SOLVER::SEQUENTIAL_IMPULSE) {
+		prepareConstraints(contacts, contactNumber, duration);
+		solveVelocities(contacts, contactNumber);
+		if (positionCorrection == POSITION_CORRECTION::SPLIT_IMPULSE) {
+			solvePositions(contacts, contactNumber, duration);
+		}
+		return;
+	}
+
+	if (solver == SOLVER::GRAPH_COLORED) {
+		prepareConstraints(contacts, contactNumber, duration);
+		colorContacts(contacts, contactNumber);
+		solveColoredVelocities(contacts, jobSystem);
+		if (positionCorrection == POSITION_CORRECTION::SPLIT_IMPULSE) {
+			solveColoredPositions(contacts, duration, jobSystem);
+		}
+		return;
+	}
+
 	// Resolved interpenetartion
 	adjustPositions(contacts, contactNumber, duration);
 
@@ -3,16 +3,119 @@
 #define COLLISION_RESOLVER_H
 
 #include "contact.h"
+#include "simdConstraintKernels.h"
+#include "jobSystem.h"
+#include <vector>
+#include <cstdint>
 
 namespace pe {
 
+	/*
+		Indexed max heap of the contacts given to the resolver, ordered
+		by one of their values (the penetration or the desired change in
+		velocity), which gives the worst contact without going through all
+		of them, and moves a contact to its new place when its value
+		changes. Among contacts with the same value, the one with the
+		lowest index comes first, as a search from the start of the array
+		would find.
+	*/
+	class ContactQueue {
+
+	private:
+
+		const Contact* contacts;
+		real Contact::* key;
+
+		// Index of the contact at each place of the heap, and the reverse
+		std::vector<unsigned int> heap;
+		std::vector<unsigned int> places;
+
+		// Whether the first contact comes before the second
+		bool isBefore(unsigned int one, unsigned int two) const {
+			real keyOne = contacts[one].*key;
+			real keyTwo = contacts[two].*key;
+			return keyOne > keyTwo || (keyOne == keyTwo && one < two);
+		}
+
+		void swap(unsigned int one, unsigned int two);
+		void siftUp(unsigned int place);
+		void siftDown(unsigned int place);
+
+	public:
+
+		// Orders the contacts by the given value
+		void build(
+			const Contact* contacts,
+			unsigned int contactNumber,
+			real Contact::* key
+		);
+
+		// Index of the worst contact
+		unsigned int top() const {
+			return heap[0];
+		}
+
+		// Moves a contact whose value changed
+		void update(unsigned int contact);
+	};
+
+
+	/*
+		The resolver has three ways of solving the contacts, which take the
+		same contacts, so that a scene can switch from one to the other.
+
+		The first (worst first) resolves the worst contact at each
+		iteration, removing all of its penetration and closing velocity
+		at once, which is exact for a few contacts, but needs far more
+		iterations than there are contacts to settle large piles, where
+		pushing one contact out pushes its neighbours in.
+
+		The second (sequential impulses, or projected Gauss-Seidel) goes
+		through all the contacts at each iteration, and each time applies
+		the part of the impulse of a contact that is still needed, keeping
+		the total impulse of each contact (its normal impulse can't pull,
+		and its friction impulse can't exceed the friction times the
+		normal impulse). All the contacts improve together, so a few
+		iterations are enough for any number of contacts, and the total
+		impulses warm start the next step.
+		Its penetration is removed either by asking for some extra closing
+		velocity in proportion to it (Baumgarte stabilization), which also
+		adds energy, or by solving separate velocities used only to move
+		the bodies out (split impulses), which are then thrown away.
+
+		The third (graph colored) is the same sequential impulse solver,
+		for large islands (like a collapsing pile) that one thread takes
+		too long to solve. The contacts are colored so that no two
+		contacts of a color share a body that can move (bodies with
+		infinite mass don't count, as they are never changed), and the
+		colors are solved one after the other. The contacts of a color
+		don't affect each other, so they are solved at the same time, in
+		blocks of 8 with SIMD instructions (see simdConstraintKernels.h),
+		and the blocks are shared among the threads of a job system if
+		one is given. The order of the contacts changes (by color), but
+		the results don't depend on the number of threads.
+	*/
 	class CollisionResolver {
 
+	public:
+
+		enum class SOLVER {
+			WORST_FIRST,
+			SEQUENTIAL_IMPULSE,
+			GRAPH_COLORED
+		};
+
+		// How the sequential impulse solver removes the penetration
+		enum class POSITION_CORRECTION {
+			BAUMGARTE,
+			SPLIT_IMPULSE
+		};
+
 	private:
 
 		/*
 			Prepares the contacts for processing. That means tha internals
-			are all calculated.
+			are all calculated, and the contacts of each body are listed.
 		*/
 		void prepareContacts(
 			Contact* contactArray,
@@ -35,6 +138,22 @@ namespace pe {
 		);
 
 
+		/*
+			Applies the impulse each contact starts with (its warm start
+			impulse, given by the contact cache from the previous frame),
+			then recalculates the closing velocities of the contacts,
+			which those impulses changed. Most of the impulse of resting
+			contacts is then already applied before the iterations start,
+			so that they do not run out before reaching every contact of a
+			stack.
+		*/
+		void applyWarmStart(
+			Contact* c,
+			unsigned numContacts,
+			real duration
+		);
+
+
 		/*
 			Resolves all velocities.
 		*/
@@ -45,10 +164,195 @@ namespace pe {
 		);
 
 
+		/*
+			Contacts of each body, so that resolving a contact only
+			updates the contacts that share one of its bodies, instead of
+			checking all of them. Each entry is the index of a contact
+			times two plus the side of the contact the body is on. The
+			body on side b of contact i has its entries from
+			bodyContactOffsets[contactBodies[2 * i + b]] to the next offset.
+			These are members so that their memory is reused.
+		*/
+		std::vector<unsigned int> contactBodies;
+		std::vector<unsigned int> bodyContactOffsets;
+		std::vector<unsigned int> bodyContacts;
+
+		// Body of each entry, sorted by body to group the entries
+		std::vector<std::pair<RigidBody*, unsigned int>> bodyEntries;
+
+		ContactQueue queue;
+
+
+		/*
+			What the sequential impulse solver keeps of each contact:
+			for each axis of the contact (the normal then the two
+			tangents), the change in angular velocity of each body for a
+			unit impulse along it, and the impulse that changes the
+			relative velocity along it by one.
+		*/
+		struct ImpulseConstraint {
+			Vector3D angularChange[2][3];
+			real effectiveMass[3];
+
+			// Relative normal velocity the contact should end with
+			real targetVelocity;
+
+			// Total impulse so far, in contact coordinates
+			Vector3D impulse;
+
+			// Total split impulse pushing the bodies apart
+			real splitImpulse;
+
+			// Mass the split impulse moves, without the rotation
+			real linearEffectiveMass;
+		};
+		std::vector<ImpulseConstraint> constraints;
+
+		// Bodies of the contacts, in the order of their entries
+		std::vector<RigidBody*> bodies;
+
+		/*
+			Velocities of each body only used to remove the penetration
+			with split impulses. They are only linear, as turning the
+			bodies about the few points of a resting face, with nothing
+			like friction to hold them, tips stacks over.
+		*/
+		std::vector<Vector3D> splitVelocities;
+
+		/*
+			What the graph colored solver keeps: the contacts in blocks,
+			those of each color following each other (the blocks of color
+			i go from colorBlocks[i] to the next offset), and the
+			velocities of the bodies while it works on them, in the
+			order of the bodies of the contacts, followed by a zero
+			velocity for the contacts without a second body.
+		*/
+		std::vector<ConstraintBlock> blocks;
+		std::vector<unsigned int> colorBlocks;
+		std::vector<BodyVelocity> velocities;
+
+		/*
+			Color of each contact, the colors each body is already in,
+			the contacts left to color, and the number of contacts of
+			each color.
+		*/
+		std::vector<unsigned int> contactColors;
+		std::vector<std::uint64_t> bodyColors;
+		std::vector<unsigned int> uncolored;
+		std::vector<unsigned int> colorSizes;
+
+		// Largest change in velocity found by each job of a color
+		std::vector<real> jobChanges;
+
+		SOLVER solver = SOLVER::WORST_FIRST;
+		POSITION_CORRECTION positionCorrection =
+			POSITION_CORRECTION::SPLIT_IMPULSE;
+
+
+		// Calculates what the sequential impulse solver keeps of each contact
+		void prepareConstraints(
+			Contact* c,
+			unsigned numContacts,
+			real duration
+		);
+
+		/*
+			Solves the velocities with sequential impulses, until no
+			contact needs more than the velocity epsilon, or the
+			iterations run out.
+		*/
+		void solveVelocities(
+			Contact* c,
+			unsigned numContacts
+		);
+
+		/*
+			Removes the penetrations with split impulses, and moves the
+			bodies by the velocities they give.
+		*/
+		void solvePositions(
+			Contact* c,
+			unsigned numContacts,
+			real duration
+		);
+
+		/*
+			Applies the split impulse of the contact of the given index,
+			returning the change in velocity it made.
+		*/
+		real solveSplitImpulse(
+			Contact* c,
+			unsigned int index,
+			real duration
+		);
+
+		/*
+			Moves the bodies by their split velocities, which are then
+			thrown away.
+		*/
+		void applySplitVelocities(real duration);
+
+
+		/*
+			Finds the bodies of the contacts, and the index of the body
+			of each side of each contact, in the order of the entries.
+		*/
+		void indexBodies(
+			const Contact* contacts,
+			unsigned contactNumber
+		);
+
+		/*
+			Gives each contact the lowest color that none of its bodies
+			that can move is in, and finds the blocks each color takes.
+		*/
+		void assignColors(
+			const Contact* c,
+			unsigned numContacts
+		);
+
+		/*
+			Colors the contacts, and places them in the blocks of their
+			color.
+		*/
+		void colorContacts(
+			Contact* c,
+			unsigned numContacts
+		);
+
+		/*
+			Runs the given task on the blocks of each color in turn,
+			spreading those of a color among the threads of the job
+			system, if there is one and the color has enough blocks to
+			keep all of them busy. Returns the largest change in velocity
+			the task found.
+		*/
+		real solveColors(
+			JobSystem* jobSystem,
+			const std::function<real(ConstraintBlock& block)>& task
+		);
+
+		// Same as solveVelocities, for the graph colored solver
+		void solveColoredVelocities(
+			Contact* c,
+			JobSystem* jobSystem
+		);
+
+		// Same as solvePositions, for the graph colored solver
+		void solveColoredPositions(
+			Contact* c,
+			real duration,
+			JobSystem* jobSystem
+		);
+
+
 		/*
 			Number of iterations to perform when resolving velocity.
 			Since resolving one velocity may cause other collisions in the
 			same frame, we need a limit on the number of allowed iterations.
+			With sequential impulses, an iteration goes through all the
+			contacts once (same for the position iterations, used for the
+			split impulses).
 		*/
 		unsigned int velocityIterations;
 
@@ -104,6 +408,37 @@ namespace pe {
 		);
 
 
+		// Sets the solver (worst first by default)
+		void setSolver(SOLVER solver) {
+			this->solver = solver;
+		}
+
+		SOLVER getSolver() const {
+			return solver;
+		}
+
+		/*
+			Sets how the sequential impulse solver removes penetration
+			(split impulses by default).
+		*/
+		void setPositionCorrection(POSITION_CORRECTION correction) {
+			positionCorrection = correction;
+		}
+
+		POSITION_CORRECTION getPositionCorrection() const {
+			return positionCorrection;
+		}
+
+		// Sets the maximum number of iterations of each part
+		void setIterations(
+			unsigned int velocityIterations,
+			unsigned int positionIterations
+		) {
+			this->velocityIterations = velocityIterations;
+			this->positionIterations = positionIterations;
+		}
+
+
 		/*
 			Resolves both the interpenetration and velocity changes (makes
 			bodies rebound and moves them so they no longer inter-penetrate).
@@ -112,12 +447,32 @@ namespace pe {
 			first, then all contacts (velocity changes).
 			Note that the contacts are resolved in order of most severe,
 			where the most severe is the one with the largest desired delta
-			velocity.
+			velocity. The contacts are kept in a heap ordered by severity,
+			so each iteration only costs as much as the number of contacts
+			of the two bodies it changed.
+			The graph colored solver spreads the contacts among the
+			threads of the given job system, if there is one (which must
+			not be running a batch already).
 		*/
 		void resolveContacts(
 			Contact* contactArray,
 			unsigned int contactNumber,
-			real duration
+			real duration,
+			JobSystem* jobSystem = nullptr
+		);
+
+		/*
+			Whether the graph colored solver would spread any color of
+			the given contacts among the threads of the job system, which
+			only happens for colors large enough to keep all of them busy.
+			The contacts are colored to find out, which they are again
+			when they are resolved (coloring is cheap next to solving).
+			Always false with the other solvers.
+		*/
+		bool isThreaded(
+			const Contact* contacts,
+			unsigned int contactNumber,
+			const JobSystem* jobSystem
 		);
 	};
 }
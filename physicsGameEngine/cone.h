@@ -136,7 +136,7 @@ namespace pe {
 		const real height;
 		const int segments;
 
-		Cone(real radius, real heigth, int segments) :
+		Cone(real radius, real height, int segments) :
 			radius{ radius }, height{ height }, segments{ segments },
 			Mesh(
 				generateVertices(radius, height, segments), 
@@ -3,6 +3,14 @@
 
 using namespace pe;
 
+
+/*
+	Closing velocity under which the bodies are considered to be resting
+	on each other, so that restitution is ignored.
+*/
+static const real velocityLimit = (real)1.0f;
+
+
 void Contact::calculateContactBasis() {
 
 	Vector3D contactTangent[2];
@@ -69,8 +77,10 @@ void Contact::calculateInternals(real duration) {
 	}
 	assert(body[0]);
 
-	// First we calculate the contact basis
-	calculateContactBasis();
+	// First we calculate the contact basis, unless it is already known
+	if (!hasContactBasis) {
+		calculateContactBasis();
+	}
 
 	// We then calculate the local positions of the contact
 	relativeContactPosition[0] = contactPoint - body[0]->position;
@@ -89,6 +99,8 @@ void Contact::calculateInternals(real duration) {
 	}
 
 
+	isColliding = contactVelocity.x < -velocityLimit;
+
 	// We also need the desired change in velocity, in world coordinates
 	calculateDesiredDeltaVelocity(duration);
 }
@@ -96,6 +108,8 @@ void Contact::calculateInternals(real duration) {
 
 void Contact::swapBodies() {
 	contactNormal *= -1;
+	impulse *= -1;
+	hasContactBasis = false;
 	RigidBody* temp = body[0];
 	body[0] = body[1];
 	body[1] = temp;
@@ -116,9 +130,15 @@ void Contact::applyPositionChange(
 	real linearInertia[2];
 	real angularInertia[2];
 
+	// Bodies with infinite mass are not moved
+	for (unsigned i = 0; i < 2; i++) {
+		linearChange[i].clear();
+		angularChange[i].clear();
+	}
+
 	// We need to work out the inertia of each object in the direction
 	// of the contact normal, due to angular inertia only.
-	for (unsigned i = 0; i < 2; i++) if (body[i])
+	for (unsigned i = 0; i < 2; i++) if (body[i] && body[i]->hasFiniteMass())
 	{
 		Matrix3x3 inverseInertiaTensor = body[i]->inverseInertiaTensor;
 
@@ -145,7 +165,7 @@ void Contact::applyPositionChange(
 	}
 
 	// Loop through again calculating and applying the changes
-	for (unsigned i = 0; i < 2; i++) if (body[i])
+	for (unsigned i = 0; i < 2; i++) if (body[i] && body[i]->hasFiniteMass())
 	{
 		// The linear and angular movements required are in proportion to
 		// the two inverse inertias.
@@ -372,9 +392,11 @@ void Contact::applyVelocityChange(
 ) {
 	// Get hold of the inverse mass and inverse inertia tensor, both in
 	// world coordinates.
+	// (bodies with infinite mass don't turn either)
 	Matrix3x3 inverseInertiaTensor[2];
-	inverseInertiaTensor[0] = body[0]->inverseInertiaTensor;
-	if (body[1])
+	if (body[0]->hasFiniteMass())
+		inverseInertiaTensor[0] = body[0]->inverseInertiaTensor;
+	if (body[1] && body[1]->hasFiniteMass())
 		inverseInertiaTensor[1] = body[1]->inverseInertiaTensor;
 
 	// We will calculate the impulse for each contact axis
@@ -391,23 +413,42 @@ void Contact::applyVelocityChange(
 	}
 
 	// Convert impulse to world coordinates
-	Vector3D impulse = contactToWorld.transform(impulseContact);
+	applyImpulse(
+		contactToWorld.transform(impulseContact),
+		velocityChange,
+		rotationChange
+	);
+}
+
+
+void Contact::applyImpulse(
+	const Vector3D& impulse,
+	Vector3D velocityChange[2],
+	Vector3D rotationChange[2]
+) {
+	this->impulse += impulse;
+
+	// Bodies with infinite mass are not changed at all
+	for (unsigned i = 0; i < 2; i++) {
+		velocityChange[i].clear();
+		rotationChange[i].clear();
+	}
 
 	// Split in the impulse into linear and rotational components
-	Vector3D impulsiveTorque = relativeContactPosition[0].vectorProduct(impulse);
-	rotationChange[0] = inverseInertiaTensor[0].transform(impulsiveTorque);
-	velocityChange[0].clear();
-	velocityChange[0].linearCombination(impulse, body[0]->inverseMass);
+	if (body[0]->hasFiniteMass()) {
+		Vector3D impulsiveTorque = relativeContactPosition[0].vectorProduct(impulse);
+		rotationChange[0] = body[0]->inverseInertiaTensor.transform(impulsiveTorque);
+		velocityChange[0].linearCombination(impulse, body[0]->inverseMass);
 
-	body[0]->linearVelocity += velocityChange[0];
-	body[0]->angularVelocity += rotationChange[0];
+		body[0]->linearVelocity += velocityChange[0];
+		body[0]->angularVelocity += rotationChange[0];
+	}
 
-	if (body[1]) {
+	if (body[1] && body[1]->hasFiniteMass()) {
 
 		// Work out body one's linear and angular changes
 		Vector3D impulsiveTorque = impulse.vectorProduct(relativeContactPosition[1]);
-		rotationChange[1] = inverseInertiaTensor[1].transform(impulsiveTorque);
-		velocityChange[1].clear();
+		rotationChange[1] = body[1]->inverseInertiaTensor.transform(impulsiveTorque);
 		velocityChange[1].linearCombination(impulse, -body[1]->inverseMass);
 
 		body[1]->linearVelocity += velocityChange[1];
@@ -419,8 +460,6 @@ void Contact::applyVelocityChange(
 
 void Contact::calculateDesiredDeltaVelocity(real duration) {
 
-	const static real velocityLimit = (real)1.0f;
-
 	// Calculate the acceleration induced velocity accumulated this frame
 	real velocityFromAcc = 0;
 
@@ -52,13 +52,13 @@ namespace pe {
 			The two bodies in contact. The second can be null if the contact
 			is with a piece of scenery.
 		*/
-		RigidBody* body[2];
+		RigidBody* body[2] = { nullptr, nullptr };
 
 		// Firction generated by contact
-		real friction;
+		real friction = 0;
 
 		// Restitution (bounciness) of contact
-		real restitution;
+		real restitution = 0;
 		
 		// Position of the contact point in world coordinates
 		Vector3D contactPoint;
@@ -71,7 +71,7 @@ namespace pe {
 			that case, the contactPoint maybe be the coordinate of the
 			halfway point between the two interpenetrating points.
 		*/
-		real penetration;
+		real penetration = 0;
 
 
 		/*
@@ -98,6 +98,40 @@ namespace pe {
 		*/
 		Matrix3x3 contactToWorld;
 
+		/*
+			Set when the contact basis was already calculated with the
+			contact, as done for manifolds of contacts sharing the same
+			normal, so that it isn't calculated again for each of them.
+		*/
+		bool hasContactBasis = false;
+
+		/*
+			Identifies the features of the two bodies (faces, edges or
+			corners) the contact was generated from, so that the same
+			contact can be found again in the next frame by the contact
+			cache. It is left to 0 by the routines that generate a single
+			contact per pair, where the body pair is enough.
+		*/
+		unsigned int feature = 0;
+
+		/*
+			Total impulse applied to the first body at the contact during
+			the step, in world coordinates (the second body receives its
+			opposite). It starts as the warm start impulse given by the
+			contact cache, which the resolver applies before its
+			iterations, and is then kept by the cache for the next frame.
+		*/
+		Vector3D impulse;
+
+		/*
+			Set when the contact is calculated, if the bodies are colliding
+			rather than resting on each other (closing faster than the
+			velocity under which restitution is ignored). The impulse that
+			stops a collision is not needed in the next frame, so it is not
+			kept to warm start it.
+		*/
+		bool isColliding = false;
+
 
 		/*
 			Position of the contact in the local coordinates of each of
@@ -110,7 +144,7 @@ namespace pe {
 			The velocity needed to resolve the contacts based on the
 			restitution and other variables.
 		*/
-		real desiredDeltaVelocity;
+		real desiredDeltaVelocity = 0;
 
 
 		/*
@@ -144,6 +178,18 @@ namespace pe {
 		);
 
 
+		/*
+			Applies the given impulse (in world coordinates) to the bodies
+			and adds it to the total impulse of the contact, returning the
+			changes in velocity of each body.
+		*/
+		void applyImpulse(
+			const Vector3D& impulse,
+			Vector3D velocityChange[2],
+			Vector3D rotationChange[2]
+		);
+
+
 		/*
 			If one of the bodies is null, then it needs to be the second
 			one. If not, this function switches the two, and then switches
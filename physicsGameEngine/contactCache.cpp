@@ -0,0 +1,143 @@
+#include "contactCache.h"
+
+using namespace pe;
+
+
+ContactCache::ContactCache(
+	real warmStartFactor,
+	real matchDistance,
+	real matchCosine
+) : currentStep{ 0 },
+warmStartFactor{ warmStartFactor },
+matchDistance{ matchDistance },
+matchCosine{ matchCosine } {}
+
+
+std::pair<RigidBody*, RigidBody*> ContactCache::getPair(
+	const Contact& contact
+) {
+	// A contact with the scenery keeps its only body first
+	if (!contact.body[0] || (contact.body[1] &&
+		std::less<RigidBody*>()(contact.body[1], contact.body[0]))) {
+		return std::make_pair(contact.body[1], contact.body[0]);
+	}
+	return std::make_pair(contact.body[0], contact.body[1]);
+}
+
+
+const ContactCache::CachedContact* ContactCache::findMatch(
+	const Manifold& manifold,
+	const Contact& contact,
+	const Vector3D& localPoint,
+	const Vector3D& normal
+) const {
+
+	const CachedContact* match = nullptr;
+	real closest = matchDistance * matchDistance;
+
+	for (const CachedContact& cached : manifold.contacts) {
+		if (cached.normal * normal < matchCosine) {
+			continue;
+		}
+
+		// Contacts with features need to come from the same ones
+		if (contact.feature != 0) {
+			if (cached.feature == contact.feature) {
+				return &cached;
+			}
+		}
+		else {
+			real distance = (cached.localPoint - localPoint).magnitudeSquared();
+			if (distance <= closest) {
+				closest = distance;
+				match = &cached;
+			}
+		}
+	}
+
+	return match;
+}
+
+
+void ContactCache::warmStart(
+	Contact* contacts,
+	unsigned int contactNumber
+) const {
+
+	for (unsigned int i = 0; i < contactNumber; i++) {
+		Contact& contact = contacts[i];
+		contact.impulse.clear();
+
+		if (warmStartFactor <= 0) {
+			continue;
+		}
+
+		auto [first, second] = getPair(contact);
+		const Manifold* manifold = manifolds.find(first, second);
+		if (!manifold) {
+			continue;
+		}
+
+		// The normal and impulse are cached relative to the first body
+		real sign = (contact.body[0] == first) ? 1 : -1;
+		Vector3D localPoint = first->transformMatrix.inverseTransform(
+			contact.contactPoint
+		);
+
+		const CachedContact* match = findMatch(
+			*manifold,
+			contact,
+			localPoint,
+			contact.contactNormal * sign
+		);
+		if (match) {
+			contact.impulse = match->impulse * (warmStartFactor * sign);
+		}
+	}
+}
+
+
+void ContactCache::update(
+	const Contact* contacts,
+	unsigned int contactNumber
+) {
+	currentStep++;
+
+	for (unsigned int i = 0; i < contactNumber; i++) {
+		const Contact& contact = contacts[i];
+
+		auto [first, second] = getPair(contact);
+		Manifold& manifold = manifolds.get(first, second).first;
+
+		// The first contact of the pair this step replaces the old ones
+		if (manifold.step != currentStep) {
+			manifold.contacts.clear();
+			manifold.step = currentStep;
+		}
+
+		/*
+			The impulse of a collision is not kept, only the position of
+			the contact, so that the next one starts from nothing.
+		*/
+		real sign = (contact.body[0] == first) ? 1 : -1;
+		manifold.contacts.push_back(CachedContact{
+			contact.feature,
+			first->transformMatrix.inverseTransform(contact.contactPoint),
+			contact.contactNormal * sign,
+			contact.isColliding ? Vector3D() : contact.impulse * sign
+		});
+	}
+
+	// Pairs that were not in contact this step are dropped
+	manifolds.endStep();
+}
+
+
+void ContactCache::remove(const RigidBody* body) {
+	manifolds.remove(body);
+}
+
+
+void ContactCache::clear() {
+	manifolds.clear();
+}
@@ -0,0 +1,143 @@
+/*
+	Header file for the contact cache, which keeps the contacts of each
+	pair of bodies (their manifold) from one step to the next, along with
+	the impulse the resolver applied at each of them.
+	When two bodies rest on each other, the contacts generated between
+	them each step are nearly the same, and so is the impulse needed to
+	hold them apart. Each new contact is matched to the contact of the
+	previous step of the same pair that came from the same features (or,
+	for the routines that don't give features, to the closest one on the
+	first body), and starts with a fraction of its impulse, which the
+	resolver applies before its iterations (warm starting).
+	This way, the iterations only need to correct the small difference
+	between the two steps, instead of building up the whole impulse
+	again, which with a stack of bodies takes more iterations than are
+	available, and lets the bodies slowly sink into each other.
+*/
+
+#ifndef CONTACT_CACHE_H
+#define CONTACT_CACHE_H
+
+#include "contact.h"
+#include "pairCache.h"
+#include <vector>
+
+namespace pe {
+
+	class ContactCache {
+
+	private:
+
+		// Contact kept from the previous step
+		struct CachedContact {
+
+			unsigned int feature;
+
+			// Contact point in the local coordinates of the first body
+			Vector3D localPoint;
+
+			/*
+				Normal and impulse of the contact, both relative to the
+				first body of the pair (the one with the lowest address),
+				so that they don't depend on the order of the bodies in
+				the contact.
+			*/
+			Vector3D normal;
+			Vector3D impulse;
+		};
+
+		// Contacts of a pair, and the last step they were updated in
+		struct Manifold {
+			std::vector<CachedContact> contacts;
+			unsigned int step = 0;
+		};
+
+		/*
+			Manifold of each pair in contact during the last step, with
+			the body with the lowest address first (unless the second one
+			is null).
+		*/
+		PairCache<Manifold> manifolds;
+
+		unsigned int currentStep;
+
+		// Fraction of the previous impulse each contact starts with
+		real warmStartFactor;
+
+		/*
+			Largest distance between two contacts without features for
+			them to be considered the same contact.
+		*/
+		real matchDistance;
+
+		/*
+			Smallest cosine of the angle between the normals of the two
+			contacts for them to be considered the same contact.
+		*/
+		real matchCosine;
+
+		// Bodies of the contact, in the order of the cache
+		static std::pair<RigidBody*, RigidBody*> getPair(
+			const Contact& contact
+		);
+
+		/*
+			Returns the contact of the manifold matching the given one,
+			or nullptr if there isn't any.
+		*/
+		const CachedContact* findMatch(
+			const Manifold& manifold,
+			const Contact& contact,
+			const Vector3D& localPoint,
+			const Vector3D& normal
+		) const;
+
+	public:
+
+		/*
+			Takes the fraction of the previous impulse each contact starts
+			with (a value a little under 1 avoids pushing bodies apart when
+			the contacts change), the largest distance between two
+			contacts without features for them to be matched, and the
+			smallest cosine of the angle between their normals.
+		*/
+		ContactCache(
+			real warmStartFactor = 0.8,
+			real matchDistance = 0.1,
+			real matchCosine = 0.95
+		);
+
+		void setWarmStartFactor(real factor) {
+			warmStartFactor = factor;
+		}
+
+		real getWarmStartFactor() const {
+			return warmStartFactor;
+		}
+
+		/*
+			Gives each contact of the array that matches a contact of the
+			previous step its warm start impulse. Contacts that don't are
+			left with no impulse.
+		*/
+		void warmStart(Contact* contacts, unsigned int contactNumber) const;
+
+		/*
+			Replaces the cached manifolds with the given contacts, once
+			they are resolved, along with their total impulse. Manifolds
+			of pairs that are no longer in contact are dropped.
+		*/
+		void update(const Contact* contacts, unsigned int contactNumber);
+
+		/*
+			Drops the manifolds of the given body, for instance when it is
+			removed, so that a body later created at the same address does
+			not inherit them.
+		*/
+		void remove(const RigidBody* body);
+
+		void clear();
+	};
+}
+
+#endif
@@ -10,6 +10,7 @@
 #ifndef DIRECTIONAL_PROJECTION_H
 #define DIRECTIONAL_PROJECTION_H
 
+#include "graphicsLibraries.h"
 #include "accuracy.h"
 
 namespace pe {
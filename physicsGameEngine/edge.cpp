@@ -5,7 +5,7 @@
 using namespace pe;
 
 
-inline const Vector3D& Edge::getVertex(const Mesh* mesh, int index) const {
+const Vector3D& Edge::getVertex(const Mesh* mesh, int index) const {
 	if (index == 0) {
 		return mesh->getVertex(indexes.first);
 	}
@@ -20,7 +20,7 @@ inline const Vector3D& Edge::getVertex(const Mesh* mesh, int index) const {
 }
 
 
-inline int Edge::getIndex(int index) const {
+int Edge::getIndex(int index) const {
 	if (index == 0) {
 		return indexes.first;
 	}
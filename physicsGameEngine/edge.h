@@ -28,10 +28,10 @@ namespace pe {
 			indexes{ std::make_pair(index1, index2) } {}
 
 
-		inline const Vector3D& getVertex(const Mesh* mesh, int index) const;
+		const Vector3D& getVertex(const Mesh* mesh, int index) const;
 
 
-		inline int getIndex(int index) const;
+		int getIndex(int index) const;
 
 
 		Vector3D getMidpoint(Mesh* mesh) const;
@@ -107,7 +107,7 @@ int Face::getIndex(int index) const {
 }
 
 
-inline int Face::getVertexCount() const {
+int Face::getVertexCount() const {
 	return indexes.size();
 }
 
@@ -98,7 +98,7 @@ namespace pe {
 		int getIndex(int index) const;
 
 
-		inline int getVertexCount() const;
+		int getVertexCount() const;
 
 
 		virtual void setTextureCoordinates(
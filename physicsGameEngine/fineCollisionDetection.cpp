@@ -1,5 +1,7 @@
 
 #include "fineCollisionDetection.h"
+#include "gjk.h"
+#include "simdContactKernels.h"
 
 using namespace pe;
 
@@ -144,10 +146,240 @@ void pe::fillPointFaceBoxBox(
     contact.body[0] = one.body;
     contact.body[1] = two.body;
 
+    // The face of box one and the corner of box two
+    contact.feature = FEATURE_POINT_FACE | (best << 3) |
+        (vertex.x < 0) | ((vertex.y < 0) << 1) | ((vertex.z < 0) << 2);
+
     contacts.push_back(contact);
 }
 
 
+/*
+    Keeps the part of a polygon (with vertices in order around it) on the
+    inner side of a plane, where the scalar product with the normal is at
+    most the offset. The vertices are written to the output, which needs
+    room for one more vertex than the input. Returns their number.
+    Each vertex also has a feature, which is kept for the vertices that
+    stay, while the vertex added where an edge crosses the plane is given
+    one made from the feature of the start of the edge and the index of
+    the plane, so that the same vertex has the same feature in the next
+    frame.
+*/
+static unsigned int clipPolygon(
+    const Vector3D* vertices,
+    const unsigned int* features,
+    unsigned int count,
+    const Vector3D& normal,
+    real offset,
+    unsigned int plane,
+    Vector3D* output,
+    unsigned int* outputFeatures
+) {
+    unsigned int outputCount = 0;
+    for (unsigned int i = 0; i < count; i++) {
+        const Vector3D& current = vertices[i];
+        const Vector3D& next = vertices[(i + 1) % count];
+        real currentDistance = normal * current - offset;
+        real nextDistance = normal * next - offset;
+
+        if (currentDistance <= 0) {
+            outputFeatures[outputCount] = features[i];
+            output[outputCount++] = current;
+        }
+
+        // The edge crosses the plane
+        if ((currentDistance < 0 && nextDistance > 0) ||
+            (currentDistance > 0 && nextDistance < 0)) {
+            real t = currentDistance / (currentDistance - nextDistance);
+            outputFeatures[outputCount] = (features[i] << 3) | (plane + 1);
+            output[outputCount++] = current + (next - current) * t;
+        }
+    }
+    return outputCount;
+}
+
+
+/*
+    Keeps four of the points of a manifold, which hold the bodies as
+    well as all of them: the deepest one, the one furthest from it, and
+    the two furthest from the line between these, on each side. The
+    points, their depths and features are reordered in place. Returns
+    the number of points kept.
+*/
+static unsigned int reduceManifold(
+    Vector3D* points,
+    real* depths,
+    unsigned int* features,
+    unsigned int count,
+    const Vector3D& normal
+) {
+    if (count <= 4) {
+        return count;
+    }
+
+    unsigned int chosen[4] = { 0, 0, 0, 0 };
+    for (unsigned int i = 1; i < count; i++) {
+        if (depths[i] > depths[chosen[0]]) {
+            chosen[0] = i;
+        }
+    }
+
+    real furthest = -1;
+    for (unsigned int i = 0; i < count; i++) {
+        real distance = (points[i] - points[chosen[0]]).magnitudeSquared();
+        if (distance > furthest) {
+            furthest = distance;
+            chosen[1] = i;
+        }
+    }
+
+    // Signed areas of the triangles made with the first two points
+    Vector3D line = points[chosen[1]] - points[chosen[0]];
+    real largest = 0;
+    real smallest = 0;
+    chosen[2] = chosen[0];
+    chosen[3] = chosen[1];
+    for (unsigned int i = 0; i < count; i++) {
+        real area = (line % (points[i] - points[chosen[0]])) * normal;
+        if (area > largest) {
+            largest = area;
+            chosen[2] = i;
+        }
+        if (area < smallest) {
+            smallest = area;
+            chosen[3] = i;
+        }
+    }
+
+    Vector3D keptPoints[4];
+    real keptDepths[4];
+    unsigned int keptFeatures[4];
+    unsigned int kept = 0;
+    for (unsigned int i = 0; i < 4; i++) {
+        bool repeated = false;
+        for (unsigned int j = 0; j < i; j++) {
+            repeated = repeated || chosen[j] == chosen[i];
+        }
+        if (!repeated) {
+            keptPoints[kept] = points[chosen[i]];
+            keptDepths[kept] = depths[chosen[i]];
+            keptFeatures[kept] = features[chosen[i]];
+            kept++;
+        }
+    }
+    for (unsigned int i = 0; i < kept; i++) {
+        points[i] = keptPoints[i];
+        depths[i] = keptDepths[i];
+        features[i] = keptFeatures[i];
+    }
+    return kept;
+}
+
+
+unsigned int pe::fillFaceFaceBoxBox(
+    const Box& one,
+    const Box& two,
+    const Vector3D& toCentre,
+    std::vector<Contact>& contacts,
+    unsigned best,
+    real pen
+) {
+    // The normal goes from box two to box one, as for a point to face
+    Vector3D normal = one.getAxis(best);
+    if (normal * toCentre > 0) {
+        normal = normal * -1.0f;
+    }
+
+    // The incident face is the one whose normal is closest to ours
+    unsigned int incident = 0;
+    real alignment = 0;
+    for (unsigned int i = 0; i < 3; i++) {
+        real current = realAbs(two.getAxis(i) * normal);
+        if (current > alignment) {
+            alignment = current;
+            incident = i;
+        }
+    }
+
+    // Its four corners, in order around it
+    unsigned int u = (incident + 1) % 3;
+    unsigned int v = (incident + 2) % 3;
+    real signs[4][2] = { { 1, 1 }, { -1, 1 }, { -1, -1 }, { 1, -1 } };
+    Vector3D polygon[8];
+    Vector3D clipped[8];
+    unsigned int polygonFeatures[8];
+    unsigned int clippedFeatures[8];
+    for (unsigned int i = 0; i < 4; i++) {
+        Vector3D corner;
+        corner[incident] = two.getAxis(incident) * normal > 0 ?
+            two.halfSize[incident] : -two.halfSize[incident];
+        corner[u] = two.halfSize[u] * signs[i][0];
+        corner[v] = two.halfSize[v] * signs[i][1];
+        polygon[i] = two.transformMatrix * corner;
+        polygonFeatures[i] = i + 1;
+    }
+    unsigned int count = 4;
+
+    // Clipped by the four planes on the sides of the reference face
+    Vector3D centre = one.getAxis(3);
+    for (unsigned int i = 1; i < 3 && count > 0; i++) {
+        Vector3D side = one.getAxis((best + i) % 3);
+        real halfSize = one.halfSize[(best + i) % 3];
+
+        count = clipPolygon(
+            polygon, polygonFeatures, count,
+            side, side * centre + halfSize, 2 * i - 2,
+            clipped, clippedFeatures
+        );
+        count = clipPolygon(
+            clipped, clippedFeatures, count,
+            side * -1.0f, halfSize - side * centre, 2 * i - 1,
+            polygon, polygonFeatures
+        );
+    }
+
+    // Only the points below the reference face are in contact
+    Vector3D faceNormal = normal * -1.0f;
+    real faceOffset = faceNormal * centre + one.halfSize[best];
+    Vector3D points[8];
+    real depths[8];
+    unsigned int features[8];
+    unsigned int pointCount = 0;
+    for (unsigned int i = 0; i < count; i++) {
+        real depth = faceOffset - faceNormal * polygon[i];
+        if (depth >= 0) {
+            points[pointCount] = polygon[i];
+            depths[pointCount] = depth;
+            features[pointCount] = polygonFeatures[i];
+            pointCount++;
+        }
+    }
+
+    // Numerical errors can clip everything, leaving the deepest vertex
+    if (pointCount == 0) {
+        fillPointFaceBoxBox(one, two, toCentre, contacts, best, pen);
+        return 1;
+    }
+
+    pointCount = reduceManifold(points, depths, features, pointCount, normal);
+
+    Contact contact;
+    contact.contactNormal = normal;
+    contact.body[0] = one.body;
+    contact.body[1] = two.body;
+    contact.calculateContactBasis();
+    contact.hasContactBasis = true;
+
+    for (unsigned int i = 0; i < pointCount; i++) {
+        contact.contactPoint = points[i];
+        contact.penetration = depths[i];
+        contact.feature = (features[i] << 6) | (best << 2) | incident;
+        contacts.push_back(contact);
+    }
+    return pointCount;
+}
+
+
 static inline Vector3D pe::contactPoint(
     const Vector3D& pOne,
     const Vector3D& dOne,
@@ -232,13 +464,28 @@ unsigned int pe::boxAndBox(
 
     assert(best != 0xffffff);
 
+    return fillBoxAndBox(
+        one, two, toCentre, contacts, best, pen, bestSingleAxis
+    );
+}
+
+
+unsigned int pe::fillBoxAndBox(
+    const Box& one,
+    const Box& two,
+    const Vector3D& toCentre,
+    std::vector<Contact>& contacts,
+    unsigned best,
+    real pen,
+    unsigned bestSingleAxis
+) {
     if (best < 3) {
-        fillPointFaceBoxBox(one, two, toCentre, contacts, best, pen);
-        return 1;
+        return fillFaceFaceBoxBox(one, two, toCentre, contacts, best, pen);
     }
     else if (best < 6) {
-        fillPointFaceBoxBox(two, one, toCentre * -1.0f, contacts, best - 3, pen);
-        return 1;
+        return fillFaceFaceBoxBox(
+            two, one, toCentre * -1.0f, contacts, best - 3, pen
+        );
     }
     else {
         best -= 6;
@@ -279,6 +526,7 @@ unsigned int pe::boxAndBox(
         contact.contactPoint = vertex;
         contact.body[0] = one.body;
         contact.body[1] = two.body;
+        contact.feature = FEATURE_EDGE_EDGE | best;
 
         contacts.push_back(contact);
 
@@ -320,7 +568,7 @@ unsigned int pe::sphereAndSphere(
 
     Contact contact;
     contact.contactNormal = normal;
-    contact.contactPoint = positionOne + midline * (real)0.5;
+    contact.contactPoint = positionTwo + midline * (real)0.5;
     contact.penetration = (one.radius + two.radius - size);
     contact.body[0] = one.body;
     contact.body[1] = two.body;
@@ -383,73 +631,497 @@ unsigned int pe::boxAndSphere(
 
 
 
-void pe::generateContacts(
-    RigidObject& one,
-    RigidObject& two,
-    std::vector<Contact>& contacts,
-    real restitution,
-    real friction
+/*
+    Squared length under which a segment is considered a point, and the
+    determinant under which two segments are considered parallel.
+*/
+static const real SEGMENT_EPSILON = (real)1e-8;
+
+/*
+    Squared sine of the angle between two capsules under which they are
+    considered parallel, and touch along their length.
+*/
+static const real PARALLEL_SINE_SQUARED = (real)1e-3;
+
+/*
+    Fraction of a segment near its ends where the closest point to a box
+    edge is left to the contact of the end.
+*/
+static const real END_FRACTION = (real)1e-3;
+
+
+static inline real clampUnit(real value) {
+    return std::max((real)0, std::min((real)1, value));
+}
+
+
+static Vector3D closestPointOnSegment(
+    const Vector3D& start,
+    const Vector3D& end,
+    const Vector3D& point
 ) {
+    Vector3D segment = end - start;
+    real lengthSquared = segment.magnitudeSquared();
+    if (lengthSquared <= SEGMENT_EPSILON) {
+        return start;
+    }
+    return start + segment * clampUnit(((point - start) * segment) / lengthSquared);
+}
 
-    std::vector<Contact> contactsGenerated;
 
-    if (one.boundingVolume->getType() == BoundingVolume::TYPE::BOX &&
-        two.boundingVolume->getType() == BoundingVolume::TYPE::BOX) {
+/*
+    Finds the closest points of the segments startOne endOne and startTwo
+    endTwo, as the fractions s and t of the way along each (as described
+    in Real-Time Collision Detection by Christer Ericson). Parallel
+    segments have many closest points, and one of them is returned.
+*/
+static void closestPointsOfSegments(
+    const Vector3D& startOne,
+    const Vector3D& endOne,
+    const Vector3D& startTwo,
+    const Vector3D& endTwo,
+    real& s,
+    real& t
+) {
+    Vector3D directionOne = endOne - startOne;
+    Vector3D directionTwo = endTwo - startTwo;
+    Vector3D offset = startOne - startTwo;
 
-        Box boxOne(
-            static_cast<const BoundingBox*>(one.boundingVolume), 
-            one.boundingVolumeTransform, &one.body
-        );
-        Box boxTwo(
-            static_cast<const BoundingBox*>(two.boundingVolume),
-            two.boundingVolumeTransform, &two.body
-        );
-        boxAndBox(boxOne, boxTwo, contactsGenerated);
+    real a = directionOne * directionOne;
+    real e = directionTwo * directionTwo;
+    real f = directionTwo * offset;
+
+    if (a <= SEGMENT_EPSILON && e <= SEGMENT_EPSILON) {
+        s = t = 0;
+        return;
+    }
+    if (a <= SEGMENT_EPSILON) {
+        s = 0;
+        t = clampUnit(f / e);
+        return;
     }
-    else if (one.boundingVolume->getType() == BoundingVolume::TYPE::SPHERE &&
-        two.boundingVolume->getType() == BoundingVolume::TYPE::SPHERE) {
 
-        Ball sphereOne(
-            static_cast<const BoundingSphere*>(one.boundingVolume),
-            one.boundingVolumeTransform, &one.body
-        );
-        Ball sphereTwo(
-            static_cast<const BoundingSphere*>(two.boundingVolume),
-            two.boundingVolumeTransform, &two.body
-        );
-        sphereAndSphere(sphereOne, sphereTwo, contactsGenerated);
+    real c = directionOne * offset;
+    if (e <= SEGMENT_EPSILON) {
+        t = 0;
+        s = clampUnit(-c / a);
+        return;
     }
-    else if (one.boundingVolume->getType() == BoundingVolume::TYPE::SPHERE &&
-        two.boundingVolume->getType() == BoundingVolume::TYPE::BOX) {
 
-        Ball sphereOne(
-            static_cast<const BoundingSphere*>(one.boundingVolume),
-            one.boundingVolumeTransform, &one.body
-        );
-        Box boxTwo(
-            static_cast<const BoundingBox*>(two.boundingVolume),
-            two.boundingVolumeTransform, &two.body
+    real b = directionOne * directionTwo;
+    real denominator = a * e - b * b;
+    s = denominator > SEGMENT_EPSILON * a * e ?
+        clampUnit((b * f - c * e) / denominator) : 0;
+
+    t = (b * s + f) / e;
+    if (t < 0) {
+        t = 0;
+        s = clampUnit(-c / a);
+    }
+    else if (t > 1) {
+        t = 1;
+        s = clampUnit((b - c) / a);
+    }
+}
+
+
+/*
+    Adds the contact of two points rounded by a radius (the closest points
+    of the cores of two shapes) if they are closer than the sum of their
+    radii, with the normal pointing towards the first, and the contact
+    point halfway between the two surfaces. The fallback normal is used
+    when the points are at the same place. Returns the number of contacts
+    added.
+*/
+static unsigned int roundedPointsContact(
+    const Vector3D& pointOne,
+    real radiusOne,
+    RigidBody* bodyOne,
+    const Vector3D& pointTwo,
+    real radiusTwo,
+    RigidBody* bodyTwo,
+    const Vector3D& fallbackNormal,
+    unsigned int feature,
+    std::vector<Contact>& data
+) {
+    Vector3D midline = pointOne - pointTwo;
+    real distanceSquared = midline.magnitudeSquared();
+    real radius = radiusOne + radiusTwo;
+    if (distanceSquared >= radius * radius) {
+        return 0;
+    }
+
+    real distance = realSqrt(distanceSquared);
+    Vector3D normal = distanceSquared > 0 ?
+        midline * ((real)1.0 / distance) : fallbackNormal;
+
+    Contact contact;
+    contact.contactNormal = normal;
+    contact.penetration = radius - distance;
+    contact.contactPoint = (pointOne - normal * radiusOne +
+        pointTwo + normal * radiusTwo) * (real)0.5;
+    contact.body[0] = bodyOne;
+    contact.body[1] = bodyTwo;
+    contact.feature = feature;
+
+    data.push_back(contact);
+    return 1;
+}
+
+
+unsigned int pe::capsuleAndSphere(
+    const Capsule& capsule,
+    const Ball& sphere,
+    std::vector<Contact>& data
+) {
+    Vector3D centre = sphere.transformMatrix.getTranslation();
+    Vector3D closest = closestPointOnSegment(
+        capsule.getEnd(0), capsule.getEnd(1), centre
+    );
+
+    return roundedPointsContact(
+        closest, capsule.radius, capsule.body,
+        centre, sphere.radius, sphere.body,
+        capsule.getAxis(0), 0, data
+    );
+}
+
+
+unsigned int pe::capsuleAndCapsule(
+    const Capsule& one,
+    const Capsule& two,
+    std::vector<Contact>& data
+) {
+    Vector3D startOne = one.getEnd(0);
+    Vector3D endOne = one.getEnd(1);
+    Vector3D startTwo = two.getEnd(0);
+    Vector3D endTwo = two.getEnd(1);
+
+    Vector3D axisOne = one.getAxis(1);
+    Vector3D axisTwo = two.getAxis(1);
+    Vector3D centreOne = one.getAxis(3);
+
+    /*
+        Segments that cross are separated along the normal of both, and
+        parallel ones along any direction orthogonal to them.
+    */
+    Vector3D normal = axisOne % axisTwo;
+    bool parallel = normal.magnitudeSquared() < PARALLEL_SINE_SQUARED;
+    if (parallel) {
+        normal = one.getAxis(0);
+    }
+    normal.normalize();
+    if (normal * (centreOne - two.getAxis(3)) < 0) {
+        normal *= -1;
+    }
+
+    if (parallel) {
+        // Part of the first segment facing the second
+        real along = (startTwo - centreOne) * axisOne;
+        real otherAlong = (endTwo - centreOne) * axisOne;
+        real low = std::max(-one.halfHeight, std::min(along, otherAlong));
+        real high = std::min(one.halfHeight, std::max(along, otherAlong));
+
+        if (low < high) {
+            unsigned int count = 0;
+            real ends[2] = { low, high };
+            for (unsigned int i = 0; i < 2; i++) {
+                Vector3D point = centreOne + axisOne * ends[i];
+                count += roundedPointsContact(
+                    point, one.radius, one.body,
+                    closestPointOnSegment(startTwo, endTwo, point),
+                    two.radius, two.body, normal, i + 1, data
+                );
+            }
+            return count;
+        }
+    }
+
+    real s, t;
+    closestPointsOfSegments(startOne, endOne, startTwo, endTwo, s, t);
+    return roundedPointsContact(
+        startOne + (endOne - startOne) * s, one.radius, one.body,
+        startTwo + (endTwo - startTwo) * t, two.radius, two.body,
+        normal, 0, data
+    );
+}
+
+
+unsigned int pe::capsuleAndBox(
+    const Capsule& capsule,
+    const Box& box,
+    std::vector<Contact>& data
+) {
+    const Vector3D& halfSize = box.halfSize;
+
+    // The segment in the coordinates of the box
+    Vector3D ends[2] = {
+        box.transformMatrix.inverseTransform(capsule.getEnd(0)),
+        box.transformMatrix.inverseTransform(capsule.getEnd(1))
+    };
+    Vector3D direction = ends[1] - ends[0];
+
+    // Clips the segment by the slabs of the box to see if it crosses it
+    bool crosses = true;
+    real enter = 0;
+    real exit = 1;
+    for (unsigned int i = 0; i < 3 && crosses; i++) {
+        if (realAbs(direction[i]) <= SEGMENT_EPSILON) {
+            crosses = realAbs(ends[0][i]) <= halfSize[i];
+        }
+        else {
+            real first = (-halfSize[i] - ends[0][i]) / direction[i];
+            real second = (halfSize[i] - ends[0][i]) / direction[i];
+            enter = std::max(enter, std::min(first, second));
+            exit = std::min(exit, std::max(first, second));
+            crosses = enter <= exit;
+        }
+    }
+
+    unsigned int count = 0;
+
+    if (!crosses) {
+        Vector3D away = capsule.getAxis(3) - box.getAxis(3);
+        away.normalize();
+
+        // The ends of the segment, against their closest point on the box
+        for (unsigned int i = 0; i < 2; i++) {
+            Vector3D closest(
+                std::max(-halfSize.x, std::min(halfSize.x, ends[i].x)),
+                std::max(-halfSize.y, std::min(halfSize.y, ends[i].y)),
+                std::max(-halfSize.z, std::min(halfSize.z, ends[i].z))
+            );
+            count += roundedPointsContact(
+                box.transformMatrix.transform(ends[i]),
+                capsule.radius, capsule.body,
+                box.transformMatrix.transform(closest), 0, box.body,
+                away, i + 1, data
+            );
+        }
+
+        /*
+            The points of the segment closest to the edges of the box,
+            unless they are at its ends, which were already covered.
+            Those are the contacts of a capsule lying across an edge.
+        */
+        for (unsigned int axis = 0; axis < 3; axis++) {
+            unsigned int u = (axis + 1) % 3;
+            unsigned int v = (axis + 2) % 3;
+            for (unsigned int corner = 0; corner < 4; corner++) {
+                Vector3D start, end;
+                start[axis] = -halfSize[axis];
+                end[axis] = halfSize[axis];
+                start[u] = end[u] = (corner & 1) ? -halfSize[u] : halfSize[u];
+                start[v] = end[v] = (corner & 2) ? -halfSize[v] : halfSize[v];
+
+                real s, t;
+                closestPointsOfSegments(ends[0], ends[1], start, end, s, t);
+                if (s <= END_FRACTION || s >= 1 - END_FRACTION) {
+                    continue;
+                }
+
+                count += roundedPointsContact(
+                    box.transformMatrix.transform(ends[0] + direction * s),
+                    capsule.radius, capsule.body,
+                    box.transformMatrix.transform(start + (end - start) * t),
+                    0, box.body, away, 3 + axis * 4 + corner, data
+                );
+            }
+        }
+        return count;
+    }
+
+    /*
+        The segment crosses the box, so the capsule is pushed out through
+        the face it penetrates the least. The edge directions could push
+        it out a shorter way, but this only happens when the resolver let
+        the capsule sink by more than its radius.
+    */
+    real smallest = REAL_MAX;
+    unsigned int best = 0;
+    real sign = 1;
+    for (unsigned int i = 0; i < 3; i++) {
+        real low = std::min(ends[0][i], ends[1][i]);
+        real high = std::max(ends[0][i], ends[1][i]);
+        real up = halfSize[i] + capsule.radius - low;
+        real down = high + halfSize[i] + capsule.radius;
+        if (up < smallest) {
+            smallest = up;
+            best = i;
+            sign = 1;
+        }
+        if (down < smallest) {
+            smallest = down;
+            best = i;
+            sign = -1;
+        }
+    }
+
+    Vector3D normal = box.getAxis(best) * sign;
+    for (unsigned int i = 0; i < 2; i++) {
+        real penetration = halfSize[best] + capsule.radius -
+            ends[i][best] * sign;
+        if (penetration <= 0) {
+            continue;
+        }
+
+        Contact contact;
+        contact.contactNormal = normal;
+        contact.penetration = penetration;
+        contact.contactPoint = box.transformMatrix.transform(ends[i]) -
+            normal * (capsule.radius - penetration * (real)0.5);
+        contact.body[0] = capsule.body;
+        contact.body[1] = box.body;
+        contact.feature = 16 + i;
+        data.push_back(contact);
+        count++;
+    }
+    return count;
+}
+
+
+/*
+    Batch routine of the table made of a routine taking the shapes of the
+    two objects of each pair, in the same order.
+*/
+template <
+    typename ShapeOne,
+    typename ShapeTwo,
+    unsigned int (*routine)(
+        const ShapeOne&, const ShapeTwo&, std::vector<Contact>&
+    )
+>
+static unsigned int routineBatch(
+    const PotentialContact* pairs,
+    unsigned int pairCount,
+    std::vector<Contact>& contacts,
+    PairCache<SimplexCache>*
+) {
+    unsigned int count = 0;
+    for (unsigned int i = 0; i < pairCount; i++) {
+        count += routine(
+            ShapeOne(*pairs[i].object[0]),
+            ShapeTwo(*pairs[i].object[1]),
+            contacts
         );
-        boxAndSphere(boxTwo, sphereOne, contactsGenerated);
     }
-    else if (one.boundingVolume->getType() == BoundingVolume::TYPE::BOX &&
-        two.boundingVolume->getType() == BoundingVolume::TYPE::SPHERE) {
+    return count;
+}
 
-        Box boxOne(
-            static_cast<const BoundingBox*>(one.boundingVolume),
-            one.boundingVolumeTransform, &one.body
+
+/*
+    Same, for the routines taking the shapes in the opposite order (so
+    the shape of the second object comes first in the contacts).
+*/
+template <
+    typename ShapeOne,
+    typename ShapeTwo,
+    unsigned int (*routine)(
+        const ShapeOne&, const ShapeTwo&, std::vector<Contact>&
+    )
+>
+static unsigned int swappedRoutineBatch(
+    const PotentialContact* pairs,
+    unsigned int pairCount,
+    std::vector<Contact>& contacts,
+    PairCache<SimplexCache>*
+) {
+    unsigned int count = 0;
+    for (unsigned int i = 0; i < pairCount; i++) {
+        count += routine(
+            ShapeOne(*pairs[i].object[1]),
+            ShapeTwo(*pairs[i].object[0]),
+            contacts
         );
-        Ball sphereTwo(
-            static_cast<const BoundingSphere*>(two.boundingVolume),
-            two.boundingVolumeTransform, &two.body
+    }
+    return count;
+}
+
+
+// Any pair with a convex hull, as two convex shapes
+static unsigned int convexBatch(
+    const PotentialContact* pairs,
+    unsigned int pairCount,
+    std::vector<Contact>& contacts,
+    PairCache<SimplexCache>* simplexCaches
+) {
+    unsigned int count = 0;
+    for (unsigned int i = 0; i < pairCount; i++) {
+        RigidObject& one = *pairs[i].object[0];
+        RigidObject& two = *pairs[i].object[1];
+
+        SimplexCache* cache = nullptr;
+        if (simplexCaches) {
+            cache = &simplexCaches->get(&one.body, &two.body).first;
+        }
+        count += convexAndConvex(
+            ConvexShape(one), ConvexShape(two), contacts, cache
         );
-        boxAndSphere(boxOne, sphereTwo, contactsGenerated);
     }
+    return count;
+}
 
-    for (Contact& contact : contactsGenerated) {
-        contact.restitution = restitution;
-        contact.friction = friction;
 
-        contacts.push_back(contact);
+/*
+    The collision dispatch table, with a row for the type of the first
+    object and a column for the type of the second, in the order of the
+    types (box, sphere, capsule and convex hull). The box and box, box and
+    sphere, and sphere and sphere batches use the SIMD kernels.
+*/
+static const ContactBatchRoutine CONTACT_BATCH_ROUTINES
+[BoundingVolume::TYPE_COUNT][BoundingVolume::TYPE_COUNT] = {
+    {
+        boxAndBoxBatch,
+        boxAndSphereBatch,
+        swappedRoutineBatch<Capsule, Box, capsuleAndBox>,
+        convexBatch
+    },
+    {
+        swappedRoutineBatch<Box, Ball, boxAndSphere>,
+        sphereAndSphereBatch,
+        swappedRoutineBatch<Capsule, Ball, capsuleAndSphere>,
+        convexBatch
+    },
+    {
+        routineBatch<Capsule, Box, capsuleAndBox>,
+        routineBatch<Capsule, Ball, capsuleAndSphere>,
+        routineBatch<Capsule, Capsule, capsuleAndCapsule>,
+        convexBatch
+    },
+    {
+        convexBatch,
+        convexBatch,
+        convexBatch,
+        convexBatch
+    }
+};
+
+
+ContactBatchRoutine pe::getContactBatchRoutine(
+    BoundingVolume::TYPE one,
+    BoundingVolume::TYPE two
+) {
+    return CONTACT_BATCH_ROUTINES[(unsigned int)one][(unsigned int)two];
+}
+
+
+void pe::generateContacts(
+    RigidObject& one,
+    RigidObject& two,
+    std::vector<Contact>& contacts,
+    real restitution,
+    real friction,
+    PairCache<SimplexCache>* simplexCaches
+) {
+    PotentialContact pair{ { &one, &two } };
+    unsigned int first = contacts.size();
+
+    getContactBatchRoutine(
+        one.boundingVolume->getType(), two.boundingVolume->getType()
+    )(&pair, 1, contacts, simplexCaches);
+
+    for (unsigned int i = first; i < contacts.size(); i++) {
+        contacts[i].restitution = restitution;
+        contacts[i].friction = friction;
     }
 }
\ No newline at end of file
@@ -6,9 +6,14 @@
 #include "rigidObject.h"
 #include "boundingBox.h"
 #include "boundingSphere.h"
+#include "boundingCapsule.h"
+#include "pairCache.h"
+#include "BVHNode.h"
 
 namespace pe {
 
+    struct SimplexCache;
+
     /*
         An abstraction used in all of this collision detection system,
         so that any shape (not necessarily a box shape) can use the
@@ -23,7 +28,12 @@ namespace pe {
     */
     struct Box {
 
-        Matrix3x4 transformMatrix;
+        /*
+            The bounding volume transform of the object, which outlives
+            the box, so it isn't copied each time a pair is checked (the
+            same goes for the ball and capsule).
+        */
+        const Matrix3x4& transformMatrix;
         Vector3D halfSize;
         RigidBody* body;
 
@@ -40,12 +50,17 @@ namespace pe {
             const BoundingBox* box, 
             const Matrix3x4& boundingVolumeTransform,
             RigidBody* body
-        ) {
+        ) : transformMatrix{ boundingVolumeTransform } {
             halfSize = box->getHalfsize();
             this->body = body;
-            transformMatrix = boundingVolumeTransform;
         }
 
+        // The box of an object whose bounding volume is a box
+        explicit Box(RigidObject& object) : Box(
+            static_cast<const BoundingBox*>(object.boundingVolume),
+            object.boundingVolumeTransform, &object.body
+        ) {}
+
         Vector3D getAxis(int index) const {
             return transformMatrix.getColumnVector(index);
         }
@@ -63,7 +78,7 @@ namespace pe {
    */
     struct Ball {
 
-        Matrix3x4 transformMatrix;
+        const Matrix3x4& transformMatrix;
         RigidBody* body;
         real radius;
 
@@ -74,18 +89,65 @@ namespace pe {
             const BoundingSphere* ball,
             const Matrix3x4& boundingVolumeTransform,
             RigidBody* body
-        ) {
+        ) : transformMatrix{ boundingVolumeTransform } {
             radius = ball->getRadius();
             this->body = body;
-            transformMatrix = boundingVolumeTransform;
         }
 
+        // The ball of an object whose bounding volume is a sphere
+        explicit Ball(RigidObject& object) : Ball(
+            static_cast<const BoundingSphere*>(object.boundingVolume),
+            object.boundingVolumeTransform, &object.body
+        ) {}
+
         Vector3D getAxis(int index) const {
             return body->transformMatrix.getColumnVector(index);
         }
     };
 
 
+    /*
+        The capsule abstraction, a segment along the y axis of the
+        transform, going from -halfHeight to halfHeight, rounded by a
+        radius. Its contacts are those of the closest points of the
+        segment to the other shape, rounded by the radius.
+    */
+    struct Capsule {
+
+        const Matrix3x4& transformMatrix;
+        real radius;
+        real halfHeight;
+        RigidBody* body;
+
+        Capsule(
+            const BoundingCapsule* capsule,
+            const Matrix3x4& boundingVolumeTransform,
+            RigidBody* body
+        ) : transformMatrix{ boundingVolumeTransform } {
+            radius = capsule->getRadius();
+            halfHeight = capsule->getHalfHeight();
+            this->body = body;
+        }
+
+        // The capsule of an object whose bounding volume is a capsule
+        explicit Capsule(RigidObject& object) : Capsule(
+            static_cast<const BoundingCapsule*>(object.boundingVolume),
+            object.boundingVolumeTransform, &object.body
+        ) {}
+
+        Vector3D getAxis(int index) const {
+            return transformMatrix.getColumnVector(index);
+        }
+
+        // End of the segment (0 for the bottom, 1 for the top)
+        Vector3D getEnd(int index) const {
+            return transformMatrix.transform(
+                Vector3D(0, index ? halfHeight : -halfHeight, 0)
+            );
+        }
+    };
+
+
     static inline real transformToAxis(
         const Box& box,
         const Vector3D& axis
@@ -139,6 +201,15 @@ namespace pe {
     );
 
 
+    /*
+        Flags of the features of the box and box contacts (see the contact
+        feature), telling the single contacts of the point to face and
+        edge to edge cases apart from those of the face manifolds.
+    */
+    const unsigned int FEATURE_POINT_FACE = 0x40000000;
+    const unsigned int FEATURE_EDGE_EDGE = 0x80000000;
+
+
     void fillPointFaceBoxBox(
         const Box& one,
         const Box& two,
@@ -149,6 +220,47 @@ namespace pe {
     );
 
 
+    /*
+        Called when the separating axis is a face normal of box one (the
+        reference face), to generate a manifold of up to four contacts
+        for face to face and edge to face contacts, so that boxes resting
+        on each other are held up by several points instead of rocking
+        on a single one.
+        The face of box two most facing the reference face (the incident
+        face) is clipped by the side planes of the reference face, and
+        the clipped points below the reference face are the contacts,
+        reduced to four if there are more. All the contacts share the
+        same normal, so their contact basis is calculated once.
+        Returns the number of contacts generated.
+    */
+    unsigned int fillFaceFaceBoxBox(
+        const Box& one,
+        const Box& two,
+        const Vector3D& toCentre,
+        std::vector<Contact>& contacts,
+        unsigned best,
+        real pen
+    );
+
+
+    /*
+        Generates the contacts of two overlapping boxes once the axis of
+        least penetration is found, given by its index in the order of
+        the separating axis test (the three axes of box one, the three of
+        box two, then their nine cross products), along with the best of
+        the six face axes. Returns the number of contacts generated.
+    */
+    unsigned int fillBoxAndBox(
+        const Box& one,
+        const Box& two,
+        const Vector3D& toCentre,
+        std::vector<Contact>& contacts,
+        unsigned best,
+        real pen,
+        unsigned bestSingleAxis
+    );
+
+
     static inline Vector3D contactPoint(
         const Vector3D& pOne,
         const Vector3D& dOne,
@@ -187,12 +299,84 @@ namespace pe {
     );
 
 
+    /*
+        The capsule routines put the capsule first, so the normal points
+        towards it. The contact is at the closest point of the segment
+        to the sphere.
+    */
+    unsigned int capsuleAndSphere(
+        const Capsule& capsule,
+        const Ball& sphere,
+        std::vector<Contact>& data
+    );
+
+
+    /*
+        Two capsules touch at the closest points of their segments, or,
+        when the segments are close to parallel (like limbs resting side
+        by side), at both ends of the part of the segments that faces
+        the other, so that they don't roll around a single point.
+    */
+    unsigned int capsuleAndCapsule(
+        const Capsule& one,
+        const Capsule& two,
+        std::vector<Contact>& data
+    );
+
+
+    /*
+        A capsule outside of the box (its segment not crossing the box)
+        touches it with the ends of its segment that are within the
+        radius of the box, and with the points of its segment within the
+        radius of the edges of the box (when the capsule lies across an
+        edge). If the segment crosses the box, the capsule is pushed out
+        through the face of the box it penetrates the least.
+    */
+    unsigned int capsuleAndBox(
+        const Capsule& capsule,
+        const Box& box,
+        std::vector<Contact>& data
+    );
+
+
+    /*
+        Routine of the collision dispatch table, which generates the
+        contacts of a batch of pairs of objects whose bounding volumes
+        have the types of its row and column (in that order), writing them
+        straight at the end of the contacts buffer. Returns the number of
+        contacts generated. Pairs where either is a convex hull use GJK
+        and EPA, which start from the simplex the cache holds for the
+        pair, if a cache is given.
+        Running a routine over many pairs at once keeps its code and data
+        hot, and lets a routine process several pairs together.
+    */
+    typedef unsigned int (*ContactBatchRoutine)(
+        const PotentialContact* pairs,
+        unsigned int pairCount,
+        std::vector<Contact>& contacts,
+        PairCache<SimplexCache>* simplexCaches
+    );
+
+
+    // Entry of the collision dispatch table for the two types
+    ContactBatchRoutine getContactBatchRoutine(
+        BoundingVolume::TYPE one,
+        BoundingVolume::TYPE two
+    );
+
+
+    /*
+        Generates the contacts of two objects, with the routine made for
+        the shapes of their bounding volumes (see the dispatch table),
+        and gives them the restitution and friction.
+    */
     void generateContacts(
         RigidObject& one,
         RigidObject& two,
         std::vector<Contact>& contacts,
         real restitution,
-        real friction
+        real friction,
+        PairCache<SimplexCache>* simplexCaches = nullptr
     );
 
 }
@@ -1,169 +1,970 @@
-
-#ifdef DONE_REFACTOR
-
 #include "gjk.h"
 
 using namespace pe;
 
 
-std::tuple<Simplex, Vector3D, bool> pe::NearestSimplex(const Simplex& s) {
-    // Implementation of NearestSimplex based on GJK algorithm
-    size_t dim = s.vertices.size();
-    Vector3D direction;
-
-    if (dim == 2) {
-        // Line segment simplex
-        Vector3D A = s.vertices[0];
-        Vector3D B = s.vertices[1];
-        Vector3D AO = -A;
-        Vector3D AB = B - A;
-
-        if (AB.scalarProduct(AO) > 0) {
-            // Origin is outside AB, set simplex to AB
-            direction = AB.vectorProduct(AO).vectorProduct(AB);
-            Simplex simplex;
-            simplex.vertices = { B, A };
-            return std::make_tuple(simplex, direction, false);
-        }
-        else {
-            // Origin is inside AB, return simplex and normal towards origin
-            direction = AB.vectorProduct(AO).vectorProduct(AB);
-            return std::make_tuple(s, direction, true);
-        }
-    }
-    else if (dim == 3) {
-        // Triangle simplex
-        Vector3D A = s.vertices[0];
-        Vector3D B = s.vertices[1];
-        Vector3D C = s.vertices[2];
-        Vector3D AO = -A;
-        Vector3D AB = B - A;
-        Vector3D AC = C - A;
-        Vector3D ABC_normal = AB.vectorProduct(AC);
-
-        if (ABC_normal.scalarProduct(AO) > 0) {
-            // Origin is outside ABC, determine which face to keep
-            Vector3D AB_normal = AB.vectorProduct(ABC_normal);
-            Vector3D AC_normal = ABC_normal.vectorProduct(AC);
-
-            if (AB_normal.scalarProduct(AO) > 0) {
-                // Origin is outside AB
-                direction = AB_normal;
-                Simplex simplex;
-                simplex.vertices = { A, B };
-                return std::make_tuple(simplex, direction, false);
+// Maximum number of iterations of each query
+static const unsigned int MAX_GJK_ITERATIONS = 32;
+static const unsigned int MAX_EPA_ITERATIONS = 64;
+static const unsigned int MAX_ADVANCEMENT_ITERATIONS = 32;
+
+// Size of the polytope of EPA, which gains a vertex each iteration
+static const unsigned int MAX_EPA_VERTICES = MAX_EPA_ITERATIONS + 4;
+static const unsigned int MAX_EPA_FACES = 2 * MAX_EPA_VERTICES;
+
+/*
+    Relative improvement under which GJK stops getting closer, and EPA
+    stops expanding the polytope.
+*/
+static const real GJK_TOLERANCE = (real)1e-4;
+static const real EPA_TOLERANCE = (real)1e-4;
+
+/*
+    Distance between the shapes (without their radius) under which they
+    are considered to be overlapping, as the closest points can't be
+    found more precisely than that.
+*/
+static const real OVERLAP_DISTANCE = (real)1e-4;
+
+/*
+    Number of vertices of a hull under which checking all of them for the
+    support point is as fast as walking the mesh.
+*/
+static const unsigned int MIN_WALKED_VERTICES = 32;
+
+
+ConvexShape::ConvexShape(
+    const BoundingConvexHull* hull,
+    const Matrix3x4& boundingVolumeTransform,
+    RigidBody* body
+) : vertices{ hull->getMesh()->getVertices().data() },
+    vertexCount{ (unsigned int)hull->getMesh()->getVertices().size() },
+    halfSize{ Vector3D::ZERO },
+    radius{ 0 },
+    adjacencyOffsets{ nullptr },
+    adjacentVertices{ nullptr },
+    supportHint{ 0 },
+    transformMatrix{ boundingVolumeTransform },
+    body{ body } {
+    const Mesh* mesh = hull->getMesh();
+    if (hull->isConvex() && vertexCount >= MIN_WALKED_VERTICES) {
+        adjacencyOffsets = mesh->getAdjacencyOffsets().data();
+        adjacentVertices = mesh->getAdjacentVertices().data();
+    }
+}
+
+
+ConvexShape::ConvexShape(
+    const BoundingCapsule* capsule,
+    const Matrix3x4& boundingVolumeTransform,
+    RigidBody* body
+) : vertices{ capsule->getEnds() },
+    vertexCount{ 2 },
+    halfSize{ Vector3D::ZERO },
+    radius{ capsule->getRadius() },
+    adjacencyOffsets{ nullptr },
+    adjacentVertices{ nullptr },
+    supportHint{ 0 },
+    transformMatrix{ boundingVolumeTransform },
+    body{ body } {}
+
+
+ConvexShape::ConvexShape(const Box& box) :
+    vertices{ nullptr },
+    vertexCount{ 8 },
+    halfSize{ box.halfSize },
+    radius{ 0 },
+    adjacencyOffsets{ nullptr },
+    adjacentVertices{ nullptr },
+    supportHint{ 0 },
+    transformMatrix{ box.transformMatrix },
+    body{ box.body } {}
+
+
+ConvexShape::ConvexShape(const Ball& ball) :
+    vertices{ &Vector3D::ZERO },
+    vertexCount{ 1 },
+    halfSize{ Vector3D::ZERO },
+    radius{ ball.radius },
+    adjacencyOffsets{ nullptr },
+    adjacentVertices{ nullptr },
+    supportHint{ 0 },
+    transformMatrix{ ball.transformMatrix },
+    body{ ball.body } {}
+
+
+ConvexShape::ConvexShape(RigidObject& object) :
+    vertices{ nullptr },
+    vertexCount{ 0 },
+    halfSize{ Vector3D::ZERO },
+    radius{ 0 },
+    adjacencyOffsets{ nullptr },
+    adjacentVertices{ nullptr },
+    supportHint{ 0 },
+    transformMatrix{ object.boundingVolumeTransform },
+    body{ &object.body } {
+    switch (object.boundingVolume->getType()) {
+    case BoundingVolume::TYPE::BOX:
+        *this = ConvexShape(Box(
+            static_cast<const BoundingBox*>(object.boundingVolume),
+            object.boundingVolumeTransform, &object.body
+        ));
+        break;
+    case BoundingVolume::TYPE::SPHERE:
+        *this = ConvexShape(Ball(
+            static_cast<const BoundingSphere*>(object.boundingVolume),
+            object.boundingVolumeTransform, &object.body
+        ));
+        break;
+    case BoundingVolume::TYPE::CAPSULE:
+        *this = ConvexShape(
+            static_cast<const BoundingCapsule*>(object.boundingVolume),
+            object.boundingVolumeTransform, &object.body
+        );
+        break;
+    case BoundingVolume::TYPE::CONVEX_HULL:
+        *this = ConvexShape(
+            static_cast<const BoundingConvexHull*>(object.boundingVolume),
+            object.boundingVolumeTransform, &object.body
+        );
+        break;
+    default:
+        assert(false && "Bounding volume has no convex shape");
+        break;
+    }
+}
+
+
+unsigned int ConvexShape::getSupportIndex(
+    const Vector3D& localDirection
+) const {
+    // The corner of a box is the one with the signs of the direction
+    if (!vertices) {
+        return (localDirection.x < 0) |
+            ((localDirection.y < 0) << 1) |
+            ((localDirection.z < 0) << 2);
+    }
+
+    if (!adjacencyOffsets) {
+        unsigned int best = 0;
+        real bestDistance = vertices[0] * localDirection;
+        for (unsigned int i = 1; i < vertexCount; i++) {
+            real distance = vertices[i] * localDirection;
+            if (distance > bestDistance) {
+                bestDistance = distance;
+                best = i;
             }
-            else if (AC_normal.scalarProduct(AO) > 0) {
-                // Origin is outside AC
-                direction = AC_normal;
-                Simplex simplex;
-                simplex.vertices = { A, C };
-                return std::make_tuple(simplex, direction, false);
+        }
+        return best;
+    }
+
+    /*
+        Moves to the furthest neighbour as long as it is further than the
+        current vertex, which on a convex mesh ends on the support point.
+        Each move is strictly further along the direction, so the walk
+        always ends.
+    */
+    unsigned int current = supportHint < vertexCount ? supportHint : 0;
+    real currentDistance = vertices[current] * localDirection;
+    while (true) {
+        unsigned int next = current;
+        for (int i = adjacencyOffsets[current];
+            i < adjacencyOffsets[current + 1]; i++) {
+            unsigned int neighbour = adjacentVertices[i];
+            real distance = vertices[neighbour] * localDirection;
+            if (distance > currentDistance) {
+                currentDistance = distance;
+                next = neighbour;
             }
-            else {
-                // Origin is inside ABC
-                direction = ABC_normal;
-                return std::make_tuple(s, direction, true);
+        }
+        if (next == current) {
+            break;
+        }
+        current = next;
+    }
+    supportHint = current;
+    return current;
+}
+
+
+Vector3D ConvexShape::getLocalVertex(unsigned int index) const {
+    if (!vertices) {
+        return Vector3D(
+            (index & 1) ? -halfSize.x : halfSize.x,
+            (index & 2) ? -halfSize.y : halfSize.y,
+            (index & 4) ? -halfSize.z : halfSize.z
+        );
+    }
+    return vertices[index];
+}
+
+
+// Fills the vertex of the simplex made from the given vertices of the shapes
+static void setSimplexVertex(
+    const ConvexShape& one,
+    const ConvexShape& two,
+    unsigned int indexOne,
+    unsigned int indexTwo,
+    SimplexVertex& vertex
+) {
+    vertex.indexOne = indexOne;
+    vertex.indexTwo = indexTwo;
+    vertex.pointOne = one.transformMatrix.transform(
+        one.getLocalVertex(indexOne)
+    );
+    vertex.pointTwo = two.transformMatrix.transform(
+        two.getLocalVertex(indexTwo)
+    );
+    vertex.point = vertex.pointOne - vertex.pointTwo;
+}
+
+
+/*
+    Fills the vertex of the simplex with the support point of the
+    Minkowski difference along the given direction, which is the
+    difference of the support point of the first shape along it, and of
+    the second against it.
+*/
+static void findSupport(
+    const ConvexShape& one,
+    const ConvexShape& two,
+    const Vector3D& direction,
+    SimplexVertex& vertex
+) {
+    unsigned int indexOne = one.getSupportIndex(
+        one.transformMatrix.inverseTransformDirection(direction)
+    );
+    unsigned int indexTwo = two.getSupportIndex(
+        two.transformMatrix.inverseTransformDirection(direction * -1)
+    );
+    setSimplexVertex(one, two, indexOne, indexTwo, vertex);
+}
+
+
+// Reduces the simplex to one of its vertices, which is the closest point
+static Vector3D keepVertex(Simplex& simplex, unsigned int index) {
+    simplex.vertices[0] = simplex.vertices[index];
+    simplex.vertices[0].weight = 1;
+    simplex.count = 1;
+    return simplex.vertices[0].point;
+}
+
+
+/*
+    Reduces the simplex to one of its edges, where the closest point is
+    at the given fraction of the way from the first vertex to the second.
+*/
+static Vector3D keepEdge(
+    Simplex& simplex,
+    unsigned int first,
+    unsigned int second,
+    real fraction
+) {
+    SimplexVertex a = simplex.vertices[first];
+    SimplexVertex b = simplex.vertices[second];
+    a.weight = 1 - fraction;
+    b.weight = fraction;
+    simplex.vertices[0] = a;
+    simplex.vertices[1] = b;
+    simplex.count = 2;
+    return a.point + (b.point - a.point) * fraction;
+}
+
+
+static Vector3D solveSegment(Simplex& simplex) {
+    const Vector3D& a = simplex.vertices[0].point;
+    Vector3D ab = simplex.vertices[1].point - a;
+
+    real t = -(a * ab);
+    if (t <= 0) {
+        return keepVertex(simplex, 0);
+    }
+    real length = ab * ab;
+    if (t >= length) {
+        return keepVertex(simplex, 1);
+    }
+    return keepEdge(simplex, 0, 1, t / length);
+}
+
+
+/*
+    Finds the point of the triangle closest to the origin by checking
+    which of the regions of its vertices, edges or face the origin is in
+    (as done in Real-Time Collision Detection by Christer Ericson).
+*/
+static Vector3D solveTriangle(Simplex& simplex) {
+    const Vector3D& a = simplex.vertices[0].point;
+    const Vector3D& b = simplex.vertices[1].point;
+    const Vector3D& c = simplex.vertices[2].point;
+    Vector3D ab = b - a;
+    Vector3D ac = c - a;
+
+    real d1 = -(ab * a);
+    real d2 = -(ac * a);
+    if (d1 <= 0 && d2 <= 0) {
+        return keepVertex(simplex, 0);
+    }
+
+    real d3 = -(ab * b);
+    real d4 = -(ac * b);
+    if (d3 >= 0 && d4 <= d3) {
+        return keepVertex(simplex, 1);
+    }
+
+    real vc = d1 * d4 - d3 * d2;
+    if (vc <= 0 && d1 >= 0 && d3 <= 0) {
+        return keepEdge(simplex, 0, 1, d1 / (d1 - d3));
+    }
+
+    real d5 = -(ab * c);
+    real d6 = -(ac * c);
+    if (d6 >= 0 && d5 <= d6) {
+        return keepVertex(simplex, 2);
+    }
+
+    real vb = d5 * d2 - d1 * d6;
+    if (vb <= 0 && d2 >= 0 && d6 <= 0) {
+        return keepEdge(simplex, 0, 2, d2 / (d2 - d6));
+    }
+
+    real va = d3 * d6 - d5 * d4;
+    if (va <= 0 && (d4 - d3) >= 0 && (d5 - d6) >= 0) {
+        return keepEdge(
+            simplex, 1, 2, (d4 - d3) / ((d4 - d3) + (d5 - d6))
+        );
+    }
+
+    // A flat triangle is treated as its first edge
+    real sum = va + vb + vc;
+    if (sum <= 0) {
+        simplex.count = 2;
+        return solveSegment(simplex);
+    }
+
+    real v = vb / sum;
+    real w = vc / sum;
+    simplex.vertices[0].weight = 1 - v - w;
+    simplex.vertices[1].weight = v;
+    simplex.vertices[2].weight = w;
+    return a + ab * v + ac * w;
+}
+
+
+/*
+    Finds the point of the tetrahedron closest to the origin, which is
+    on one of the faces the origin is in front of, setting enclosed if
+    there are none (the origin is inside).
+*/
+static Vector3D solveTetrahedron(Simplex& simplex, bool& enclosed) {
+
+    // Each face, followed by the vertex opposite to it
+    static const unsigned int faces[4][4] = {
+        { 0, 1, 2, 3 }, { 0, 3, 1, 2 }, { 0, 2, 3, 1 }, { 1, 3, 2, 0 }
+    };
+
+    Simplex best;
+    Vector3D closest;
+    real closestDistance = REAL_MAX;
+    enclosed = true;
+
+    for (unsigned int i = 0; i < 4; i++) {
+        const Vector3D& p = simplex.vertices[faces[i][0]].point;
+        const Vector3D& q = simplex.vertices[faces[i][1]].point;
+        const Vector3D& r = simplex.vertices[faces[i][2]].point;
+        const Vector3D& opposite = simplex.vertices[faces[i][3]].point;
+
+        Vector3D normal = (q - p) % (r - p);
+        real originSide = -(normal * p);
+        real oppositeSide = normal * (opposite - p);
+
+        /*
+            A flat tetrahedron is treated as the triangle without its
+            newest vertex (the last), which added nothing.
+        */
+        if (realAbs(oppositeSide) <= (real)1e-6 *
+            normal.magnitude() * (opposite - p).magnitude()) {
+            simplex.count = 3;
+            enclosed = false;
+            return solveTriangle(simplex);
+        }
+
+        if (originSide * oppositeSide < 0) {
+            enclosed = false;
+
+            Simplex face;
+            face.vertices[0] = simplex.vertices[faces[i][0]];
+            face.vertices[1] = simplex.vertices[faces[i][1]];
+            face.vertices[2] = simplex.vertices[faces[i][2]];
+            face.count = 3;
+
+            Vector3D point = solveTriangle(face);
+            real distance = point * point;
+            if (distance < closestDistance) {
+                closestDistance = distance;
+                closest = point;
+                best = face;
             }
         }
-        else {
-            // Origin is inside ABC, return simplex and normal towards origin
-            direction = ABC_normal;
-            return std::make_tuple(s, direction, true);
+    }
+
+    if (!enclosed) {
+        simplex = best;
+    }
+    return closest;
+}
+
+
+real pe::gjkDistance(
+    const ConvexShape& one,
+    const ConvexShape& two,
+    Simplex& simplex,
+    Vector3D& pointOne,
+    Vector3D& pointTwo,
+    SimplexCache* cache
+) {
+    /*
+        Starts from the simplex of the previous step if there is one, and
+        walks the meshes from its first vertex.
+    */
+    simplex.count = 0;
+    if (cache && cache->count > 0) {
+        one.supportHint = cache->indexOne[0];
+        two.supportHint = cache->indexTwo[0];
+    }
+    if (cache) {
+        for (unsigned int i = 0; i < cache->count && i < 4; i++) {
+            if (cache->indexOne[i] < one.vertexCount &&
+                cache->indexTwo[i] < two.vertexCount) {
+                setSimplexVertex(
+                    one, two, cache->indexOne[i], cache->indexTwo[i],
+                    simplex.vertices[simplex.count++]
+                );
+            }
         }
     }
-    else {
-        // Higher dimensions not implemented for demonstration
-        // You would need to handle higher-dimensional simplices accordingly
-        return std::make_tuple(s, Vector3D(), false);
+
+    /*
+        Otherwise it starts from the support point towards the origin,
+        from the difference of the centres.
+    */
+    if (simplex.count == 0) {
+        Vector3D direction = two.transformMatrix.getTranslation() -
+            one.transformMatrix.getTranslation();
+        if (direction.magnitudeSquared() == 0) {
+            direction = Vector3D::RIGHT;
+        }
+        findSupport(one, two, direction, simplex.vertices[0]);
+        simplex.count = 1;
     }
+
+    Vector3D closest;
+    bool enclosed = false;
+    real previousDistance = REAL_MAX;
+
+    for (unsigned int iteration = 0; iteration < MAX_GJK_ITERATIONS;
+        iteration++) {
+
+        switch (simplex.count) {
+        case 1:
+            closest = simplex.vertices[0].point;
+            simplex.vertices[0].weight = 1;
+            break;
+        case 2:
+            closest = solveSegment(simplex);
+            break;
+        case 3:
+            closest = solveTriangle(simplex);
+            break;
+        default:
+            closest = solveTetrahedron(simplex, enclosed);
+            break;
+        }
+
+        real distance = closest * closest;
+        if (enclosed || distance <= OVERLAP_DISTANCE * OVERLAP_DISTANCE) {
+            enclosed = true;
+            break;
+        }
+
+        // Numerical errors can keep the simplex from getting any closer
+        if (distance >= previousDistance) {
+            break;
+        }
+        previousDistance = distance;
+
+        SimplexVertex& vertex = simplex.vertices[simplex.count];
+        findSupport(one, two, closest * -1, vertex);
+
+        // A support point already in the simplex means it is the closest
+        bool repeated = false;
+        for (unsigned int i = 0; i < simplex.count; i++) {
+            repeated = repeated ||
+                (simplex.vertices[i].indexOne == vertex.indexOne &&
+                    simplex.vertices[i].indexTwo == vertex.indexTwo);
+        }
+        if (repeated) {
+            break;
+        }
+
+        // As is one that gets no closer to the origin than the simplex
+        if (distance - closest * vertex.point <= GJK_TOLERANCE * distance) {
+            break;
+        }
+
+        simplex.count++;
+    }
+
+    if (cache) {
+        cache->count = simplex.count;
+        for (unsigned int i = 0; i < simplex.count; i++) {
+            cache->indexOne[i] = simplex.vertices[i].indexOne;
+            cache->indexTwo[i] = simplex.vertices[i].indexTwo;
+        }
+    }
+
+    if (enclosed) {
+        return 0;
+    }
+
+    pointOne = Vector3D::ZERO;
+    pointTwo = Vector3D::ZERO;
+    for (unsigned int i = 0; i < simplex.count; i++) {
+        pointOne += simplex.vertices[i].pointOne * simplex.vertices[i].weight;
+        pointTwo += simplex.vertices[i].pointTwo * simplex.vertices[i].weight;
+    }
+    return realSqrt(closest * closest);
 }
 
 
-Vector3D pe::support(
-    const pe::Polyhedron& shape,
-    const Vector3D& direction
+/*
+    Adds support points to the simplex of an overlapping GJK query until
+    it is a tetrahedron, as the query stops as soon as it touches the
+    origin, with as few as one vertex. Returns false if the difference is
+    too flat for one to be found.
+*/
+static bool completeTetrahedron(
+    const ConvexShape& one,
+    const ConvexShape& two,
+    SimplexVertex* vertices,
+    unsigned int& count
 ) {
+    real scale = 1;
+    for (unsigned int i = 0; i < count; i++) {
+        scale = std::max(scale, vertices[i].point.magnitude());
+    }
+    real epsilon = (real)1e-5 * scale;
+
+    static const Vector3D axes[6] = {
+        Vector3D(1, 0, 0), Vector3D(-1, 0, 0),
+        Vector3D(0, 1, 0), Vector3D(0, -1, 0),
+        Vector3D(0, 0, 1), Vector3D(0, 0, -1)
+    };
+
+    if (count == 1) {
+        for (unsigned int i = 0; i < 6 && count == 1; i++) {
+            findSupport(one, two, axes[i], vertices[1]);
+            if ((vertices[1].point - vertices[0].point).magnitude() > epsilon) {
+                count = 2;
+            }
+        }
+    }
+
+    if (count == 2) {
+        Vector3D line = vertices[1].point - vertices[0].point;
+        line.normalize();
+
+        // Directions at right angles to the segment
+        unsigned int smallest = 0;
+        for (unsigned int i = 1; i < 3; i++) {
+            if (realAbs(line[i]) < realAbs(line[smallest])) {
+                smallest = i;
+            }
+        }
+        Vector3D first = line % axes[2 * smallest];
+        first.normalize();
+        Vector3D second = line % first;
+        Vector3D directions[4] = { first, first * -1, second, second * -1 };
 
-    // First the direction is turned into local coordinates
-    Vector3D localDirection = 
-        shape.getTransformMatrix().inverseTransform(direction);
+        for (unsigned int i = 0; i < 4 && count == 2; i++) {
+            findSupport(one, two, directions[i], vertices[2]);
+            Vector3D offset = vertices[2].point - vertices[0].point;
+            if ((offset % line).magnitude() > epsilon) {
+                count = 3;
+            }
+        }
+    }
 
-    Vector3D furthestVertex = shape.localVertices[0];
-    real maxDot = furthestVertex.scalarProduct(localDirection);
+    if (count == 3) {
+        Vector3D normal = (vertices[1].point - vertices[0].point) %
+            (vertices[2].point - vertices[0].point);
+        normal.normalize();
+        Vector3D directions[2] = { normal, normal * -1 };
 
-    // Finding the farthest vertex in the given direction
-    for (size_t i = 1; i < shape.localVertices.size(); ++i) {
-        real dotProduct = shape.localVertices[i].scalarProduct(localDirection);
-        if (dotProduct > maxDot) {
-            maxDot = dotProduct;
-            furthestVertex = shape.localVertices[i];
+        for (unsigned int i = 0; i < 2 && count == 3; i++) {
+            findSupport(one, two, directions[i], vertices[3]);
+            Vector3D offset = vertices[3].point - vertices[0].point;
+            if (realAbs(offset * normal) > epsilon) {
+                count = 4;
+            }
         }
     }
 
-    // The furthest vertex is then turned into global coordinates
-    Vector3D globalFurthestVertex = 
-        shape.getTransformMatrix().transform(furthestVertex);
-    return  globalFurthestVertex;
+    return count == 4;
 }
 
 
-Vector3D pe::Support(
-    const pe::Polyhedron& shape1,
-    const pe::Polyhedron& shape2, 
-    const Vector3D& direction
+// Triangle of the polytope of EPA, with its normal facing outwards
+struct PolytopeFace {
+    unsigned int vertex[3];
+    Vector3D normal;
+
+    // Distance of the plane of the face from the origin
+    real distance;
+};
+
+
+/*
+    Makes the face of the given vertices, in that order, returning false
+    if it is too thin to have a normal.
+*/
+static bool makeFace(
+    const SimplexVertex* vertices,
+    unsigned int a,
+    unsigned int b,
+    unsigned int c,
+    PolytopeFace& face
 ) {
-    // Calculate support point in the given direction for both shapes
-    return support(shape1, direction) - support(shape2, -direction);
+    Vector3D normal = (vertices[b].point - vertices[a].point) %
+        (vertices[c].point - vertices[a].point);
+    real length = normal.magnitude();
+    if (length <= 0) {
+        return false;
+    }
+    normal *= 1 / length;
+
+    face.vertex[0] = a;
+    face.vertex[1] = b;
+    face.vertex[2] = c;
+    face.normal = normal;
+    face.distance = normal * vertices[a].point;
+    return true;
 }
 
 
-bool pe::GJK(
-    const pe::Polyhedron& p,
-    const pe::Polyhedron& q,
-    const Vector3D& initial_axis,
-    int upperLimit
+bool pe::epaPenetration(
+    const ConvexShape& one,
+    const ConvexShape& two,
+    const Simplex& simplex,
+    Vector3D& normal,
+    real& depth,
+    Vector3D& pointOne,
+    Vector3D& pointTwo
 ) {
-    Vector3D A = Support(p, q, initial_axis) - Support(q, p, -initial_axis);
-    Simplex s;
-    s.vertices = { A };
-    Vector3D D = -A;
-
-    int i = upperLimit;
-    while (i--) {
-        Vector3D new_point = Support(p, q, D) - Support(q, p, -D);
-        if (new_point.scalarProduct(D) < 0) {
-            // No intersection
+    SimplexVertex vertices[MAX_EPA_VERTICES];
+    unsigned int vertexCount = simplex.count;
+    for (unsigned int i = 0; i < vertexCount; i++) {
+        vertices[i] = simplex.vertices[i];
+    }
+
+    if (!completeTetrahedron(one, two, vertices, vertexCount)) {
+        return false;
+    }
+
+    // The faces of the tetrahedron, each facing away from the other vertex
+    static const unsigned int tetrahedron[4][4] = {
+        { 0, 1, 2, 3 }, { 0, 3, 1, 2 }, { 0, 2, 3, 1 }, { 1, 3, 2, 0 }
+    };
+
+    PolytopeFace faces[MAX_EPA_FACES];
+    unsigned int faceCount = 0;
+    for (unsigned int i = 0; i < 4; i++) {
+        unsigned int a = tetrahedron[i][0];
+        unsigned int b = tetrahedron[i][1];
+        unsigned int c = tetrahedron[i][2];
+        const Vector3D& opposite = vertices[tetrahedron[i][3]].point;
+
+        if (!makeFace(vertices, a, b, c, faces[faceCount])) {
             return false;
         }
+        if (faces[faceCount].normal * (opposite - vertices[a].point) > 0) {
+            makeFace(vertices, a, c, b, faces[faceCount]);
+        }
+        faceCount++;
+    }
+
+    unsigned int closest = 0;
+
+    for (unsigned int iteration = 0; iteration < MAX_EPA_ITERATIONS;
+        iteration++) {
+
+        closest = 0;
+        for (unsigned int i = 1; i < faceCount; i++) {
+            if (faces[i].distance < faces[closest].distance) {
+                closest = i;
+            }
+        }
+
+        // The face is on the surface of the difference when it can't grow
+        SimplexVertex& vertex = vertices[vertexCount];
+        findSupport(one, two, faces[closest].normal, vertex);
+        real supportDistance = faces[closest].normal * vertex.point;
+        if (supportDistance - faces[closest].distance <=
+            EPA_TOLERANCE * std::max((real)1, supportDistance)) {
+            break;
+        }
+        if (vertexCount + 1 == MAX_EPA_VERTICES) {
+            break;
+        }
 
-        s.vertices.push_back(new_point);
-        Simplex new_simplex;
-        Vector3D new_direction;
-        bool contains_origin;
-        std::tie(new_simplex, new_direction, contains_origin) = NearestSimplex(s);
+        /*
+            The faces the new vertex is in front of are removed, and the
+            edges that only belonged to one of them (the horizon) are
+            joined to the vertex by new faces, keeping the polytope
+            convex. Each edge is kept in the order of its removed face,
+            so the new faces face outwards as well.
+        */
+        unsigned int horizon[MAX_EPA_FACES][2];
+        unsigned int horizonCount = 0;
+        unsigned int kept = 0;
 
-        if (contains_origin) {
-            // Intersection found
-            return true; 
+        for (unsigned int i = 0; i < faceCount; i++) {
+            const PolytopeFace& face = faces[i];
+            if (face.normal * (vertex.point - vertices[face.vertex[0]].point)
+                <= 0) {
+                faces[kept++] = face;
+                continue;
+            }
+
+            for (unsigned int e = 0; e < 3; e++) {
+                unsigned int from = face.vertex[e];
+                unsigned int to = face.vertex[(e + 1) % 3];
+
+                // An edge shared with another removed face is not kept
+                bool shared = false;
+                for (unsigned int h = 0; h < horizonCount; h++) {
+                    if (horizon[h][0] == to && horizon[h][1] == from) {
+                        horizon[h][0] = horizon[horizonCount - 1][0];
+                        horizon[h][1] = horizon[horizonCount - 1][1];
+                        horizonCount--;
+                        shared = true;
+                        break;
+                    }
+                }
+                if (!shared && horizonCount < MAX_EPA_FACES) {
+                    horizon[horizonCount][0] = from;
+                    horizon[horizonCount][1] = to;
+                    horizonCount++;
+                }
+            }
+        }
+
+        if (kept + horizonCount > MAX_EPA_FACES) {
+            break;
+        }
+        faceCount = kept;
+        for (unsigned int h = 0; h < horizonCount; h++) {
+            if (makeFace(
+                vertices, horizon[h][0], horizon[h][1], vertexCount,
+                faces[faceCount]
+            )) {
+                faceCount++;
+            }
+        }
+        vertexCount++;
+
+        if (faceCount == 0) {
+            return false;
+        }
+    }
+
+    /*
+        The deepest points are found from the barycentric coordinates of
+        the point of the closest face nearest to the origin.
+    */
+    closest = 0;
+    for (unsigned int i = 1; i < faceCount; i++) {
+        if (faces[i].distance < faces[closest].distance) {
+            closest = i;
         }
+    }
+    const PolytopeFace& face = faces[closest];
+    const SimplexVertex& a = vertices[face.vertex[0]];
+    const SimplexVertex& b = vertices[face.vertex[1]];
+    const SimplexVertex& c = vertices[face.vertex[2]];
 
-        // Updating simplex and direction for next iteration
-        s = new_simplex;
-        D = new_direction;
+    Vector3D point = face.normal * face.distance;
+    Vector3D ab = b.point - a.point;
+    Vector3D ac = c.point - a.point;
+    Vector3D ap = point - a.point;
+    real abab = ab * ab;
+    real abac = ab * ac;
+    real acac = ac * ac;
+    real denominator = abab * acac - abac * abac;
+    real v = 0;
+    real w = 0;
+    if (denominator > 0) {
+        v = (acac * (ap * ab) - abac * (ap * ac)) / denominator;
+        w = (abab * (ap * ac) - abac * (ap * ab)) / denominator;
     }
+    real u = 1 - v - w;
+
+    normal = face.normal;
+    depth = std::max((real)0, face.distance);
+    pointOne = a.pointOne * u + b.pointOne * v + c.pointOne * w;
+    pointTwo = a.pointTwo * u + b.pointTwo * v + c.pointTwo * w;
+    return true;
+}
 
-    return false;
+
+bool pe::isSeparatingDirection(
+    const ConvexShape& one,
+    const ConvexShape& two,
+    const Vector3D& direction
+) {
+    /*
+        The point of the difference furthest along the direction is the
+        furthest point of the first shape along it, minus the closest
+        point of the second, so if even that point is behind the origin
+        by more than the radius, the shapes are apart along it.
+    */
+    SimplexVertex vertex;
+    findSupport(one, two, direction, vertex);
+    return vertex.point * direction <
+        -(one.radius + two.radius) * direction.magnitude();
 }
 
 
-bool pe::testIntersectionGJK(
-    const Polyhedron& p,
-    const Polyhedron& q,
-    int upperLimit
+unsigned int pe::convexAndConvex(
+    const ConvexShape& one,
+    const ConvexShape& two,
+    std::vector<Contact>& contacts,
+    SimplexCache* cache
 ) {
-    Vector3D pToQ(q.getCentre() - p.getCentre());
-    return GJK(p, q, pToQ, upperLimit);
+    real radius = one.radius + two.radius;
+
+    if (cache && cache->separatingDirection.magnitudeSquared() > 0) {
+        // The walks start from the simplex, as the query would
+        if (cache->count > 0) {
+            one.supportHint = cache->indexOne[0];
+            two.supportHint = cache->indexTwo[0];
+        }
+        if (isSeparatingDirection(one, two, cache->separatingDirection)) {
+            return 0;
+        }
+    }
+
+    Simplex simplex;
+    Vector3D pointOne, pointTwo;
+    real distance = gjkDistance(
+        one, two, simplex, pointOne, pointTwo, cache
+    );
+
+    if (cache) {
+        cache->separatingDirection = distance > radius ?
+            pointTwo - pointOne : Vector3D();
+    }
+    if (distance > radius) {
+        return 0;
+    }
+
+    Contact contact;
+
+    if (distance > OVERLAP_DISTANCE) {
+        /*
+            Only the rounded parts overlap, so the contact is between the
+            closest points, moved to the surfaces by their radius.
+        */
+        Vector3D normal = (pointOne - pointTwo) * (1 / distance);
+        contact.contactNormal = normal;
+        contact.penetration = radius - distance;
+        contact.contactPoint = (pointOne - normal * one.radius +
+            pointTwo + normal * two.radius) * 0.5;
+    }
+    else {
+        Vector3D normal;
+        real depth;
+        if (!epaPenetration(
+            one, two, simplex, normal, depth, pointOne, pointTwo
+        )) {
+            return 0;
+        }
+
+        // The first shape is moved against the normal of the difference
+        contact.contactNormal = normal * -1;
+        contact.penetration = depth + radius;
+        contact.contactPoint = (pointOne + normal * one.radius +
+            pointTwo - normal * two.radius) * 0.5;
+    }
+
+    contact.body[0] = one.body;
+    contact.body[1] = two.body;
+    contacts.push_back(contact);
+    return 1;
 }
 
-#endif
\ No newline at end of file
+
+real pe::findTimeOfImpact(
+    const ConvexShape& one,
+    const Vector3D& motionOne,
+    const ConvexShape& two,
+    const Vector3D& motionTwo,
+    real tolerance
+) {
+    real radius = one.radius + two.radius;
+    Vector3D startOne = one.transformMatrix.getTranslation();
+    Vector3D startTwo = two.transformMatrix.getTranslation();
+
+    // Motion of the second shape as seen from the first
+    Vector3D motion = motionTwo - motionOne;
+
+    ConvexShape movedOne = one;
+    ConvexShape movedTwo = two;
+
+    // Each query starts from the simplex of the last one
+    SimplexCache cache;
+    Simplex simplex;
+    Vector3D pointOne, pointTwo;
+
+    real time = 0;
+    real approach = 0;
+    for (unsigned int iteration = 0;
+        iteration < MAX_ADVANCEMENT_ITERATIONS; iteration++) {
+
+        movedOne.transformMatrix.setTranslation(startOne + motionOne * time);
+        movedTwo.transformMatrix.setTranslation(startTwo + motionTwo * time);
+        real distance = gjkDistance(
+            movedOne, movedTwo, simplex, pointOne, pointTwo, &cache
+        );
+
+        /*
+            Flat faces are reached exactly in one advancement, so the
+            shapes can end up touching, and are then moved on with the
+            last speed at which they approached.
+        */
+        real gap = distance - radius;
+        if (distance <= OVERLAP_DISTANCE || gap <= 0) {
+            return time > 0 ?
+                std::min((real)1, time + tolerance / approach) : 1;
+        }
+
+        /*
+            Both shapes are convex and only translate, so their distance
+            can't shrink faster than the speed at which they approach
+            along the direction between their closest points.
+        */
+        Vector3D direction = (pointTwo - pointOne) * (1 / distance);
+        approach = -(motion * direction);
+        if (approach <= 0) {
+            return 1;
+        }
+
+        if (gap <= tolerance) {
+            return std::min((real)1, time + (gap + tolerance) / approach);
+        }
+        time += gap / approach;
+        if (time >= 1) {
+            return 1;
+        }
+    }
+    return time;
+}
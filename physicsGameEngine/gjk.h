@@ -1,51 +1,256 @@
+/*
+    Header file for the GJK (Gilbert-Johnson-Keerthi) distance query and
+    the EPA (Expanding Polytope Algorithm) penetration query, which
+    generate the contacts of any two convex shapes, as long as each can
+    give its support point (its point furthest along a direction).
 
-#ifdef DONE_REFACTOR
+    Two shapes overlap if and only if their Minkowski difference (the set
+    of all the differences between a point of one and a point of the
+    other) contains the origin, and their distance is the distance from
+    the origin to that set. GJK finds that distance by building a simplex
+    (a point, segment, triangle or tetrahedron) of support points of the
+    difference, each time keeping the part of the simplex closest to the
+    origin and adding the support point in the direction of the origin,
+    until the simplex stops getting closer, or contains the origin.
+    In that second case, EPA grows the tetrahedron into a polytope by
+    adding the support point in the direction of its face closest to the
+    origin, until that face is on the surface of the difference, giving
+    the normal and depth of the penetration.
 
-#include <vector>
-#include "contact.h"
-#include "polyhedron.h"
+    The shapes are the convex hulls of sets of points, optionally rounded
+    by a radius: a mesh is its vertices, a box its eight corners, a
+    sphere a single point with a radius, and a capsule the two ends of
+    its segment with its radius. The rounded shapes only need GJK
+    as long as the points themselves don't overlap, which makes spheres
+    exact, and resting contacts cheaper as they rarely reach EPA.
+
+    The bodies barely move from one step to the next, so the simplex of
+    the last query of a pair (the indices of the vertices of each shape
+    its points were made of) is kept in a cache, and the next query
+    starts from it, finishing in one or two iterations instead of
+    building a new simplex from a single point.
+    For the same reason, the support point of a convex mesh with many
+    vertices is found by walking from the last support point of the
+    shape (starting with those of the cached simplex) over the adjacent
+    vertices of the mesh, always to the furthest neighbour, until none
+    is further along the direction. This visits a few vertices instead
+    of all of them.
+    The same distance query gives the time of impact of two shapes moving
+    without rotating, by conservative advancement: the shapes can't touch
+    before they have closed their distance at the speed they approach
+    each other along the direction between their closest points, so
+    they can safely be moved by that time, and the query repeated, until
+    they touch or the motion ends. This is used for the bodies that move
+    far enough in one step to pass through others.
+*/
+
+#ifndef GJK_H
+#define GJK_H
+
+#include "fineCollisionDetection.h"
+#include "boundingConvexHull.h"
 
 namespace pe {
 
+    /*
+        A convex shape as seen by GJK and EPA: the convex hull of some
+        points in local coordinates, moved by a transform and rounded by
+        a radius.
+    */
+    struct ConvexShape {
+
+        /*
+            Vertices of the hull in local coordinates, or null for a
+            box, whose corners are found from its half size instead
+            (the index of a corner holds the signs of its coordinates).
+        */
+        const Vector3D* vertices;
+        unsigned int vertexCount;
+        Vector3D halfSize;
+
+        real radius;
+
+        /*
+            Vertices adjacent to each vertex, in the layout of the mesh
+            (see Mesh), or null when the support point is found by
+            checking every vertex (for small or non convex meshes).
+        */
+        const int* adjacencyOffsets;
+        const int* adjacentVertices;
+
+        /*
+            Vertex the next walk starts from, which is the last support
+            point found, so it is updated by the const queries.
+        */
+        mutable unsigned int supportHint;
+
+        Matrix3x4 transformMatrix;
+        RigidBody* body;
+
+        // A hull made of the vertices of the mesh of the bounding volume
+        ConvexShape(
+            const BoundingConvexHull* hull,
+            const Matrix3x4& boundingVolumeTransform,
+            RigidBody* body
+        );
+
+        // The two ends of the segment of the capsule, with its radius
+        ConvexShape(
+            const BoundingCapsule* capsule,
+            const Matrix3x4& boundingVolumeTransform,
+            RigidBody* body
+        );
+
+        ConvexShape(const Box& box);
+
+        // A single point (the centre) with the radius of the ball
+        ConvexShape(const Ball& ball);
+
+        /*
+            The shape of the bounding volume of the object, which can be a
+            box, sphere, capsule or convex hull.
+        */
+        ConvexShape(RigidObject& object);
+
+        /*
+            Index of the vertex furthest along a direction in local
+            coordinates, walking from the support hint if the shape has
+            adjacency, and then making it the new hint.
+        */
+        unsigned int getSupportIndex(const Vector3D& localDirection) const;
+
+        // Vertex of the given index in local coordinates
+        Vector3D getLocalVertex(unsigned int index) const;
+    };
+
+
+    // Point of the simplex, along with the points it is the difference of
+    struct SimplexVertex {
+
+        // Point of each shape, in world coordinates
+        Vector3D pointOne;
+        Vector3D pointTwo;
+
+        // Their difference
+        Vector3D point;
+
+        // Index of the vertex of each shape the points are made from
+        unsigned int indexOne;
+        unsigned int indexTwo;
+
+        /*
+            Barycentric coordinate of the point closest to the origin
+            along this vertex.
+        */
+        real weight;
+    };
+
+
     struct Simplex {
-        std::vector<Vector3D> vertices;
+        SimplexVertex vertices[4];
+        unsigned int count;
     };
 
 
     /*
-        Function to find the nearest simplex to the origin and the
-        direction towards the origin normal to the simplex.
+        What is kept of the simplex of a pair between steps: the indices
+        of the vertices its points were made of. The points themselves
+        are found again from the new transforms of the shapes.
+        Most pairs the broad phase finds are separated, and stay
+        separated along the same direction for many steps, so the cache
+        also keeps the direction (from the first shape to the second)
+        that separated the pair in the last step, or zero if they
+        weren't.
     */
-    std::tuple<Simplex, Vector3D, bool> NearestSimplex(const Simplex& s);
+    struct SimplexCache {
+        unsigned int count = 0;
+        unsigned int indexOne[4];
+        unsigned int indexTwo[4];
+        Vector3D separatingDirection;
+    };
 
 
-    Vector3D support(
-        const pe::Polyhedron& shape,
-        const Vector3D& direction
+    /*
+        Finds the distance between the two shapes, without their radius
+        (0 if they overlap), along with the closest point of each. The
+        simplex is left as it was when the query ended, so that it can be
+        given to EPA if the shapes overlap. If a cache is given, the
+        query starts from the simplex it holds (as long as its indices
+        are valid for the two shapes) and it is then replaced by the
+        new simplex.
+    */
+    real gjkDistance(
+        const ConvexShape& one,
+        const ConvexShape& two,
+        Simplex& simplex,
+        Vector3D& pointOne,
+        Vector3D& pointTwo,
+        SimplexCache* cache = nullptr
     );
 
 
-    Vector3D Support(
-        const pe::Polyhedron& shape1,
-        const pe::Polyhedron& shape2,
-        const Vector3D& direction
+    /*
+        Given the simplex of a GJK query that found the shapes (without
+        their radius) overlapping, finds the direction and depth of the
+        penetration of the two, where moving the first shape by the
+        depth against the normal separates them, and the deepest point
+        of each. Returns false if the penetration can't be found (when
+        the shapes barely touch and the simplex can't be grown).
+    */
+    bool epaPenetration(
+        const ConvexShape& one,
+        const ConvexShape& two,
+        const Simplex& simplex,
+        Vector3D& normal,
+        real& depth,
+        Vector3D& pointOne,
+        Vector3D& pointTwo
     );
 
 
-    bool GJK(
-        const pe::Polyhedron& p,
-        const pe::Polyhedron& q,
-        const Vector3D& initial_axis,
-        int upperLimit
+    /*
+        Checks whether the given direction (from the first shape to the
+        second) separates the two shapes with their radius, which only
+        takes the support point of the difference along it.
+    */
+    bool isSeparatingDirection(
+        const ConvexShape& one,
+        const ConvexShape& two,
+        const Vector3D& direction
     );
 
 
-    bool testIntersectionGJK(
-        const Polyhedron& p,
-        const Polyhedron& q,
-        int upperLimit
+    /*
+        Generates the contact of two convex shapes, if they overlap, with
+        the normal pointing towards the first, as for the other contact
+        generation functions. Returns the number of contacts generated.
+        If a cache is given, its separating direction is checked first,
+        and the query is skipped if it still separates the shapes.
+    */
+    unsigned int convexAndConvex(
+        const ConvexShape& one,
+        const ConvexShape& two,
+        std::vector<Contact>& contacts,
+        SimplexCache* cache = nullptr
     );
 
+
+    /*
+        Finds the fraction (between 0 and 1) of the given translations of
+        the two shapes (from their current transforms) at which they
+        first come within the tolerance of each other, and then moves it
+        on by the time it takes them to close that distance and
+        penetrate by the tolerance, so that the contact is generated
+        there. Returns 1 if they don't touch during the motion, or if
+        they already overlap (their contact is then already generated).
+    */
+    real findTimeOfImpact(
+        const ConvexShape& one,
+        const Vector3D& motionOne,
+        const ConvexShape& two,
+        const Vector3D& motionTwo,
+        real tolerance
+    );
 }
 
-#endif
\ No newline at end of file
+#endif
@@ -2,7 +2,7 @@
 #ifndef GLFW_WINDOW_WRAPPER_H
 #define GLFW_WINDOW_WRAPPER_H
 
-#include <GL/glew.h>
+#include "graphicsLibraries.h"
 #include <GLFW/glfw3.h>
 #include "accuracy.h"
 
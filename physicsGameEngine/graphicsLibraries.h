@@ -0,0 +1,28 @@
+/*
+	Header file that includes the graphics libraries in one place.
+	Only the rendering module (shaders, cameras, windows, renderers)
+	should include it; the physics core must build without it.
+*/
+
+#ifndef GRAPHICS_LIBRARIES_H
+#define GRAPHICS_LIBRARIES_H
+
+// For GLEW static version (no dlls) and stb library
+// Note that they also need to be included in the preprocessor definitions
+// (We can also define these in the makefile)
+#ifndef GLEW_STATIC
+#define GLEW_STATIC
+#endif
+#ifndef _CRT_SECURE_NO_WARNINGS
+#define _CRT_SECURE_NO_WARNINGS
+#endif
+
+// Can't have both Glew and Glad
+// Glew has to be included first
+#include <GL/glew.h>
+#include <GL/gl.h>
+
+#include <glm.hpp>
+#include <gtc/matrix_transform.hpp>
+
+#endif
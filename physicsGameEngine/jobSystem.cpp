@@ -0,0 +1,135 @@
+// Source file for the job system
+
+#include "jobSystem.h"
+#include <cassert>
+
+using namespace pe;
+
+
+JobSystem::JobSystem(unsigned int threadCount) :
+	task{ nullptr }, remainingJobs{ 0 }, batch{ 0 }, stopping{ false } {
+
+	assert(threadCount > 0 && "There must be at least one thread");
+
+	for (unsigned int i = 0; i < threadCount; i++) {
+		queues.push_back(std::make_unique<Queue>());
+	}
+
+	// The calling thread is the first one, so it isn't started
+	for (unsigned int i = 1; i < threadCount; i++) {
+		threads.emplace_back(&JobSystem::work, this, i);
+	}
+}
+
+
+JobSystem::~JobSystem() {
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	batchStarted.notify_all();
+	for (std::thread& thread : threads) {
+		thread.join();
+	}
+}
+
+
+bool JobSystem::takeJob(unsigned int thread, unsigned int& job) {
+
+	// The thread's own jobs are taken from the front (largest first)
+	{
+		Queue& queue = *queues[thread];
+		std::lock_guard<std::mutex> lock(queue.mutex);
+		if (!queue.jobs.empty()) {
+			job = queue.jobs.front();
+			queue.jobs.pop_front();
+			return true;
+		}
+	}
+
+	// And those of the others from the back, starting with the next one
+	for (unsigned int i = 1; i < queues.size(); i++) {
+		Queue& queue = *queues[(thread + i) % queues.size()];
+		std::lock_guard<std::mutex> lock(queue.mutex);
+		if (!queue.jobs.empty()) {
+			job = queue.jobs.back();
+			queue.jobs.pop_back();
+			return true;
+		}
+	}
+
+	return false;
+}
+
+
+void JobSystem::runJobs(unsigned int thread) {
+	unsigned int job;
+	while (takeJob(thread, job)) {
+		/*
+			The task is read after the job is taken, as the jobs of a
+			batch are only queued once its task is set.
+		*/
+		(*task)(job, thread);
+
+		if (remainingJobs.fetch_sub(1) == 1) {
+			std::lock_guard<std::mutex> lock(mutex);
+			batchFinished.notify_one();
+		}
+	}
+}
+
+
+void JobSystem::work(unsigned int thread) {
+	unsigned int lastBatch = 0;
+	while (true) {
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			batchStarted.wait(lock, [this, lastBatch]() {
+				return stopping || batch != lastBatch;
+			});
+			if (stopping) {
+				return;
+			}
+			lastBatch = batch;
+		}
+		runJobs(thread);
+	}
+}
+
+
+void JobSystem::run(unsigned int jobCount, const Task& task) {
+	if (jobCount == 0) {
+		return;
+	}
+
+	// Without other threads, there is no need to queue anything
+	if (threads.empty()) {
+		for (unsigned int job = 0; job < jobCount; job++) {
+			task(job, 0);
+		}
+		return;
+	}
+
+	this->task = &task;
+	remainingJobs = jobCount;
+
+	// The jobs are dealt to the threads in turn, in the given order
+	for (unsigned int job = 0; job < jobCount; job++) {
+		Queue& queue = *queues[job % queues.size()];
+		std::lock_guard<std::mutex> lock(queue.mutex);
+		queue.jobs.push_back(job);
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		batch++;
+	}
+	batchStarted.notify_all();
+
+	runJobs(0);
+
+	std::unique_lock<std::mutex> lock(mutex);
+	batchFinished.wait(lock, [this]() {
+		return remainingJobs == 0;
+	});
+}
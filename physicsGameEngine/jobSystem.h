@@ -0,0 +1,104 @@
+/*
+	Header file for the job system, a pool of threads that runs a batch of
+	independent jobs (like the islands of a step) and returns once they
+	are all done.
+	Each thread has its own queue of jobs. The jobs of a batch are dealt
+	to the queues in turn, in the order they are given (so the largest
+	jobs should come first), and each thread takes the jobs from the
+	front of its own queue. A thread whose queue is empty steals from
+	the back of the queue of another thread (where the smallest jobs
+	are), so the threads stay busy until the very end of the batch even
+	when the jobs have very different sizes.
+	The thread calling run works on the batch as the first thread of the
+	pool. Which thread runs a job is given to it, so that it can use
+	scratch memory of its own, but it can't change the results as long
+	as the jobs are independent, which keeps them the same for any
+	number of threads.
+	The queues are locked with a mutex each, which is cheap next to jobs
+	the size of an island.
+*/
+
+#ifndef JOB_SYSTEM_H
+#define JOB_SYSTEM_H
+
+#include <vector>
+#include <deque>
+#include <memory>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+
+namespace pe {
+
+	class JobSystem {
+
+	public:
+
+		// Runs the job of the given index on the thread of the given index
+		typedef std::function<void(unsigned int job, unsigned int thread)>
+			Task;
+
+	private:
+
+		struct Queue {
+			std::deque<unsigned int> jobs;
+			std::mutex mutex;
+		};
+
+		// Queue of each thread, including the calling one (the first)
+		std::vector<std::unique_ptr<Queue>> queues;
+
+		std::vector<std::thread> threads;
+
+		// Task of the current batch, and the number of its jobs left
+		const Task* task;
+		std::atomic<unsigned int> remainingJobs;
+
+		/*
+			The threads wait for the batch count to change to start
+			working, and the calling thread for the jobs to run out.
+		*/
+		std::mutex mutex;
+		std::condition_variable batchStarted;
+		std::condition_variable batchFinished;
+		unsigned int batch;
+		bool stopping;
+
+
+		// Loop of the threads of the pool
+		void work(unsigned int thread);
+
+		/*
+			Takes a job from the queue of the given thread, or steals one
+			from another thread. Returns false if there are none left.
+		*/
+		bool takeJob(unsigned int thread, unsigned int& job);
+
+		// Runs jobs on the given thread until there are none left
+		void runJobs(unsigned int thread);
+
+	public:
+
+		// Takes the number of threads, including the calling one
+		JobSystem(unsigned int threadCount);
+
+		~JobSystem();
+
+		JobSystem(const JobSystem&) = delete;
+		JobSystem& operator=(const JobSystem&) = delete;
+
+		unsigned int getThreadCount() const {
+			return queues.size();
+		}
+
+		/*
+			Runs the given number of jobs with the task, largest first,
+			and returns when all of them are done.
+		*/
+		void run(unsigned int jobCount, const Task& task);
+	};
+}
+
+#endif
@@ -150,7 +150,7 @@ namespace pe {
 					* coefficient;
 				inverse.data[3] = -(data[3] * data[8] - data[5] * data[6])
 					* coefficient;
-				inverse.data[4] = (data[0] * data[8] - data[0] * data[4])
+				inverse.data[4] = (data[0] * data[8] - data[2] * data[6])
 					* coefficient;
 				inverse.data[5] = -(data[0] * data[5] - data[2] * data[3])
 					* coefficient;
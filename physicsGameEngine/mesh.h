@@ -7,6 +7,7 @@
 #include "edge.h"
 #include <numeric>
 #include <unordered_set>
+#include <algorithm>
 #include "util.h"
 
 namespace pe {
@@ -37,6 +38,103 @@ namespace pe {
 		*/
 		int faceVertexCount;
 
+		/*
+			Vertices adjacent to each vertex (those it shares an edge of a
+			face with), used to walk over the surface of the mesh, for
+			instance to find the vertex furthest along a direction by
+			moving to a further neighbour until there are none (which is
+			only correct for convex meshes).
+			The neighbours of vertex i are adjacentVertices[
+			adjacencyOffsets[i]] up to adjacentVertices[adjacencyOffsets[
+			i + 1]] (excluded), all in the same vector so that it stays in
+			one block of memory.
+			Vertices at the same position (as meshes often repeat
+			vertices along seams) share their neighbours, so that the
+			surface isn't cut along those seams.
+			The topology of a mesh never changes, so this is built once,
+			but only by the meshes that are walked (those of convex
+			hulls), when their hull is made (see buildAdjacency).
+		*/
+		mutable std::vector<int> adjacencyOffsets;
+		mutable std::vector<int> adjacentVertices;
+
+
+		void calculateAdjacency() const {
+			/*
+				Groups the vertices closer than a small fraction of the size
+				of the mesh (the vertices of a seam are usually calculated
+				separately, so they aren't exactly equal), each represented
+				by one of them. Sorting them along x means only the next
+				few vertices can be close to each one.
+			*/
+			real size = 0;
+			for (const Vector3D& vertex : vertices) {
+				size = std::max(size, vertex.magnitude());
+			}
+			real tolerance = size * (real)1e-5;
+
+			std::vector<int> order(vertices.size());
+			std::iota(order.begin(), order.end(), 0);
+			std::sort(order.begin(), order.end(), [this](int a, int b) {
+				return vertices[a].x < vertices[b].x;
+			});
+
+			std::vector<int> representative(vertices.size(), -1);
+			for (size_t i = 0; i < order.size(); i++) {
+				if (representative[order[i]] != -1) {
+					continue;
+				}
+				representative[order[i]] = order[i];
+				const Vector3D& vertex = vertices[order[i]];
+				for (size_t j = i + 1; j < order.size() &&
+					vertices[order[j]].x - vertex.x <= tolerance; j++) {
+					if (representative[order[j]] == -1 &&
+						(vertices[order[j]] - vertex).magnitudeSquared() <=
+						tolerance * tolerance) {
+						representative[order[j]] = order[i];
+					}
+				}
+			}
+
+			// Each edge of each face, in both directions, without repeats
+			std::vector<std::pair<int, int>> links;
+			for (const Face& face : faces) {
+				int count = face.getVertexCount();
+				for (int i = 0; i < count; i++) {
+					int a = representative[face.getIndex(i)];
+					int b = representative[face.getIndex((i + 1) % count)];
+					if (a != b) {
+						links.push_back(std::make_pair(a, b));
+						links.push_back(std::make_pair(b, a));
+					}
+				}
+			}
+			std::sort(links.begin(), links.end());
+			links.erase(std::unique(links.begin(), links.end()), links.end());
+
+			// Range of the links of each representative
+			std::vector<int> linkOffsets(vertices.size() + 1, 0);
+			for (const std::pair<int, int>& link : links) {
+				linkOffsets[link.first + 1]++;
+			}
+			for (size_t i = 0; i < vertices.size(); i++) {
+				linkOffsets[i + 1] += linkOffsets[i];
+			}
+
+			// Each vertex gets the neighbours of its representative
+			adjacencyOffsets.resize(vertices.size() + 1);
+			adjacencyOffsets[0] = 0;
+			adjacentVertices.clear();
+			for (size_t i = 0; i < vertices.size(); i++) {
+				int group = representative[i];
+				for (int j = linkOffsets[group]; j < linkOffsets[group + 1];
+					j++) {
+					adjacentVertices.push_back(links[j].second);
+				}
+				adjacencyOffsets[i + 1] = adjacentVertices.size();
+			}
+		}
+
 	public:
 
 		Mesh(
@@ -137,6 +235,37 @@ namespace pe {
 			return faceVertexCount;
 		}
 
+		/*
+			Builds the vertices adjacent to each vertex if they haven't
+			been built yet. Only the meshes that are walked need them, so
+			they are built by whoever walks them (the convex hull, when it
+			is made), before any of the getters below are used. This isn't
+			safe to call from several threads at once, so it isn't built
+			during a step.
+		*/
+		void buildAdjacency() const {
+			if (adjacencyOffsets.empty()) {
+				calculateAdjacency();
+			}
+		}
+
+		// Offsets of the neighbours of each vertex, one more than vertices
+		const std::vector<int>& getAdjacencyOffsets() const {
+			return adjacencyOffsets;
+		}
+
+		const std::vector<int>& getAdjacentVertices() const {
+			return adjacentVertices;
+		}
+
+		int getAdjacentVertexCount(int index) const {
+			return adjacencyOffsets[index + 1] - adjacencyOffsets[index];
+		}
+
+		int getAdjacentVertex(int index, int neighbour) const {
+			return adjacentVertices[adjacencyOffsets[index] + neighbour];
+		}
+
 		void setFaceTextureCoordinates(
 			int index, 
 			const std::vector<Vector2D>& uv
@@ -0,0 +1,262 @@
+/*
+	Benchmark of the narrow phase on random pairs of objects whose
+	bounding spheres overlap, like the pairs the broad phase gives it,
+	with a part of them actually touching. The objects spin a little each
+	step (without moving), so that the pairs change from one step to the
+	next, but slowly, as in a simulation.
+		For pairs of boxes, the scalar boxAndBox, which tests the
+		separating axes one at a time, is compared with the batch routine
+		of the dispatch table at each instruction set the processor
+		supports.
+		For pairs of convex hulls, GJK is measured with and without the
+		cache, which starts each query from the last simplex of the pair,
+		and skips it if the last separating direction still holds.
+*/
+
+#include "benchmarks.h"
+#include "simdContactKernels.h"
+#include "gjk.h"
+#include "orientedBoundingBox.h"
+#include "boundingConvexHull.h"
+#include "cuboid.h"
+#include "sphere.h"
+#include <chrono>
+#include <random>
+#include <deque>
+#include <functional>
+#include <iostream>
+#include <iomanip>
+
+using namespace pe;
+
+
+namespace {
+
+	const int MEASURED_STEPS = 20;
+
+	const real STEP = 1.0 / 60.0;
+
+
+	/*
+		Pairs of objects, where the second object of each pair is placed
+		randomly within the bounding sphere of the first, both with a
+		bounding volume made by the given function.
+	*/
+	template <typename Volume>
+	struct ObjectPairs {
+		std::vector<RigidObject*> objects;
+		std::deque<Volume> boundingVolumes;
+		std::vector<PotentialContact> pairs;
+
+		ObjectPairs(
+			Mesh* mesh,
+			int pairCount,
+			const std::function<Volume (std::mt19937&)>& create
+		) {
+			std::mt19937 generator(1);
+			std::uniform_real_distribution<real> unit(-1, 1);
+			std::uniform_real_distribution<real> spin(-2, 2);
+
+			for (int i = 0; i < pairCount * 2; i++) {
+				boundingVolumes.push_back(create(generator));
+				Volume* boundingVolume = &boundingVolumes.back();
+
+				// The pairs are far apart from each other
+				Vector3D position(i * 500, 0, 0);
+				if (i % 2 == 1) {
+					Vector3D offset;
+					do {
+						offset = Vector3D(
+							unit(generator), unit(generator), unit(generator)
+						);
+					} while (offset.magnitudeSquared() > 1);
+					real reach = boundingVolume->getBVHSphereRadius() +
+						boundingVolumes[i - 1].getBVHSphereRadius();
+					position = objects.back()->body.position + offset * reach;
+				}
+
+				Quaternion orientation(
+					unit(generator), unit(generator),
+					unit(generator), unit(generator)
+				);
+				orientation.normalize();
+
+				RigidObject* object = new RigidObject(
+					mesh, boundingVolume, position, orientation, 1
+				);
+				object->body.angularVelocity = Vector3D(
+					spin(generator), spin(generator), spin(generator)
+				);
+				objects.push_back(object);
+
+				if (i % 2 == 1) {
+					pairs.push_back(PotentialContact{
+						{ objects[i - 1], objects[i] }
+					});
+				}
+			}
+		}
+
+		~ObjectPairs() {
+			for (RigidObject* object : objects) {
+				delete object;
+			}
+		}
+
+		void step() {
+			for (RigidObject* object : objects) {
+				object->body.orientation.addScaledVector(
+					object->body.angularVelocity, STEP
+				);
+				object->body.orientation.normalize();
+				object->update();
+			}
+		}
+	};
+
+
+	/*
+		Runs the given narrow phase on new pairs each step, and prints the
+		time it took on average, with the number of contacts it found.
+	*/
+	template <typename Volume>
+	void measure(
+		const std::string& name,
+		const std::function<ObjectPairs<Volume>* ()>& create,
+		const std::function<
+			void(ObjectPairs<Volume>&, std::vector<Contact>&)
+		>& narrowPhase
+	) {
+		ObjectPairs<Volume>* objectPairs = create();
+		std::vector<Contact> contacts;
+
+		double milliseconds = 0;
+		double contactCount = 0;
+		for (int step = 0; step < MEASURED_STEPS; step++) {
+			objectPairs->step();
+			contacts.clear();
+
+			auto start = std::chrono::steady_clock::now();
+			narrowPhase(*objectPairs, contacts);
+			auto end = std::chrono::steady_clock::now();
+
+			milliseconds += std::chrono::duration<double, std::milli>(
+				end - start
+			).count();
+			contactCount += contacts.size();
+		}
+		delete objectPairs;
+
+		std::cout << "    " << std::left << std::setw(30) << name + ":"
+			<< std::right << std::fixed << std::setprecision(3)
+			<< milliseconds / MEASURED_STEPS << " ms per step, "
+			<< std::setprecision(0) << contactCount / MEASURED_STEPS
+			<< " contacts\n";
+	}
+
+
+	// Runs the batch routine of the two types on all the pairs
+	template <typename Volume>
+	void runBatch(
+		BoundingVolume::TYPE one,
+		BoundingVolume::TYPE two,
+		ObjectPairs<Volume>& objectPairs,
+		std::vector<Contact>& contacts,
+		PairCache<SimplexCache>* simplexCaches
+	) {
+		getContactBatchRoutine(one, two)(
+			objectPairs.pairs.data(), objectPairs.pairs.size(),
+			contacts, simplexCaches
+		);
+		if (simplexCaches) {
+			simplexCaches->endStep();
+		}
+	}
+
+
+	void benchmarkBoxes(Mesh* mesh, int pairCount) {
+
+		typedef ObjectPairs<OrientedBoundingBox> BoxPairs;
+		std::function<BoxPairs* ()> create = [mesh, pairCount]() {
+			return new BoxPairs(mesh, pairCount, [](std::mt19937& generator) {
+				std::uniform_real_distribution<real> size(5, 30);
+				return OrientedBoundingBox(Vector3D(
+					size(generator), size(generator), size(generator)
+				));
+			});
+		};
+		const BoundingVolume::TYPE box = BoundingVolume::TYPE::BOX;
+
+		std::cout << "Box and box, " << pairCount << " pairs\n";
+
+		measure<OrientedBoundingBox>("one axis at a time", create,
+			[](BoxPairs& boxPairs, std::vector<Contact>& contacts) {
+				for (const PotentialContact& pair : boxPairs.pairs) {
+					boxAndBox(
+						Box(*pair.object[0]), Box(*pair.object[1]), contacts
+					);
+				}
+			}
+		);
+
+		const char* levelNames[] = { "scalar", "SSE", "AVX" };
+		for (unsigned int level = 0;
+			level <= (unsigned int)getSupportedSimdLevel(); level++) {
+			setSimdLevel((SIMD_LEVEL)level);
+			measure<OrientedBoundingBox>(
+				std::string("all axes, ") + levelNames[level], create,
+				[box](BoxPairs& boxPairs, std::vector<Contact>& contacts) {
+					runBatch(box, box, boxPairs, contacts, nullptr);
+				}
+			);
+		}
+	}
+
+
+	void benchmarkConvexHulls(Mesh* mesh, int pairCount) {
+
+		typedef ObjectPairs<BoundingConvexHull> HullPairs;
+		std::function<HullPairs* ()> create = [mesh, pairCount]() {
+			return new HullPairs(mesh, pairCount, [mesh](std::mt19937&) {
+				return BoundingConvexHull(mesh);
+			});
+		};
+		const BoundingVolume::TYPE hull = BoundingVolume::TYPE::CONVEX_HULL;
+
+		std::cout << "Convex hull and convex hull, " << pairCount
+			<< " pairs\n";
+
+		measure<BoundingConvexHull>("without cache", create,
+			[hull](HullPairs& hullPairs, std::vector<Contact>& contacts) {
+				runBatch(hull, hull, hullPairs, contacts, nullptr);
+			}
+		);
+
+		PairCache<SimplexCache> simplexCaches;
+		measure<BoundingConvexHull>("with cache", create,
+			[hull, &simplexCaches](
+				HullPairs& hullPairs,
+				std::vector<Contact>& contacts
+			) {
+				runBatch(hull, hull, hullPairs, contacts, &simplexCaches);
+			}
+		);
+	}
+}
+
+
+void pe::runNarrowPhaseBenchmark() {
+
+	// Shared by all the boxes, as only their bounding volumes matter
+	Cuboid box(1, 1, 1);
+
+	for (int pairCount : { 2000, 100000 }) {
+		benchmarkBoxes(&box, pairCount);
+	}
+	setSimdLevel(getSupportedSimdLevel());
+
+	// The hulls are all made from this mesh
+	Sphere sphere(10, 16, 16);
+
+	benchmarkConvexHulls(&sphere, 2000);
+}
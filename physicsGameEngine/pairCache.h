@@ -0,0 +1,128 @@
+/*
+	Header file for the pair cache, which keeps some data for each pair of
+	bodies from one step to the next, like the contacts of the pair or the
+	simplex of its last distance query, so that the narrow phase can start
+	from the result of the previous step (the bodies barely move between
+	two steps).
+	The data of a pair is created the first time it is asked for, and
+	dropped at the end of the first step in which it isn't, so the cache
+	only holds the pairs that are still close. The entries of the pairs
+	that stay are reused, so that the cache doesn't allocate memory each
+	step once the pairs are found.
+	The pairs are ordered: (A, B) and (B, A) are different entries, so
+	the caller decides whether the order of the bodies matters.
+*/
+
+#ifndef PAIR_CACHE_H
+#define PAIR_CACHE_H
+
+#include "rigidBody.h"
+#include <unordered_map>
+
+namespace pe {
+
+	template <typename T>
+	class PairCache {
+
+	private:
+
+		struct BodyPair {
+
+			const RigidBody* one;
+			const RigidBody* two;
+
+			bool operator==(const BodyPair& pair) const {
+				return one == pair.one && two == pair.two;
+			}
+		};
+
+		struct BodyPairHash {
+			size_t operator()(const BodyPair& pair) const {
+				size_t h1 = std::hash<const RigidBody*>()(pair.one);
+				size_t h2 = std::hash<const RigidBody*>()(pair.two);
+				return h1 ^ (h2 + 0x9e3779b9 + (h1 << 6) + (h1 >> 2));
+			}
+		};
+
+		// Data of a pair, and the last step it was asked for in
+		struct Entry {
+			T data;
+			unsigned int step = 0;
+		};
+
+		std::unordered_map<BodyPair, Entry, BodyPairHash> entries;
+
+		unsigned int currentStep;
+
+	public:
+
+		PairCache() : currentStep{ 1 } {}
+
+		/*
+			Returns the data of the given pair, which is default
+			constructed if the pair wasn't in the cache. The second
+			value is false in that case, and true if the data was kept
+			from a previous step (or was already asked for in this one).
+		*/
+		std::pair<T&, bool> get(const RigidBody* one, const RigidBody* two) {
+			Entry& entry = entries[BodyPair{ one, two }];
+			bool found = entry.step != 0;
+			entry.step = currentStep;
+			return std::pair<T&, bool>(entry.data, found);
+		}
+
+		/*
+			Returns the data of the given pair, or nullptr if it isn't in
+			the cache, without keeping it for the next step.
+		*/
+		const T* find(const RigidBody* one, const RigidBody* two) const {
+			auto iterator = entries.find(BodyPair{ one, two });
+			if (iterator == entries.end()) {
+				return nullptr;
+			}
+			return &iterator->second.data;
+		}
+
+		/*
+			Ends the current step, dropping the pairs that weren't asked
+			for during it.
+		*/
+		void endStep() {
+			for (auto iterator = entries.begin(); iterator != entries.end();) {
+				if (iterator->second.step != currentStep) {
+					iterator = entries.erase(iterator);
+				}
+				else {
+					iterator++;
+				}
+			}
+			currentStep++;
+		}
+
+		/*
+			Drops the pairs of the given body, for instance when it is
+			removed, so that a body later created at the same address does
+			not inherit them.
+		*/
+		void remove(const RigidBody* body) {
+			for (auto iterator = entries.begin(); iterator != entries.end();) {
+				if (iterator->first.one == body || iterator->first.two == body) {
+					iterator = entries.erase(iterator);
+				}
+				else {
+					iterator++;
+				}
+			}
+		}
+
+		void clear() {
+			entries.clear();
+		}
+
+		unsigned int size() const {
+			return entries.size();
+		}
+	};
+}
+
+#endif
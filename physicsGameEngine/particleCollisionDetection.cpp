@@ -101,3 +101,59 @@ void pe::generateContactParticleAndObject(
         contacts.push_back(contact);
     }
 }
+
+
+void pe::generateContactParticlesAndObject(
+    std::vector<Particle>& particles,
+    const SpatialHashGrid& grid,
+    RigidObject& one,
+    std::vector<ParticleContact>& contacts,
+    real restitution
+) {
+    std::vector<unsigned int> indices;
+    grid.query(
+        one.boundingVolumeTransform.getTranslation(),
+        one.boundingVolume->getBVHSphereRadius(),
+        indices
+    );
+
+    for (unsigned int index : indices) {
+        generateContactParticleAndObject(
+            &particles[index], one, contacts, restitution
+        );
+    }
+}
+
+
+void pe::generateContactsBetweenParticles(
+    std::vector<Particle>& particles,
+    const SpatialHashGrid& grid,
+    real radius,
+    std::vector<ParticleContact>& contacts,
+    real restitution
+) {
+    std::vector<std::pair<unsigned int, unsigned int>> pairs;
+    grid.getPairs(pairs);
+
+    for (const auto& [first, second] : pairs) {
+        Vector3D normal = particles[first].position
+            - particles[second].position;
+        real distance = normal.magnitude();
+
+        // Particles at the same position are pushed apart vertically
+        if (distance > 0) {
+            normal *= 1 / distance;
+        }
+        else {
+            normal = Vector3D::UP;
+        }
+
+        ParticleContact contact;
+        contact.particle[0] = &particles[first];
+        contact.particle[1] = &particles[second];
+        contact.contactNormal = normal;
+        contact.interpenetration = 2 * radius - distance;
+        contact.restitutionCoefficient = restitution;
+        contacts.push_back(contact);
+    }
+}
@@ -4,6 +4,7 @@
 
 #include "fineCollisionDetection.h"
 #include "particleContact.h"
+#include "spatialHashGrid.h"
 
 namespace pe {
 
@@ -31,6 +32,34 @@ namespace pe {
         real restitution
     );
 
+
+    /*
+        Generates the contacts between the particles and an object, only
+        checking the particles that the grid, built from the same particles,
+        finds in the bounding sphere of the object.
+    */
+    void generateContactParticlesAndObject(
+        std::vector<Particle>& particles,
+        const SpatialHashGrid& grid,
+        RigidObject& one,
+        std::vector<ParticleContact>& contacts,
+        real restitution
+    );
+
+
+    /*
+        Generates the contacts between the pairs of particles closer than
+        the sum of their radii, as found by the grid, built from the same
+        particles. The normal goes from the second particle to the first.
+    */
+    void generateContactsBetweenParticles(
+        std::vector<Particle>& particles,
+        const SpatialHashGrid& grid,
+        real radius,
+        std::vector<ParticleContact>& contacts,
+        real restitution
+    );
+
 }
 
 #endif
\ No newline at end of file
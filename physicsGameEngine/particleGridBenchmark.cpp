@@ -0,0 +1,103 @@
+/*
+	Benchmark of the spatial hash grid on a cloud of particles settling
+	in a box, like sand or a fluid, at the scale of hundreds of thousands
+	of particles. Each step, the particles are moved a little, then the
+	grid is rebuilt from their positions and queried for all the pairs of
+	touching particles, and for the particles touching a large sphere.
+*/
+
+#include "benchmarks.h"
+#include "spatialHashGrid.h"
+#include <chrono>
+#include <random>
+#include <iostream>
+#include <iomanip>
+
+using namespace pe;
+
+
+namespace {
+
+	const int MEASURED_STEPS = 20;
+
+	const real PARTICLE_RADIUS = 1;
+
+
+	void benchmarkParticles(int count) {
+
+		/*
+			The box is sized so that the particles take about a tenth of
+			its volume.
+		*/
+		real side = std::cbrt(count * 10 * 8 * PARTICLE_RADIUS
+			* PARTICLE_RADIUS * PARTICLE_RADIUS);
+
+		std::mt19937 generator(1);
+		std::uniform_real_distribution<real> position(0, side);
+		std::uniform_real_distribution<real> jitter(-0.1, 0.1);
+
+		std::vector<Particle> particles(count);
+		for (Particle& particle : particles) {
+			particle.position = Vector3D(
+				position(generator),
+				position(generator),
+				position(generator)
+			);
+		}
+
+		// Cells of two diameters were the fastest for this density
+		SpatialHashGrid grid(4 * PARTICLE_RADIUS, count);
+		std::vector<std::pair<unsigned int, unsigned int>> pairs;
+		std::vector<unsigned int> touching;
+
+		double buildMilliseconds = 0;
+		double queryMilliseconds = 0;
+		double pairCount = 0;
+
+		for (int step = 0; step < MEASURED_STEPS; step++) {
+			for (Particle& particle : particles) {
+				particle.position += Vector3D(
+					jitter(generator),
+					jitter(generator),
+					jitter(generator)
+				);
+			}
+
+			auto start = std::chrono::steady_clock::now();
+			grid.build(particles, PARTICLE_RADIUS);
+			auto built = std::chrono::steady_clock::now();
+
+			pairs.clear();
+			touching.clear();
+			grid.getPairs(pairs);
+			grid.query(
+				Vector3D(side * 0.5, side * 0.5, side * 0.5),
+				side * 0.1,
+				touching
+			);
+			auto end = std::chrono::steady_clock::now();
+
+			buildMilliseconds += std::chrono::duration<double, std::milli>(
+				built - start
+			).count();
+			queryMilliseconds += std::chrono::duration<double, std::milli>(
+				end - built
+			).count();
+			pairCount += pairs.size();
+		}
+
+		std::cout << "Particles, " << count << " particles\n"
+			<< "    spatial hash grid: " << std::fixed << std::setprecision(3)
+			<< buildMilliseconds / MEASURED_STEPS << " ms per build, "
+			<< queryMilliseconds / MEASURED_STEPS << " ms per query, "
+			<< std::setprecision(0) << pairCount / MEASURED_STEPS
+			<< " pairs\n";
+	}
+}
+
+
+void pe::runParticleGridBenchmark() {
+	for (int count : { 10000, 100000, 500000 }) {
+		benchmarkParticles(count);
+	}
+}
@@ -1,6 +1,7 @@
 #ifndef POINT_PROJECTION_H
 #define POINT_PROJECTION_H
 
+#include "graphicsLibraries.h"
 #include "accuracy.h"
 
 namespace pe {
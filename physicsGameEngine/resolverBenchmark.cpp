@@ -0,0 +1,275 @@
+/*
+	Benchmark of the collision resolver on stacks of boxes resting on a
+	static ground, which is the contact graph the worst first solver has
+	the most trouble with (each box rests on the one below it, so the
+	weight of a stack has to go through all of its contacts).
+	Each solver runs the whole world for some steps with a few iteration
+	budgets, and the time per step is printed with how far the stacks
+	are from resting: the average height the boxes lost (from sinking
+	into each other, or falling), and their average speed at the end.
+	The solver converging better for the same time has the smaller
+	errors for the same time per step.
+	The sequential solver is then run on more columns with several
+	threads, each column being an island of its own, and the graph
+	colored solver on a pyramid of boxes, in which each box rests on
+	four others, so that the whole pyramid is a single island. Last,
+	both solvers run on several pyramids, which the threads should solve
+	at the same time (one island each), whichever the solver.
+*/
+
+#include "benchmarks.h"
+#include "rigidBodyWorld.h"
+#include "rigidBodyGravity.h"
+#include "orientedBoundingBox.h"
+#include "cuboid.h"
+#include "simdContactKernels.h"
+#include <chrono>
+#include <iostream>
+#include <iomanip>
+#include <string>
+
+using namespace pe;
+
+
+namespace {
+
+	const int STEPS = 300;
+
+	const real STEP = 1.0 / 60.0;
+
+	// Size of the boxes, and the gap they are dropped from
+	const real BOX_SIZE = 20;
+	const real GAP = 0.5;
+
+
+	struct SolverSettings {
+		std::string name;
+		CollisionResolver::SOLVER solver;
+		CollisionResolver::POSITION_CORRECTION positionCorrection;
+		unsigned int velocityIterations;
+		unsigned int positionIterations;
+	};
+
+
+	/*
+		Resting positions of the boxes of columns of the given height,
+		apart from each other.
+	*/
+	std::vector<Vector3D> getColumns(int columns, int height) {
+		std::vector<Vector3D> positions;
+		for (int x = 0; x < columns; x++) {
+			for (int z = 0; z < columns; z++) {
+				for (int y = 0; y < height; y++) {
+					positions.push_back(Vector3D(
+						x * BOX_SIZE * 1.5,
+						5 + BOX_SIZE * (y + 0.5),
+						z * BOX_SIZE * 1.5
+					));
+				}
+			}
+		}
+		return positions;
+	}
+
+
+	/*
+		Resting positions of the boxes of a pyramid with the given number
+		of boxes on each side of its base, each layer being shifted by
+		half a box from the one below.
+	*/
+	std::vector<Vector3D> getPyramid(int base) {
+		std::vector<Vector3D> positions;
+		for (int y = 0; y < base; y++) {
+			for (int x = 0; x < base - y; x++) {
+				for (int z = 0; z < base - y; z++) {
+					positions.push_back(Vector3D(
+						(x + y * 0.5) * (BOX_SIZE + GAP),
+						5 + BOX_SIZE * (y + 0.5),
+						(z + y * 0.5) * (BOX_SIZE + GAP)
+					));
+				}
+			}
+		}
+		return positions;
+	}
+
+
+	// Same, for a row of the given number of pyramids, apart
+	std::vector<Vector3D> getPyramids(int count, int base) {
+		std::vector<Vector3D> positions;
+		for (int i = 0; i < count; i++) {
+			for (const Vector3D& position : getPyramid(base)) {
+				positions.push_back(position +
+					Vector3D(i * (base + 1) * (BOX_SIZE + GAP), 0, 0));
+			}
+		}
+		return positions;
+	}
+
+
+	/*
+		Simulates the boxes with the given solver and number of threads,
+		dropping each a little above its resting position, and prints the
+		time per step and the errors at the end.
+	*/
+	void measure(
+		const SolverSettings& settings,
+		const std::vector<Vector3D>& restingPositions,
+		unsigned int threads = 1
+	) {
+		Cuboid groundMesh(2000, 10, 2000);
+		OrientedBoundingBox groundVolume(Vector3D(1000, 5, 1000));
+		Cuboid boxMesh(BOX_SIZE, BOX_SIZE, BOX_SIZE);
+		OrientedBoundingBox boxVolume(Vector3D(
+			BOX_SIZE / 2, BOX_SIZE / 2, BOX_SIZE / 2
+		));
+
+		RigidBodyWorld world(
+			settings.velocityIterations,
+			settings.positionIterations,
+			0.2, 0.5, 10000
+		);
+		world.setSolver(settings.solver);
+		world.setPositionCorrection(settings.positionCorrection);
+		world.setThreadCount(threads);
+
+		// Stacks that fall asleep would no longer cost anything
+		world.setSleeping(false);
+
+		RigidObject ground(
+			&groundMesh, &groundVolume, Vector3D(), Quaternion::IDENTITY, 0
+		);
+		ground.body.inverseMass = 0;
+		ground.body.inverseInertiaTensor = Matrix3x3();
+		ground.body.calculateDerivedData();
+		ground.body.isAwake = false;
+		world.addObject(&ground);
+
+		// Inertia tensor of a box of mass 1
+		real inertia = BOX_SIZE * BOX_SIZE / 6;
+		Matrix3x3 inertiaTensor(
+			inertia, 0, 0,
+			0, inertia, 0,
+			0, 0, inertia
+		);
+
+		// Each layer is dropped from a little higher than the one below
+		std::vector<RigidObject*> boxes;
+		for (const Vector3D& position : restingPositions) {
+			int layer = (int)((position.y - 5) / BOX_SIZE);
+			RigidObject* box = new RigidObject(
+				&boxMesh, &boxVolume,
+				position + Vector3D(0, GAP * (layer + 1), 0),
+				Quaternion::IDENTITY, 1, inertiaTensor
+			);
+			boxes.push_back(box);
+			world.addObject(box);
+		}
+
+		RigidBodyGravity gravity(Vector3D(0, -10, 0));
+		world.addGlobalForce(&gravity);
+
+		auto start = std::chrono::steady_clock::now();
+		for (int step = 0; step < STEPS; step++) {
+			world.runPhysics(STEP);
+		}
+		auto end = std::chrono::steady_clock::now();
+
+		real heightLost = 0;
+		real speed = 0;
+		for (unsigned int i = 0; i < boxes.size(); i++) {
+			heightLost += restingPositions[i].y - boxes[i]->body.position.y;
+			speed += boxes[i]->body.linearVelocity.magnitude();
+		}
+
+		std::cout << "    " << std::left << std::setw(36)
+			<< settings.name + ":" << std::right << std::fixed
+			<< std::setprecision(3)
+			<< std::chrono::duration<double, std::milli>(
+				end - start
+			).count() / STEPS << " ms per step, "
+			<< heightLost / boxes.size() << " height lost, "
+			<< speed / boxes.size() << " speed\n";
+
+		for (RigidObject* box : boxes) {
+			delete box;
+		}
+	}
+}
+
+
+void pe::runResolverBenchmark() {
+
+	typedef CollisionResolver::SOLVER Solver;
+	typedef CollisionResolver::POSITION_CORRECTION Correction;
+
+	const SolverSettings settings[] = {
+		{ "worst first, 100", Solver::WORST_FIRST,
+			Correction::SPLIT_IMPULSE, 100, 100 },
+		{ "worst first, 1000", Solver::WORST_FIRST,
+			Correction::SPLIT_IMPULSE, 1000, 1000 },
+		{ "sequential split, 5", Solver::SEQUENTIAL_IMPULSE,
+			Correction::SPLIT_IMPULSE, 5, 5 },
+		{ "sequential split, 10", Solver::SEQUENTIAL_IMPULSE,
+			Correction::SPLIT_IMPULSE, 10, 10 },
+		{ "sequential split, 20", Solver::SEQUENTIAL_IMPULSE,
+			Correction::SPLIT_IMPULSE, 20, 20 },
+		{ "sequential Baumgarte, 10", Solver::SEQUENTIAL_IMPULSE,
+			Correction::BAUMGARTE, 10, 0 },
+		{ "sequential Baumgarte, 20", Solver::SEQUENTIAL_IMPULSE,
+			Correction::BAUMGARTE, 20, 0 }
+	};
+
+	for (int height : { 5, 10 }) {
+		std::cout << "Stacks of boxes, 4 x 4 columns of " << height << "\n";
+		for (const SolverSettings& setting : settings) {
+			measure(setting, getColumns(4, height));
+		}
+	}
+
+	const SolverSettings threaded{ "sequential split, 10",
+		Solver::SEQUENTIAL_IMPULSE, Correction::SPLIT_IMPULSE, 10, 10 };
+
+	std::cout << "Stacks of boxes, 8 x 8 columns of 5\n";
+	for (unsigned int threads : { 1, 2, 4, 8 }) {
+		SolverSettings setting = threaded;
+		setting.name += ", " + std::to_string(threads) + " threads";
+		measure(setting, getColumns(8, 5), threads);
+	}
+
+	/*
+		The graph colored solver is run with each instruction set, to
+		show what the blocks gain, then with more threads, which should
+		never be slower than one (the colors of this pyramid are too
+		small to be split among them, so they are solved inline).
+	*/
+	std::vector<Vector3D> pyramid = getPyramid(8);
+	std::cout << "Pyramid of " << pyramid.size() << " boxes\n";
+	measure(threaded, pyramid);
+
+	const SolverSettings colored{ "graph colored, 10",
+		Solver::GRAPH_COLORED, Correction::SPLIT_IMPULSE, 10, 10 };
+	const char* levelNames[] = { "scalar", "SSE", "AVX" };
+	for (unsigned int level = 0;
+		level <= (unsigned int)getSupportedSimdLevel(); level++) {
+		setSimdLevel((SIMD_LEVEL)level);
+		SolverSettings setting = colored;
+		setting.name += std::string(", ") + levelNames[level];
+		measure(setting, pyramid);
+	}
+	for (unsigned int threads : { 2, 4, 8 }) {
+		SolverSettings setting = colored;
+		setting.name += ", " + std::to_string(threads) + " threads";
+		measure(setting, pyramid, threads);
+	}
+
+	std::vector<Vector3D> pyramids = getPyramids(4, 8);
+	std::cout << "4 pyramids of " << pyramid.size() << " boxes\n";
+	for (const SolverSettings& solver : { threaded, colored }) {
+		for (unsigned int threads : { 1, 2, 4, 8 }) {
+			SolverSettings setting = solver;
+			setting.name += ", " + std::to_string(threads) + " threads";
+			measure(setting, pyramids, threads);
+		}
+	}
+}
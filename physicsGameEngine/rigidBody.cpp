@@ -8,6 +8,13 @@ using namespace pe;
 const real RigidBody::SLEEP_EPSILON = 0.5f;
 
 
+/*
+	Weight the motion of the last second keeps in the average motion of
+	a body (so half of it is forgotten each second).
+*/
+static const real SLEEP_BIAS = 0.5f;
+
+
 /*
 	Creates a transform matrix from the orientationand position of the
 	object.
@@ -152,6 +159,7 @@ void RigidBody::setInertiaTensor(const Matrix3x3& inertiaTensor) {
 
 void RigidBody::addForce(const Vector3D& force) {
 	forceAccumulator += force;
+	setAwake(true);
 }
 
 
@@ -202,6 +210,18 @@ void RigidBody::integrate(real duration) {
 
 	// Accumulators cleared each frame
 	clearAccumulators();
+
+	/*
+		The motion is averaged over the last steps, and capped so that a
+		fast body doesn't take too long to be considered at rest.
+	*/
+	real currentMotion = linearVelocity.scalarProduct(linearVelocity) +
+		angularVelocity.scalarProduct(angularVelocity);
+	real bias = realPow(SLEEP_BIAS, duration);
+	motion = bias * motion + (1 - bias) * currentMotion;
+	if (motion > 10 * SLEEP_EPSILON) {
+		motion = 10 * SLEEP_EPSILON;
+	}
 }
 
 
@@ -268,5 +288,19 @@ Vector3D RigidBody::getPointInLocalCoordinates(const Vector3D& point) const {
 
 
 void RigidBody::setAwake(bool isAwake){
+	if (isAwake) {
+		if (!this->isAwake) {
+			motion = 2 * SLEEP_EPSILON;
+		}
+	}
+	else {
+		linearVelocity.clear();
+		angularVelocity.clear();
+	}
 	this->isAwake = isAwake;
+}
+
+
+bool RigidBody::isAtRest() const {
+	return canSleep && motion < SLEEP_EPSILON;
 }
\ No newline at end of file
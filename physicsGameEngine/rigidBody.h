@@ -152,16 +152,32 @@ namespace pe {
 		real angularDamping;
 
 		/*
-			A body that is not awake is not currently active.
-			It can't be integrated, or moved. When it collides with an
-			object, it remains unmoving.
+			A body that is not awake is asleep: it isn't integrated, and
+			contacts between bodies that aren't awake are not generated.
+			The world puts a body to sleep with the rest of its island
+			once they all stop moving, and wakes it up when an awake body
+			touches it, or when a force is added to it.
+			Bodies that never move (like walls) are those with infinite
+			mass, whether they are awake or not.
 		*/
 		bool isAwake;
 
+		/*
+			Recency weighted average of the kinetic energy of the body
+			(without its mass, so the sum of its squared linear and
+			angular speeds), used to know if it has stopped moving for
+			long enough to be put to sleep.
+		*/
+		real motion;
+
+		// Whether the body is allowed to be put to sleep
+		bool canSleep;
+
 	public:
 
 
-		RigidBody() : isAwake{true} {};
+		RigidBody() : isAwake{ true }, motion{ 2 * SLEEP_EPSILON },
+			canSleep{ true } {};
 
 
 		RigidBody(
@@ -169,7 +185,8 @@ namespace pe {
 			const Matrix3x3& inertiaTensor,
 			const Vector3D& position = Vector3D::ZERO,
 			const Quaternion& orientation = Quaternion::IDENTITY
-		) : position{ position }, orientation{orientation}, isAwake {true} {
+		) : position{ position }, orientation{orientation}, isAwake {true},
+			motion{ 2 * SLEEP_EPSILON }, canSleep{ true } {
 			
 			setMass(mass);
 			setInertiaTensor(inertiaTensor);
@@ -277,9 +294,19 @@ namespace pe {
 		Vector3D getPointInLocalCoordinates(const Vector3D& point) const;
 
 
-		// Sets the wake status
+		/*
+			Sets the wake status. A body put to sleep loses its velocity,
+			and one woken up gets some motion, so that it isn't put back
+			to sleep right away.
+		*/
 		void setAwake(bool isAwake);
 
+		/*
+			Checks if the body has moved little enough for long enough
+			to be put to sleep.
+		*/
+		bool isAtRest() const;
+
 
 		static inline void calculateTransformMatrix(Matrix3x4& transformMatrix,
 			const Vector3D& position, const Quaternion& orientation);
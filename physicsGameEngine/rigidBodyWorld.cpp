@@ -4,24 +4,692 @@
 
 using namespace pe;
 
+
+/*
+	Distance, as a fraction of the radius of the smaller object of a
+	pair, at which a fast object is considered to touch the other, and
+	by which it is then allowed to penetrate it so that their contact
+	is generated in the next step.
+*/
+static const real TIME_OF_IMPACT_TOLERANCE = 0.01;
+
+/*
+	Whether the body moves during the step, which bodies with infinite
+	mass never do, even when they are awake.
+*/
+static bool isMoving(const RigidBody& body) {
+	return body.isAwake && body.hasFiniteMass();
+}
+
+
+const RigidBodyWorld::ObjectHandle RigidBodyWorld::INVALID_HANDLE =
+	std::numeric_limits<RigidBodyWorld::ObjectHandle>::max();
+
+
+RigidBodyWorld::RigidBodyWorld(
+	unsigned int velocityIterations,
+	unsigned int positionIterations,
+	real restitution,
+	real friction,
+	unsigned int potentialContactCapacity,
+	real hierarchyMargin
+) : hierarchy(hierarchyMargin),
+	broadPhase{ BROAD_PHASE::BOUNDING_VOLUME_HIERARCHY },
+	linearRebuildFraction{ 0.5 },
+	resolvers(1, CollisionResolver(velocityIterations, positionIterations)),
+	sleeping{ true }, velocityIterationsUsed{ 0 }, positionIterationsUsed{ 0 },
+	restitution{ restitution }, friction{ friction },
+	continuousCollision{ false }, continuousCollisionThreshold{ 0.5 },
+	batchedNarrowPhase{ false },
+	potentialContactOverflow{ 0 } {
+	potentialContacts.reserve(potentialContactCapacity);
+}
+
+
+RigidBodyWorld::ObjectHandle RigidBodyWorld::addObject(RigidObject* object) {
+
+	assert(object != nullptr && "Object cannot be null");
+
+	// Reuses the handle of a removed object if there is one
+	ObjectHandle handle;
+	if (!freeHandles.empty()) {
+		handle = freeHandles.back();
+		freeHandles.pop_back();
+	}
+	else {
+		handle = handleToIndex.size();
+		handleToIndex.push_back(INVALID_HANDLE);
+	}
+
+	handleToIndex[handle] = objects.size();
+	objects.push_back(object);
+	indexToHandle.push_back(handle);
+	objectLeaves.push_back(BVHNode::NULL_NODE);
+
+	addToBroadPhase(objects.size() - 1);
+
+	return handle;
+}
+
+
+void RigidBodyWorld::addToBroadPhase(unsigned int index) {
+	RigidObject* object = objects[index];
+	Vector3D centre = object->boundingVolumeTransform.getTranslation();
+	real radius = object->boundingVolume->getBVHSphereRadius();
+
+	if (broadPhase == BROAD_PHASE::SWEEP_AND_PRUNE) {
+		sweepAndPrune.insert(object, centre, radius);
+		objectLeaves[index] = BVHNode::NULL_NODE;
+	}
+	else {
+		objectLeaves[index] = hierarchy.insert(object, centre, radius);
+	}
+}
+
+
+void RigidBodyWorld::removeObject(ObjectHandle handle) {
+
+	if (handle >= handleToIndex.size() ||
+		handleToIndex[handle] == INVALID_HANDLE) {
+		return;
+	}
+
+	/*
+		The last object takes the place of the removed one so that the
+		array remains contiguous, and its handle is redirected.
+	*/
+	unsigned int index = handleToIndex[handle];
+	unsigned int lastIndex = objects.size() - 1;
+
+	if (broadPhase == BROAD_PHASE::SWEEP_AND_PRUNE) {
+		sweepAndPrune.remove(objects[index]);
+	}
+	else {
+		hierarchy.remove(objects[index]);
+	}
+	contactCache.remove(&objects[index]->body);
+	simplexCaches.remove(&objects[index]->body);
+
+	objects[index] = objects[lastIndex];
+	objectLeaves[index] = objectLeaves[lastIndex];
+	indexToHandle[index] = indexToHandle[lastIndex];
+	handleToIndex[indexToHandle[index]] = index;
+
+	objects.pop_back();
+	objectLeaves.pop_back();
+	indexToHandle.pop_back();
+
+	handleToIndex[handle] = INVALID_HANDLE;
+	freeHandles.push_back(handle);
+
+	// The forces registered for the object are removed with it
+	forceRegistrations.erase(
+		std::remove_if(
+			forceRegistrations.begin(),
+			forceRegistrations.end(),
+			[handle](const ForceRegistration& registration) {
+				return registration.handle == handle;
+			}
+		),
+		forceRegistrations.end()
+	);
+}
+
+
+RigidObject* RigidBodyWorld::getObject(ObjectHandle handle) const {
+	if (handle >= handleToIndex.size() ||
+		handleToIndex[handle] == INVALID_HANDLE) {
+		return nullptr;
+	}
+	return objects[handleToIndex[handle]];
+}
+
+
+void RigidBodyWorld::addForce(
+	ObjectHandle handle,
+	const RigidBodyForceGenerator* force
+) {
+	forceRegistrations.push_back(ForceRegistration{ handle, force });
+}
+
+
+void RigidBodyWorld::removeForce(
+	ObjectHandle handle,
+	const RigidBodyForceGenerator* force
+) {
+	for (unsigned int i = 0; i < forceRegistrations.size(); i++) {
+		if (forceRegistrations[i].handle == handle &&
+			forceRegistrations[i].force == force) {
+			forceRegistrations.erase(forceRegistrations.begin() + i);
+			return;
+		}
+	}
+}
+
+
+void RigidBodyWorld::addGlobalForce(const RigidBodyForceGenerator* force) {
+	globalForces.push_back(force);
+}
+
+
+void RigidBodyWorld::removeGlobalForce(const RigidBodyForceGenerator* force) {
+	globalForces.erase(
+		std::remove(globalForces.begin(), globalForces.end(), force),
+		globalForces.end()
+	);
+}
+
+
+void RigidBodyWorld::addJoint(const Joint* joint) {
+	joints.push_back(joint);
+}
+
+
+void RigidBodyWorld::removeJoint(const Joint* joint) {
+	joints.erase(
+		std::remove(joints.begin(), joints.end(), joint),
+		joints.end()
+	);
+}
+
+
+void RigidBodyWorld::setBroadPhase(BROAD_PHASE broadPhase) {
+	if (this->broadPhase == broadPhase) {
+		return;
+	}
+
+	hierarchy.clear();
+	sweepAndPrune.clear();
+
+	this->broadPhase = broadPhase;
+	for (unsigned int i = 0; i < objects.size(); i++) {
+		addToBroadPhase(i);
+	}
+}
+
+
+void RigidBodyWorld::rebuildHierarchy() {
+
+	if (broadPhase != BROAD_PHASE::BOUNDING_VOLUME_HIERARCHY) {
+		return;
+	}
+	updateObjectSpheres();
+	hierarchy.build(objects, objectSpheres, objectLeaves);
+}
+
+
+void RigidBodyWorld::updateObjectSpheres(real duration) {
+
+	bool sweep = continuousCollision && duration > 0;
+	if (sweep) {
+		fastObjects.clear();
+	}
+
+	objectSpheres.clear();
+	for (RigidObject* object : objects) {
+		Vector3D centre = object->boundingVolumeTransform.getTranslation();
+		real radius = object->boundingVolume->getBVHSphereRadius();
+
+		RigidBody& body = object->body;
+		if (sweep && isMoving(body)) {
+			/*
+				The motion of the step is predicted from the forces
+				applied so far, the same way the body is integrated.
+			*/
+			Vector3D acceleration = body.acceleration;
+			acceleration.linearCombination(
+				body.forceAccumulator, body.inverseMass
+			);
+			Vector3D motion = (body.linearVelocity +
+				acceleration * duration) * duration;
+			real distance = motion.magnitude();
+
+			// The sphere is enlarged to cover the whole motion
+			if (distance > continuousCollisionThreshold * radius) {
+				fastObjects.push_back(FastObject{ object, 1 });
+				centre += motion * 0.5;
+				radius += distance * 0.5;
+			}
+		}
+
+		objectSpheres.push_back(BVHSphere(centre, radius));
+	}
+
+	if (sweep) {
+		std::sort(
+			fastObjects.begin(),
+			fastObjects.end(),
+			[](const FastObject& one, const FastObject& two) {
+				return one.object < two.object;
+			}
+		);
+	}
+}
+
+
 void RigidBodyWorld::startFrame() {
-	RigidBodyRegistrationPtr ptr = firstRigidBody;
-	// Loops over the particles
-	while (ptr) {
-		// Clears the accumulators of all the particles
-		ptr->rigidBody->clearAccumulators();
+	for (RigidObject* object : objects) {
+		// Clears the accumulators of all the bodies
+		object->body.clearAccumulators();
 		// Calculates the new data
-		ptr->rigidBody->calculateDerivedData();
-		ptr = ptr->next;
+		object->update();
 	}
 }
 
-void RigidBodyWorld::runPhysics(real duration){
-	// First apply the force generators, then integrate the objects
-	RigidBodyRegistrationPtr ptr = firstRigidBody;
-	while (ptr){
-		// Remove all forces from the accumulator
-		ptr->rigidBody->integrate(duration);
-		ptr = ptr->next;
+
+void RigidBodyWorld::applyForces(real duration) {
+	/*
+		Global forces are only applied to bodies that can move, as bodies
+		that are not awake are not integrated anyway.
+	*/
+	for (const RigidBodyForceGenerator* force : globalForces) {
+		for (RigidObject* object : objects) {
+			if (isMoving(object->body)) {
+				force->updateForce(&object->body, duration);
+			}
+		}
 	}
-}
\ No newline at end of file
+
+	for (const ForceRegistration& registration : forceRegistrations) {
+		registration.force->updateForce(
+			&objects[handleToIndex[registration.handle]]->body,
+			duration
+		);
+	}
+}
+
+
+void RigidBodyWorld::findPotentialContacts(real duration) {
+
+	unsigned int capacity = potentialContacts.capacity();
+	potentialContacts.clear();
+
+	updateObjectSpheres(duration);
+
+	if (broadPhase == BROAD_PHASE::SWEEP_AND_PRUNE) {
+		for (unsigned int i = 0; i < objects.size(); i++) {
+			sweepAndPrune.update(
+				objects[i],
+				objectSpheres[i].centre,
+				objectSpheres[i].radius
+			);
+		}
+		sweepAndPrune.getPotentialContacts(potentialContacts);
+	}
+	else {
+
+		/*
+			Only the objects that left their fat spheres since the last
+			step are reinserted, the rest of the tree is left as it is.
+			If most of them did, it is faster to build a new tree.
+		*/
+		unsigned int moved = hierarchy.countMoved(objectLeaves, objectSpheres);
+		if (moved > linearRebuildFraction * objects.size()) {
+			hierarchy.buildLinear(objects, objectSpheres, objectLeaves);
+		}
+		else {
+			for (unsigned int i = 0; i < objects.size(); i++) {
+				hierarchy.updateLeaf(
+					objectLeaves[i],
+					objectSpheres[i].centre,
+					objectSpheres[i].radius
+				);
+			}
+		}
+		hierarchy.getPotentialContacts(potentialContacts);
+	}
+
+	potentialContactOverflow = potentialContacts.size() > capacity ?
+		potentialContacts.size() - capacity : 0;
+}
+
+
+void RigidBodyWorld::generateContacts() {
+
+	// The buffer keeps its capacity from the previous steps
+	contacts.clear();
+
+	if (batchedNarrowPhase) {
+		generateBatchedContacts();
+	}
+	else {
+		for (unsigned int i = 0; i < potentialContacts.size(); i++) {
+			RigidObject* one = potentialContacts[i].object[0];
+			RigidObject* two = potentialContacts[i].object[1];
+
+			/*
+				We only do the expensive fine collision detection phase if
+				at least one body is moving, otherwise it serves no
+				purpose and wastes time.
+			*/
+			if (isMoving(one->body) || isMoving(two->body)) {
+				pe::generateContacts(
+					*one, *two, contacts, restitution, friction,
+					&simplexCaches
+				);
+			}
+		}
+	}
+
+	// The pairs that are no longer close are dropped
+	simplexCaches.endStep();
+
+	for (const Joint* joint : joints) {
+		joint->addContact(contacts);
+	}
+}
+
+
+void RigidBodyWorld::generateBatchedContacts() {
+
+	const unsigned int typeCount = BoundingVolume::TYPE_COUNT;
+
+	/*
+		Counts the pairs of each pair of types, putting the object with
+		the lowest type first, so that both orders share a batch.
+	*/
+	unsigned int batchStart[typeCount * typeCount + 1] = { 0 };
+	for (const PotentialContact& pair : potentialContacts) {
+		if (isMoving(pair.object[0]->body) || isMoving(pair.object[1]->body)) {
+			unsigned int typeOne =
+				(unsigned int)pair.object[0]->boundingVolume->getType();
+			unsigned int typeTwo =
+				(unsigned int)pair.object[1]->boundingVolume->getType();
+			batchStart[std::min(typeOne, typeTwo) * typeCount +
+				std::max(typeOne, typeTwo) + 1]++;
+		}
+	}
+	for (unsigned int i = 0; i < typeCount * typeCount; i++) {
+		batchStart[i + 1] += batchStart[i];
+	}
+
+	// Places each pair in its batch
+	unsigned int batchEnd[typeCount * typeCount];
+	std::copy(batchStart, batchStart + typeCount * typeCount, batchEnd);
+	batchedPairs.resize(batchStart[typeCount * typeCount]);
+	for (const PotentialContact& pair : potentialContacts) {
+		if (isMoving(pair.object[0]->body) || isMoving(pair.object[1]->body)) {
+			unsigned int typeOne =
+				(unsigned int)pair.object[0]->boundingVolume->getType();
+			unsigned int typeTwo =
+				(unsigned int)pair.object[1]->boundingVolume->getType();
+			if (typeOne <= typeTwo) {
+				batchedPairs[batchEnd[typeOne * typeCount + typeTwo]++] = pair;
+			}
+			else {
+				batchedPairs[batchEnd[typeTwo * typeCount + typeOne]++] =
+					PotentialContact{ { pair.object[1], pair.object[0] } };
+			}
+		}
+	}
+
+	// Runs the routine of each batch over all of its pairs
+	for (unsigned int typeOne = 0; typeOne < typeCount; typeOne++) {
+		for (unsigned int typeTwo = typeOne; typeTwo < typeCount; typeTwo++) {
+			unsigned int batch = typeOne * typeCount + typeTwo;
+			if (batchStart[batch] == batchEnd[batch]) {
+				continue;
+			}
+
+			unsigned int first = contacts.size();
+			getContactBatchRoutine(
+				(BoundingVolume::TYPE)typeOne, (BoundingVolume::TYPE)typeTwo
+			)(
+				batchedPairs.data() + batchStart[batch],
+				batchEnd[batch] - batchStart[batch],
+				contacts, &simplexCaches
+			);
+
+			for (unsigned int i = first; i < contacts.size(); i++) {
+				contacts[i].restitution = restitution;
+				contacts[i].friction = friction;
+			}
+		}
+	}
+}
+
+
+void RigidBodyWorld::resolveIslands(real duration) {
+	const std::vector<SimulationIslands::Island>& islandList =
+		islands.getIslands();
+
+	// The largest islands are solved first, so the threads finish together
+	islandOrder.clear();
+	for (unsigned int i = 0; i < islandList.size(); i++) {
+		if (islandList[i].isAwake && islandList[i].contactCount > 0) {
+			islandOrder.push_back(i);
+		}
+	}
+	std::stable_sort(
+		islandOrder.begin(),
+		islandOrder.end(),
+		[&islandList](unsigned int one, unsigned int two) {
+			return islandList[one].contactCount >
+				islandList[two].contactCount;
+		}
+	);
+	islandIterations.resize(islandOrder.size() * 2);
+
+	/*
+		With the graph colored solver, the largest islands are solved
+		first, one at a time, each by all the threads, as long as they
+		have colors large enough to be spread among the threads (the
+		resolver decides this in the same way for each color). The
+		islands after the first that doesn't are solved one per thread,
+		like with the other solvers.
+	*/
+	unsigned int sharedIslands = 0;
+	if (jobSystem) {
+		while (sharedIslands < islandOrder.size() &&
+			resolvers[0].isThreaded(
+				contacts.data() +
+				islandList[islandOrder[sharedIslands]].firstContact,
+				islandList[islandOrder[sharedIslands]].contactCount,
+				jobSystem.get()
+			)) {
+			const SimulationIslands::Island& island =
+				islandList[islandOrder[sharedIslands]];
+			resolvers[0].resolveContacts(
+				contacts.data() + island.firstContact,
+				island.contactCount,
+				duration,
+				jobSystem.get()
+			);
+			islandIterations[sharedIslands * 2] =
+				resolvers[0].velocityIterationsUsed;
+			islandIterations[sharedIslands * 2 + 1] =
+				resolvers[0].positionIterationsUsed;
+			sharedIslands++;
+		}
+	}
+
+	/*
+		Islands share no body that can move, so each can be solved by
+		any thread, with the resolver (and buffers) of that thread.
+	*/
+	JobSystem::Task solveIsland = [this, &islandList, duration,
+		sharedIslands](unsigned int job, unsigned int thread) {
+		job += sharedIslands;
+		const SimulationIslands::Island& island =
+			islandList[islandOrder[job]];
+		CollisionResolver& resolver = resolvers[thread];
+		resolver.resolveContacts(
+			contacts.data() + island.firstContact,
+			island.contactCount,
+			duration
+		);
+		islandIterations[job * 2] = resolver.velocityIterationsUsed;
+		islandIterations[job * 2 + 1] = resolver.positionIterationsUsed;
+	};
+
+	unsigned int jobCount = islandOrder.size() - sharedIslands;
+	if (jobSystem) {
+		jobSystem->run(jobCount, solveIsland);
+	}
+	else {
+		for (unsigned int job = 0; job < jobCount; job++) {
+			solveIsland(job, 0);
+		}
+	}
+
+	velocityIterationsUsed = 0;
+	positionIterationsUsed = 0;
+	for (unsigned int job = 0; job < islandOrder.size(); job++) {
+		velocityIterationsUsed = std::max(
+			velocityIterationsUsed, islandIterations[job * 2]
+		);
+		positionIterationsUsed = std::max(
+			positionIterationsUsed, islandIterations[job * 2 + 1]
+		);
+	}
+}
+
+
+void RigidBodyWorld::integrate(real duration) {
+	for (RigidObject* object : objects) {
+		object->body.integrate(duration);
+	}
+
+	// The objects of the sleeping bodies haven't changed
+	for (RigidObject* object : objects) {
+		if (object->body.isAwake || !object->body.hasFiniteMass()) {
+			object->update();
+		}
+	}
+}
+
+
+void RigidBodyWorld::stopFastObjects(real duration) {
+
+	if (!continuousCollision || fastObjects.empty()) {
+		return;
+	}
+
+	auto findFastObject = [this](RigidObject* object) -> FastObject* {
+		auto fast = std::lower_bound(
+			fastObjects.begin(),
+			fastObjects.end(),
+			object,
+			[](const FastObject& fast, RigidObject* object) {
+				return fast.object < object;
+			}
+		);
+		return fast != fastObjects.end() && fast->object == object ?
+			&*fast : nullptr;
+	};
+
+	// The swept spheres made sure the pairs include what they went through
+	for (const PotentialContact& pair : potentialContacts) {
+		FastObject* fast[2] = {
+			findFastObject(pair.object[0]),
+			findFastObject(pair.object[1])
+		};
+		if (!fast[0] && !fast[1]) {
+			continue;
+		}
+
+		/*
+			The position of a body changes by its new velocity over the
+			duration, so the shapes are moved back by that much to where
+			they were at the start of the step (keeping their new
+			orientation).
+		*/
+		Vector3D motion[2];
+		for (unsigned int i = 0; i < 2; i++) {
+			const RigidBody& body = pair.object[i]->body;
+			if (body.isAwake) {
+				motion[i] = body.linearVelocity * duration;
+			}
+		}
+		ConvexShape one(*pair.object[0]);
+		ConvexShape two(*pair.object[1]);
+		one.transformMatrix.addTranslation(motion[0] * -1);
+		two.transformMatrix.addTranslation(motion[1] * -1);
+
+		real tolerance = TIME_OF_IMPACT_TOLERANCE * std::min(
+			pair.object[0]->boundingVolume->getBVHSphereRadius(),
+			pair.object[1]->boundingVolume->getBVHSphereRadius()
+		);
+		real time = findTimeOfImpact(
+			one, motion[0], two, motion[1], tolerance
+		);
+
+		for (unsigned int i = 0; i < 2; i++) {
+			if (fast[i] && time < fast[i]->timeOfImpact) {
+				fast[i]->timeOfImpact = time;
+			}
+		}
+	}
+
+	/*
+		The velocity is kept, so the contact generated in the next step
+		resolves the impact.
+	*/
+	for (const FastObject& fast : fastObjects) {
+		if (fast.timeOfImpact < 1) {
+			RigidBody& body = fast.object->body;
+			body.position -= body.linearVelocity *
+				(duration * (1 - fast.timeOfImpact));
+			fast.object->update();
+		}
+	}
+}
+
+
+void RigidBodyWorld::runPhysics(real duration) {
+
+	// First the forces are applied to the bodies
+	applyForces(duration);
+
+	// Then the contacts are found and generated
+	findPotentialContacts(duration);
+	generateContacts();
+
+	/*
+		And then grouped by island, waking up the islands touched by an
+		awake body, and resolved island by island, starting from the
+		impulses of the contacts that persist from the previous step,
+		after which the impulses are kept for the next one.
+	*/
+	islands.build(objects, joints, contacts);
+	contactCache.warmStart(contacts.data(), contacts.size());
+	resolveIslands(duration);
+	contactCache.update(contacts.data(), contacts.size());
+
+	// Then the bodies are moved, and the objects updated
+	integrate(duration);
+	stopFastObjects(duration);
+
+	// Finally the islands that stopped moving are put to sleep
+	if (sleeping) {
+		islands.sleepIslands();
+	}
+}
+
+
+void RigidBodyWorld::setThreadCount(unsigned int threadCount) {
+	assert(threadCount > 0 && "There must be at least one thread");
+
+	// The new resolvers take the settings of the first one
+	CollisionResolver settings = resolvers[0];
+	resolvers.resize(threadCount, settings);
+
+	hierarchy.setJobSystem(nullptr);
+	jobSystem.reset();
+	if (threadCount > 1) {
+		jobSystem = std::make_unique<JobSystem>(threadCount);
+		hierarchy.setJobSystem(jobSystem.get());
+	}
+}
+
+
+void RigidBodyWorld::setSleeping(bool enabled) {
+	sleeping = enabled;
+	if (!sleeping) {
+		for (RigidObject* object : objects) {
+			if (object->body.hasFiniteMass()) {
+				object->body.setAwake(true);
+			}
+		}
+	}
+}
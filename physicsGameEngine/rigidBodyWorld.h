@@ -1,7 +1,41 @@
 /*
 	Header file for the Rigid Body World, which keeps track of all the
-	which works in the same way as the particle world class but with rigid
-	bodies.
+	rigid objects of a scene and runs the whole physics pipeline on them,
+	in the same way as the particle world class but with rigid bodies.
+
+	Each step goes through the same phases in order:
+	- The force generators registered in the world fill the force and
+	torque accumulators of the bodies.
+	- The broad phase (coarse collision detection) finds the pairs of
+	objects whose bounding volume hierarchy spheres overlap. The
+	hierarchy is kept from one step to the next, and only the objects
+	that moved out of their fattened spheres are reinserted, unless most
+	of them did, in which case the hierarchy is built again. Sweep and
+	prune can be selected instead, which is faster for scenes of many
+	similarly sized objects spread out on a plane.
+	- The narrow phase (fine collision detection) generates the contacts
+	between these pairs, to which the contacts of the joints are added.
+	- The bodies are grouped into islands (bodies connected by contacts
+	or joints, see simulationIslands.h), and the contacts of each awake
+	island are resolved on their own.
+	- The bodies are integrated, and the objects updated (transform
+	matrices and bounding volume transforms).
+	- With sleeping enabled, the islands whose bodies have all stopped
+	moving are put to sleep. Sleeping bodies are not integrated, and
+	the pairs of objects of which none is awake skip the narrow phase,
+	so a pile at rest costs little more than its broad phase. An island
+	is woken up as soon as an awake body touches one of its bodies, or
+	a force is added to one of them.
+
+	With continuous collision detection enabled, the objects that move
+	by more than a fraction of their radius in a step (like thrown or
+	falling objects) are given a sphere that covers their whole motion
+	during the step in the broad phase. After the integration, each of
+	them is moved back to the time of impact of its first potential
+	contact (found by conservative advancement, see gjk.h), so that
+	instead of passing through thin objects, they stop against them and
+	their contacts are generated in the next step. This only costs
+	anything for the few fast objects, unlike more substeps.
 
 	When the class is used properly, the game loop should look like this:
 
@@ -15,35 +49,343 @@
 		// Changes the graphics based on the physics
 		runGraphicsUpdate(duration);
 	}
+
+	The objects are kept in a contiguous array which is traversed by index
+	in each phase, instead of a linked list. Removing an object moves the
+	last object into its place, so the array stays dense, which means an
+	index is not a stable way of referring to an object. Instead, adding an
+	object returns a handle, which remains valid until the object is
+	removed, no matter how the array is reordered.
+	The world does not own the objects themselves (they are usually derived
+	classes that also hold renderers), so they must outlive the world or
+	be removed from it before they are deleted.
 */
 
 #ifndef RIGID_BODY_WORLD_H
 #define RIGID_BODY_WORLD_H
 
-#include "rigidBody.h"
+#include "rigidObject.h"
+#include "joint.h"
+#include "collisionResolver.h"
+#include "contactCache.h"
+#include "simulationIslands.h"
+#include "jobSystem.h"
+#include "boundingVolumeHierarchy.h"
+#include "sweepAndPrune.h"
+#include "fineCollisionDetection.h"
+#include "gjk.h"
+#include <algorithm>
 
 namespace pe {
 
 	class RigidBodyWorld {
 
+	public:
+
+		// Stable handle returned when an object is added to the world
+		typedef unsigned int ObjectHandle;
+
+		// Value of a handle that does not refer to any object
+		static const ObjectHandle INVALID_HANDLE;
+
+		// Algorithms that can be used for the coarse collision detection
+		enum class BROAD_PHASE {
+			BOUNDING_VOLUME_HIERARCHY,
+			SWEEP_AND_PRUNE
+		};
+
 	private:
 
-		struct RigidBodyRegistration;
-		typedef RigidBodyRegistration* RigidBodyRegistrationPtr;
+		/*
+			Objects of the world, stored contiguously. The index of an
+			object in this array can change when another object is removed.
+		*/
+		std::vector<RigidObject*> objects;
+
+		/*
+			Maps the index of each object in the objects array to its
+			handle, and each handle to the index of its object (or to
+			INVALID_HANDLE if the handle is not in use).
+		*/
+		std::vector<ObjectHandle> indexToHandle;
+		std::vector<unsigned int> handleToIndex;
+
+		// Handles of removed objects, which can be given to new objects
+		std::vector<ObjectHandle> freeHandles;
+
+
+		/*
+			Struct that represents a force applied to a single object of
+			the world, like a spring attached to it.
+		*/
+		struct ForceRegistration {
+			ObjectHandle handle;
+			const RigidBodyForceGenerator* force;
+		};
+
+		// Forces applied to specific objects
+		std::vector<ForceRegistration> forceRegistrations;
+
+		/*
+			Forces applied to every object in the world with a finite mass,
+			like gravity.
+		*/
+		std::vector<const RigidBodyForceGenerator*> globalForces;
+
+		// Joints between the bodies, which generate their own contacts
+		std::vector<const Joint*> joints;
+
+
+		/*
+			Bounding volume hierarchy of all the objects, which persists
+			between steps and is only updated for the objects that moved.
+		*/
+		BoundingVolumeHierarchy hierarchy;
+
+		/*
+			Sweep and prune alternative to the hierarchy. Only the one
+			used by the world holds the objects.
+		*/
+		SweepAndPrune sweepAndPrune;
+
+		BROAD_PHASE broadPhase;
+
+		/*
+			Fraction of the objects that need to have left their fat
+			spheres in a step for the hierarchy to be built again with
+			the linear builder, instead of reinserting each of them.
+		*/
+		real linearRebuildFraction;
+
+		/*
+			Resolves the contacts generated each step. There is one
+			resolver per thread, so that each has buffers of its own,
+			all with the same settings.
+		*/
+		std::vector<CollisionResolver> resolvers;
+
+		/*
+			Threads the islands are solved on, if there is more than one
+			(the islands are then solved largest first, see jobSystem.h).
+			With the graph colored solver, each of the largest islands
+			is solved by all of them.
+		*/
+		std::unique_ptr<JobSystem> jobSystem;
+
+		/*
+			Contacts of the previous step and their impulses, which warm
+			start the resolver.
+		*/
+		ContactCache contactCache;
+
+		// Islands of the current step
+		SimulationIslands islands;
 
 		/*
-			Struct that represents a node in the linked list holding all of
-			the bodies of the world.
+			Awake islands with contacts, from the one with the most
+			contacts to the one with the least, and the velocity and
+			position iterations the resolver used on each.
 		*/
-		struct RigidBodyRegistration {
-			// Particle in the node
-			RigidBody* rigidBody;
-			// Next particle in the node
-			RigidBodyRegistrationPtr next;
+		std::vector<unsigned int> islandOrder;
+		std::vector<unsigned int> islandIterations;
+
+		// Whether the islands at rest are put to sleep
+		bool sleeping;
+
+		/*
+			Most iterations the resolver used on an island during the
+			last step.
+		*/
+		unsigned int velocityIterationsUsed;
+		unsigned int positionIterationsUsed;
+
+		/*
+			Simplex of the last GJK query of each pair of objects colliding
+			as convex hulls, which the next query starts from.
+		*/
+		PairCache<SimplexCache> simplexCaches;
+
+		// Restitution and friction of the generated contacts
+		real restitution;
+		real friction;
+
+		/*
+			Whether the fast objects are swept in the broad phase and
+			stopped at their time of impact, and the fraction of its
+			radius by which an object has to move in a step to count as
+			fast.
+		*/
+		bool continuousCollision;
+		real continuousCollisionThreshold;
+
+		/*
+			Fast objects of the current step, sorted by address so that
+			the potential contacts involving them can be found, and the
+			fraction of their motion at which they first touch another
+			object.
+		*/
+		struct FastObject {
+			RigidObject* object;
+			real timeOfImpact;
 		};
+		std::vector<FastObject> fastObjects;
+
+		/*
+			Whether the narrow phase sorts the potential contacts by the
+			types of their bounding volumes and runs each routine of the
+			dispatch table over its whole batch at once, instead of
+			dispatching each pair on its own.
+		*/
+		bool batchedNarrowPhase;
+
 
-		// Pointer to the first particle in the linked list
-		RigidBodyRegistrationPtr firstRigidBody;
+		/*
+			Buffers filled each step. They are members so that their
+			memory is reused from one step to the next instead of being
+			allocated again. They grow when needed, so no potential
+			contact or contact is ever dropped.
+		*/
+		std::vector<PotentialContact> potentialContacts;
+		std::vector<Contact> contacts;
+
+		/*
+			Potential contacts of the awake objects sorted by the types of
+			their bounding volumes, for the batched narrow phase.
+		*/
+		std::vector<PotentialContact> batchedPairs;
+
+		// Current bounding sphere of each object, in the same order
+		std::vector<BVHSphere> objectSpheres;
+
+		/*
+			Leaf of the hierarchy holding each object, in the same order
+			(NULL_NODE when the hierarchy is not the broad phase in use),
+			so that the moved objects are found without looking them up.
+		*/
+		std::vector<unsigned int> objectLeaves;
+
+		/*
+			Number of potential contacts of the last step that did not
+			fit in the capacity of the buffer at the start of the step.
+		*/
+		unsigned int potentialContactOverflow;
+
+
+		// Adds the object of the given index to the broad phase in use
+		void addToBroadPhase(unsigned int index);
+
+		/*
+			Fills the sphere buffer with the current spheres of the
+			objects. If a duration is given and continuous collision
+			detection is enabled, the fast objects are found, and their
+			spheres are swept over the motion they will have during it.
+		*/
+		void updateObjectSpheres(real duration = 0);
+
+		// Applies the global and object specific forces
+		void applyForces(real duration);
+
+		/*
+			Coarse collision detection; fills the potential contacts
+			buffer with the pairs of objects that may be in contact
+			during the given duration.
+		*/
+		void findPotentialContacts(real duration);
+
+		/*
+			Fine collision detection; fills the contacts buffer with the
+			contacts between the potential contacts, and those of the
+			joints.
+		*/
+		void generateContacts();
+
+		/*
+			Batched version of the pair loop of the fine collision
+			detection, which sorts the pairs by the types of their
+			bounding volumes (with a counting sort, as there are only a
+			few of them) and runs each routine on its batch.
+		*/
+		void generateBatchedContacts();
+
+		// Resolves the contacts of each awake island
+		void resolveIslands(real duration);
+
+		/*
+			Integrates all of the bodies during the given duration and
+			updates the derived data of their objects.
+		*/
+		void integrate(real duration);
+
+		/*
+			Moves the fast objects back along their motion of the step to
+			the time of impact of their first potential contact.
+		*/
+		void stopFastObjects(real duration);
+
+	public:
+
+		/*
+			Takes the iterations of the collision resolver, the restitution
+			and friction of the generated contacts, the number of potential
+			contacts for which memory is reserved up front (the buffer
+			still grows past it if needed), and the margin by which the
+			spheres of the hierarchy are enlarged (as a fraction of their
+			radius).
+		*/
+		RigidBodyWorld(
+			unsigned int velocityIterations,
+			unsigned int positionIterations,
+			real restitution,
+			real friction,
+			unsigned int potentialContactCapacity = 1000,
+			real hierarchyMargin = 0.1
+		);
+
+
+		/*
+			Adds an object to the world and returns the handle used to
+			refer to it afterwards.
+		*/
+		ObjectHandle addObject(RigidObject* object);
+
+		/*
+			Removes an object from the world (the object itself is not
+			deleted), along with the forces registered for it.
+		*/
+		void removeObject(ObjectHandle handle);
+
+		// Returns the object with the given handle, or nullptr
+		RigidObject* getObject(ObjectHandle handle) const;
+
+		unsigned int getObjectCount() const {
+			return objects.size();
+		}
+
+		// Returns the object at the given index of the dense array
+		RigidObject* getObjectAtIndex(unsigned int index) const {
+			return objects[index];
+		}
+
+
+		// Registers a force applied to a single object
+		void addForce(ObjectHandle handle, const RigidBodyForceGenerator* force);
+
+		// Removes a force applied to a single object, if it exists
+		void removeForce(ObjectHandle handle, const RigidBodyForceGenerator* force);
+
+		// Registers a force applied to all objects, like gravity
+		void addGlobalForce(const RigidBodyForceGenerator* force);
+
+		void removeGlobalForce(const RigidBodyForceGenerator* force);
+
+
+		/*
+			Registers a joint. The bodies of the joint are expected to be
+			the bodies of objects in the world.
+		*/
+		void addJoint(const Joint* joint);
+
+		void removeJoint(const Joint* joint);
 
 
 		/*
@@ -57,13 +399,204 @@ namespace pe {
 		void startFrame();
 
 		/*
-			Once the startFrame function is called, and any needed forces
-			are added afterwards (or before the startFrame is called,
-			it doesn't matetr)
+			Runs one step of the whole pipeline (forces, coarse and fine
+			collision detection, contact resolution, integration and
+			object update) for the given duration.
 		*/
 		void runPhysics(real duration);
 
+
+		/*
+			Changes the algorithm used for the coarse collision detection
+			(the bounding volume hierarchy by default), moving all of the
+			objects to it.
+		*/
+		void setBroadPhase(BROAD_PHASE broadPhase);
+
+		BROAD_PHASE getBroadPhase() const {
+			return broadPhase;
+		}
+
+		/*
+			Sets the fraction of the objects (0.5 by default) which, when
+			they all moved out of their fat spheres in the same step,
+			makes the world build the hierarchy again from scratch with
+			the linear builder rather than update it. A value above 1
+			means the hierarchy is always updated.
+		*/
+		void setLinearRebuildFraction(real fraction) {
+			linearRebuildFraction = fraction;
+		}
+
+		real getLinearRebuildFraction() const {
+			return linearRebuildFraction;
+		}
+
+		/*
+			Rebuilds the whole hierarchy top-down from the current
+			positions of the objects, which gives a better tree than
+			the one incrementally updated. Useful after adding many
+			objects at once, or periodically in very dynamic scenes.
+			Does nothing if the hierarchy is not the broad phase in use.
+		*/
+		void rebuildHierarchy();
+
+
+		/*
+			Sets the solver of the contacts (worst first by default), and
+			how the sequential impulse solvers remove penetration. All
+			the solvers take the same contacts, so they can be switched
+			at any step.
+		*/
+		void setSolver(CollisionResolver::SOLVER solver) {
+			for (CollisionResolver& resolver : resolvers) {
+				resolver.setSolver(solver);
+			}
+		}
+
+		CollisionResolver::SOLVER getSolver() const {
+			return resolvers[0].getSolver();
+		}
+
+		void setPositionCorrection(
+			CollisionResolver::POSITION_CORRECTION correction
+		) {
+			for (CollisionResolver& resolver : resolvers) {
+				resolver.setPositionCorrection(correction);
+			}
+		}
+
+		// Sets the maximum number of iterations of the resolver
+		void setSolverIterations(
+			unsigned int velocityIterations,
+			unsigned int positionIterations
+		) {
+			for (CollisionResolver& resolver : resolvers) {
+				resolver.setIterations(velocityIterations, positionIterations);
+			}
+		}
+
+		/*
+			Iterations the resolver used during the last step, on the
+			island that needed the most.
+		*/
+		unsigned int getVelocityIterationsUsed() const {
+			return velocityIterationsUsed;
+		}
+
+		unsigned int getPositionIterationsUsed() const {
+			return positionIterationsUsed;
+		}
+
+
+		/*
+			Sets whether the islands whose bodies have all stopped moving
+			are put to sleep (enabled by default). Disabling it wakes
+			the bodies that are asleep.
+		*/
+		void setSleeping(bool enabled);
+
+		bool getSleeping() const {
+			return sleeping;
+		}
+
+		// Islands found during the last step
+		const SimulationIslands& getIslands() const {
+			return islands;
+		}
+
+
+		/*
+			Sets the number of threads the islands are solved on, and the
+			hierarchy is built on, including the one running the step (1
+			by default, which doesn't start any thread). The results are
+			the same for any number of threads.
+		*/
+		void setThreadCount(unsigned int threadCount);
+
+		unsigned int getThreadCount() const {
+			return resolvers.size();
+		}
+
+
+		/*
+			Sets the fraction of the impulse of the previous step each
+			persisting contact starts with (0.8 by default). Setting it to
+			0 disables warm starting.
+		*/
+		void setWarmStartFactor(real factor) {
+			contactCache.setWarmStartFactor(factor);
+		}
+
+		real getWarmStartFactor() const {
+			return contactCache.getWarmStartFactor();
+		}
+
+
+		/*
+			Enables or disables the batched narrow phase (disabled by
+			default), which gives the same contacts, in a different order.
+		*/
+		void setBatchedNarrowPhase(bool batched) {
+			batchedNarrowPhase = batched;
+		}
+
+		bool isNarrowPhaseBatched() const {
+			return batchedNarrowPhase;
+		}
+
+		/*
+			Enables or disables the continuous collision detection of the
+			fast objects (disabled by default).
+		*/
+		void setContinuousCollision(bool enabled) {
+			continuousCollision = enabled;
+		}
+
+		bool isContinuousCollisionEnabled() const {
+			return continuousCollision;
+		}
+
+		/*
+			Sets the fraction of its bounding sphere radius (0.5 by
+			default) an object has to move by in a step for the
+			continuous collision detection to handle it.
+		*/
+		void setContinuousCollisionThreshold(real fraction) {
+			continuousCollisionThreshold = fraction;
+		}
+
+		real getContinuousCollisionThreshold() const {
+			return continuousCollisionThreshold;
+		}
+
+		// Number of objects that were fast enough during the last step
+		unsigned int getFastObjectCount() const {
+			return fastObjects.size();
+		}
+
+
+		// Contacts generated (and resolved) during the last step
+		const std::vector<Contact>& getContacts() const {
+			return contacts;
+		}
+
+		// Number of potential contacts found during the last step
+		unsigned int getPotentialContactCount() const {
+			return potentialContacts.size();
+		}
+
+		/*
+			Number of potential contacts found during the last step beyond
+			the capacity the buffer had, which then had to grow to hold
+			them (they are not lost). A value other than 0 means that the
+			simulation allocated memory during that step, and that a
+			larger capacity should be given to the constructor.
+		*/
+		unsigned int getPotentialContactOverflow() const {
+			return potentialContactOverflow;
+		}
 	};
 }
 
-#endif
\ No newline at end of file
+#endif
@@ -2,6 +2,7 @@
 #ifndef SHADER_INTERFACE_H
 #define SHADER_INTERFACE_H
 
+#include "graphicsLibraries.h"
 #include "mesh.h"
 #include <vector>
 #include <map>
@@ -0,0 +1,491 @@
+#include "simdConstraintKernels.h"
+#include "simdContactKernels.h"
+#include <cmath>
+#include <algorithm>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define PE_SIMD_X86
+#include <immintrin.h>
+#endif
+
+// Same as in simdContactKernels.cpp
+#if defined(PE_SIMD_X86) && (defined(__GNUC__) || defined(__clang__))
+#define PE_TARGET_SSE __attribute__((target("sse2")))
+#define PE_TARGET_AVX __attribute__((target("avx")))
+#else
+#define PE_TARGET_SSE
+#define PE_TARGET_AVX
+#endif
+
+using namespace pe;
+
+// The kernels work on 32 bit floats
+static_assert(sizeof(real) == sizeof(float), "The kernels need real to be float");
+
+
+// Velocities of the bodies of a block, by body, then component
+struct VelocityLanes {
+    alignas(32) real linear[2][3][CONSTRAINT_LANES];
+    alignas(32) real angular[2][3][CONSTRAINT_LANES];
+};
+
+
+static void gatherVelocities(
+    const ConstraintBlock& block,
+    const BodyVelocity* velocities,
+    VelocityLanes& lanes
+) {
+    for (unsigned int lane = 0; lane < CONSTRAINT_LANES; lane++) {
+        for (unsigned int b = 0; b < 2; b++) {
+            const BodyVelocity& velocity = velocities[block.body[b][lane]];
+            lanes.linear[b][0][lane] = velocity.linear.x;
+            lanes.linear[b][1][lane] = velocity.linear.y;
+            lanes.linear[b][2][lane] = velocity.linear.z;
+            lanes.angular[b][0][lane] = velocity.angular.x;
+            lanes.angular[b][1][lane] = velocity.angular.y;
+            lanes.angular[b][2][lane] = velocity.angular.z;
+        }
+    }
+}
+
+
+static void scatterVelocities(
+    const ConstraintBlock& block,
+    const VelocityLanes& lanes,
+    BodyVelocity* velocities
+) {
+    for (unsigned int lane = 0; lane < block.count; lane++) {
+        for (unsigned int b = 0; b < 2; b++) {
+            if (!block.isMovable[b][lane]) {
+                continue;
+            }
+            BodyVelocity& velocity = velocities[block.body[b][lane]];
+            velocity.linear = Vector3D(
+                lanes.linear[b][0][lane],
+                lanes.linear[b][1][lane],
+                lanes.linear[b][2][lane]
+            );
+            velocity.angular = Vector3D(
+                lanes.angular[b][0][lane],
+                lanes.angular[b][1][lane],
+                lanes.angular[b][2][lane]
+            );
+        }
+    }
+}
+
+
+/*
+    Relative velocity of the bodies of a lane along an axis, which is
+    the axis times the difference of the linear velocities, plus the
+    torques of the axis times the angular velocities.
+*/
+static real axisVelocity(
+    const ConstraintBlock& block,
+    const VelocityLanes& lanes,
+    unsigned int axis,
+    unsigned int lane
+) {
+    real velocity = 0;
+    for (unsigned int i = 0; i < 3; i++) {
+        velocity += block.axis[axis][i][lane] *
+            (lanes.linear[0][i][lane] - lanes.linear[1][i][lane]);
+    }
+    for (unsigned int i = 0; i < 3; i++) {
+        velocity += block.torque[0][axis][i][lane] * lanes.angular[0][i][lane];
+    }
+    for (unsigned int i = 0; i < 3; i++) {
+        velocity -= block.torque[1][axis][i][lane] * lanes.angular[1][i][lane];
+    }
+    return velocity;
+}
+
+
+// Applies an impulse along an axis to the first body, and its opposite
+static void applyAxisImpulse(
+    const ConstraintBlock& block,
+    VelocityLanes& lanes,
+    unsigned int axis,
+    real amount,
+    unsigned int lane
+) {
+    real linearOne = amount * block.inverseMass[0][lane];
+    real linearTwo = amount * block.inverseMass[1][lane];
+    for (unsigned int i = 0; i < 3; i++) {
+        lanes.linear[0][i][lane] += block.axis[axis][i][lane] * linearOne;
+        lanes.linear[1][i][lane] -= block.axis[axis][i][lane] * linearTwo;
+        lanes.angular[0][i][lane] +=
+            block.angularChange[0][axis][i][lane] * amount;
+        lanes.angular[1][i][lane] -=
+            block.angularChange[1][axis][i][lane] * amount;
+    }
+}
+
+
+// Solves the contact of a lane, returning the largest change in velocity
+static real solveLane(
+    ConstraintBlock& block,
+    VelocityLanes& lanes,
+    unsigned int lane
+) {
+    real velocityOne = axisVelocity(block, lanes, 1, lane);
+    real velocityTwo = axisVelocity(block, lanes, 2, lane);
+    real impulseOne = block.impulse[1][lane] -
+        block.effectiveMass[1][lane] * velocityOne;
+    real impulseTwo = block.impulse[2][lane] -
+        block.effectiveMass[2][lane] * velocityTwo;
+    real planarImpulse = std::sqrt(
+        impulseOne * impulseOne + impulseTwo * impulseTwo
+    );
+    real maxPlanarImpulse = block.friction[lane] * block.impulse[0][lane];
+    if (planarImpulse > maxPlanarImpulse) {
+        real scale = maxPlanarImpulse / planarImpulse;
+        impulseOne = impulseOne * scale;
+        impulseTwo = impulseTwo * scale;
+    }
+
+    real change[3];
+    change[1] = impulseOne - block.impulse[1][lane];
+    change[2] = impulseTwo - block.impulse[2][lane];
+    applyAxisImpulse(block, lanes, 1, change[1], lane);
+    applyAxisImpulse(block, lanes, 2, change[2], lane);
+    block.impulse[1][lane] = impulseOne;
+    block.impulse[2][lane] = impulseTwo;
+
+    real normalVelocity = axisVelocity(block, lanes, 0, lane);
+    real normalImpulse = std::max(block.impulse[0][lane] +
+        block.effectiveMass[0][lane] *
+        (block.targetVelocity[lane] - normalVelocity), (real)0);
+    change[0] = normalImpulse - block.impulse[0][lane];
+    applyAxisImpulse(block, lanes, 0, change[0], lane);
+    block.impulse[0][lane] = normalImpulse;
+
+    real largestChange = 0;
+    for (unsigned int axis = 0; axis < 3; axis++) {
+        if (block.effectiveMass[axis][lane] > 0) {
+            largestChange = std::max(largestChange,
+                std::abs(change[axis]) / block.effectiveMass[axis][lane]
+            );
+        }
+    }
+    return largestChange;
+}
+
+
+#ifdef PE_SIMD_X86
+
+/*
+    The SSE kernel works on the four lanes starting at the given one,
+    doing what axisVelocity, applyAxisImpulse and solveLane do.
+*/
+PE_TARGET_SSE static __m128 axisVelocitySse(
+    const ConstraintBlock& block,
+    const VelocityLanes& lanes,
+    unsigned int axis,
+    unsigned int lane
+) {
+    __m128 velocity = _mm_setzero_ps();
+    for (unsigned int i = 0; i < 3; i++) {
+        velocity = _mm_add_ps(velocity, _mm_mul_ps(
+            _mm_load_ps(block.axis[axis][i] + lane),
+            _mm_sub_ps(
+                _mm_load_ps(lanes.linear[0][i] + lane),
+                _mm_load_ps(lanes.linear[1][i] + lane)
+            )
+        ));
+    }
+    for (unsigned int i = 0; i < 3; i++) {
+        velocity = _mm_add_ps(velocity, _mm_mul_ps(
+            _mm_load_ps(block.torque[0][axis][i] + lane),
+            _mm_load_ps(lanes.angular[0][i] + lane)
+        ));
+    }
+    for (unsigned int i = 0; i < 3; i++) {
+        velocity = _mm_sub_ps(velocity, _mm_mul_ps(
+            _mm_load_ps(block.torque[1][axis][i] + lane),
+            _mm_load_ps(lanes.angular[1][i] + lane)
+        ));
+    }
+    return velocity;
+}
+
+
+PE_TARGET_SSE static void applyAxisImpulseSse(
+    const ConstraintBlock& block,
+    VelocityLanes& lanes,
+    unsigned int axis,
+    __m128 amount,
+    unsigned int lane
+) {
+    __m128 linearOne = _mm_mul_ps(
+        amount, _mm_load_ps(block.inverseMass[0] + lane)
+    );
+    __m128 linearTwo = _mm_mul_ps(
+        amount, _mm_load_ps(block.inverseMass[1] + lane)
+    );
+    for (unsigned int i = 0; i < 3; i++) {
+        __m128 direction = _mm_load_ps(block.axis[axis][i] + lane);
+        _mm_store_ps(lanes.linear[0][i] + lane, _mm_add_ps(
+            _mm_load_ps(lanes.linear[0][i] + lane),
+            _mm_mul_ps(direction, linearOne)
+        ));
+        _mm_store_ps(lanes.linear[1][i] + lane, _mm_sub_ps(
+            _mm_load_ps(lanes.linear[1][i] + lane),
+            _mm_mul_ps(direction, linearTwo)
+        ));
+        _mm_store_ps(lanes.angular[0][i] + lane, _mm_add_ps(
+            _mm_load_ps(lanes.angular[0][i] + lane),
+            _mm_mul_ps(_mm_load_ps(block.angularChange[0][axis][i] + lane),
+                amount)
+        ));
+        _mm_store_ps(lanes.angular[1][i] + lane, _mm_sub_ps(
+            _mm_load_ps(lanes.angular[1][i] + lane),
+            _mm_mul_ps(_mm_load_ps(block.angularChange[1][axis][i] + lane),
+                amount)
+        ));
+    }
+}
+
+
+// Stores the largest change in velocity of each lane in the given array
+PE_TARGET_SSE static void solveLanesSse(
+    ConstraintBlock& block,
+    VelocityLanes& lanes,
+    unsigned int lane,
+    real* changes
+) {
+    __m128 impulseOne = _mm_sub_ps(
+        _mm_load_ps(block.impulse[1] + lane),
+        _mm_mul_ps(_mm_load_ps(block.effectiveMass[1] + lane),
+            axisVelocitySse(block, lanes, 1, lane))
+    );
+    __m128 impulseTwo = _mm_sub_ps(
+        _mm_load_ps(block.impulse[2] + lane),
+        _mm_mul_ps(_mm_load_ps(block.effectiveMass[2] + lane),
+            axisVelocitySse(block, lanes, 2, lane))
+    );
+    __m128 planarImpulse = _mm_sqrt_ps(_mm_add_ps(
+        _mm_mul_ps(impulseOne, impulseOne),
+        _mm_mul_ps(impulseTwo, impulseTwo)
+    ));
+    __m128 maxPlanarImpulse = _mm_mul_ps(
+        _mm_load_ps(block.friction + lane),
+        _mm_load_ps(block.impulse[0] + lane)
+    );
+
+    // The scale is only used in the lanes going over the limit
+    __m128 over = _mm_cmpgt_ps(planarImpulse, maxPlanarImpulse);
+    __m128 scale = _mm_div_ps(maxPlanarImpulse, planarImpulse);
+    impulseOne = _mm_or_ps(
+        _mm_and_ps(over, _mm_mul_ps(impulseOne, scale)),
+        _mm_andnot_ps(over, impulseOne)
+    );
+    impulseTwo = _mm_or_ps(
+        _mm_and_ps(over, _mm_mul_ps(impulseTwo, scale)),
+        _mm_andnot_ps(over, impulseTwo)
+    );
+
+    __m128 change[3];
+    change[1] = _mm_sub_ps(impulseOne, _mm_load_ps(block.impulse[1] + lane));
+    change[2] = _mm_sub_ps(impulseTwo, _mm_load_ps(block.impulse[2] + lane));
+    applyAxisImpulseSse(block, lanes, 1, change[1], lane);
+    applyAxisImpulseSse(block, lanes, 2, change[2], lane);
+    _mm_store_ps(block.impulse[1] + lane, impulseOne);
+    _mm_store_ps(block.impulse[2] + lane, impulseTwo);
+
+    __m128 normalImpulse = _mm_max_ps(_mm_setzero_ps(), _mm_add_ps(
+        _mm_load_ps(block.impulse[0] + lane),
+        _mm_mul_ps(_mm_load_ps(block.effectiveMass[0] + lane), _mm_sub_ps(
+            _mm_load_ps(block.targetVelocity + lane),
+            axisVelocitySse(block, lanes, 0, lane)
+        ))
+    ));
+    change[0] = _mm_sub_ps(normalImpulse, _mm_load_ps(block.impulse[0] + lane));
+    applyAxisImpulseSse(block, lanes, 0, change[0], lane);
+    _mm_store_ps(block.impulse[0] + lane, normalImpulse);
+
+    // The sign bit is cleared for the absolute value
+    __m128 sign = _mm_set1_ps(-0.0f);
+    __m128 largestChange = _mm_setzero_ps();
+    for (unsigned int axis = 0; axis < 3; axis++) {
+        __m128 mass = _mm_load_ps(block.effectiveMass[axis] + lane);
+        __m128 velocityChange = _mm_and_ps(
+            _mm_cmpgt_ps(mass, _mm_setzero_ps()),
+            _mm_div_ps(_mm_andnot_ps(sign, change[axis]), mass)
+        );
+        largestChange = _mm_max_ps(largestChange, velocityChange);
+    }
+    _mm_store_ps(changes + lane, largestChange);
+}
+
+
+// Same with the eight lanes of the block
+PE_TARGET_AVX static __m256 axisVelocityAvx(
+    const ConstraintBlock& block,
+    const VelocityLanes& lanes,
+    unsigned int axis
+) {
+    __m256 velocity = _mm256_setzero_ps();
+    for (unsigned int i = 0; i < 3; i++) {
+        velocity = _mm256_add_ps(velocity, _mm256_mul_ps(
+            _mm256_load_ps(block.axis[axis][i]),
+            _mm256_sub_ps(
+                _mm256_load_ps(lanes.linear[0][i]),
+                _mm256_load_ps(lanes.linear[1][i])
+            )
+        ));
+    }
+    for (unsigned int i = 0; i < 3; i++) {
+        velocity = _mm256_add_ps(velocity, _mm256_mul_ps(
+            _mm256_load_ps(block.torque[0][axis][i]),
+            _mm256_load_ps(lanes.angular[0][i])
+        ));
+    }
+    for (unsigned int i = 0; i < 3; i++) {
+        velocity = _mm256_sub_ps(velocity, _mm256_mul_ps(
+            _mm256_load_ps(block.torque[1][axis][i]),
+            _mm256_load_ps(lanes.angular[1][i])
+        ));
+    }
+    return velocity;
+}
+
+
+PE_TARGET_AVX static void applyAxisImpulseAvx(
+    const ConstraintBlock& block,
+    VelocityLanes& lanes,
+    unsigned int axis,
+    __m256 amount
+) {
+    __m256 linearOne = _mm256_mul_ps(
+        amount, _mm256_load_ps(block.inverseMass[0])
+    );
+    __m256 linearTwo = _mm256_mul_ps(
+        amount, _mm256_load_ps(block.inverseMass[1])
+    );
+    for (unsigned int i = 0; i < 3; i++) {
+        __m256 direction = _mm256_load_ps(block.axis[axis][i]);
+        _mm256_store_ps(lanes.linear[0][i], _mm256_add_ps(
+            _mm256_load_ps(lanes.linear[0][i]),
+            _mm256_mul_ps(direction, linearOne)
+        ));
+        _mm256_store_ps(lanes.linear[1][i], _mm256_sub_ps(
+            _mm256_load_ps(lanes.linear[1][i]),
+            _mm256_mul_ps(direction, linearTwo)
+        ));
+        _mm256_store_ps(lanes.angular[0][i], _mm256_add_ps(
+            _mm256_load_ps(lanes.angular[0][i]),
+            _mm256_mul_ps(_mm256_load_ps(block.angularChange[0][axis][i]),
+                amount)
+        ));
+        _mm256_store_ps(lanes.angular[1][i], _mm256_sub_ps(
+            _mm256_load_ps(lanes.angular[1][i]),
+            _mm256_mul_ps(_mm256_load_ps(block.angularChange[1][axis][i]),
+                amount)
+        ));
+    }
+}
+
+
+PE_TARGET_AVX static void solveLanesAvx(
+    ConstraintBlock& block,
+    VelocityLanes& lanes,
+    real* changes
+) {
+    __m256 impulseOne = _mm256_sub_ps(
+        _mm256_load_ps(block.impulse[1]),
+        _mm256_mul_ps(_mm256_load_ps(block.effectiveMass[1]),
+            axisVelocityAvx(block, lanes, 1))
+    );
+    __m256 impulseTwo = _mm256_sub_ps(
+        _mm256_load_ps(block.impulse[2]),
+        _mm256_mul_ps(_mm256_load_ps(block.effectiveMass[2]),
+            axisVelocityAvx(block, lanes, 2))
+    );
+    __m256 planarImpulse = _mm256_sqrt_ps(_mm256_add_ps(
+        _mm256_mul_ps(impulseOne, impulseOne),
+        _mm256_mul_ps(impulseTwo, impulseTwo)
+    ));
+    __m256 maxPlanarImpulse = _mm256_mul_ps(
+        _mm256_load_ps(block.friction),
+        _mm256_load_ps(block.impulse[0])
+    );
+
+    __m256 over = _mm256_cmp_ps(planarImpulse, maxPlanarImpulse, _CMP_GT_OQ);
+    __m256 scale = _mm256_div_ps(maxPlanarImpulse, planarImpulse);
+    impulseOne = _mm256_or_ps(
+        _mm256_and_ps(over, _mm256_mul_ps(impulseOne, scale)),
+        _mm256_andnot_ps(over, impulseOne)
+    );
+    impulseTwo = _mm256_or_ps(
+        _mm256_and_ps(over, _mm256_mul_ps(impulseTwo, scale)),
+        _mm256_andnot_ps(over, impulseTwo)
+    );
+
+    __m256 change[3];
+    change[1] = _mm256_sub_ps(impulseOne, _mm256_load_ps(block.impulse[1]));
+    change[2] = _mm256_sub_ps(impulseTwo, _mm256_load_ps(block.impulse[2]));
+    applyAxisImpulseAvx(block, lanes, 1, change[1]);
+    applyAxisImpulseAvx(block, lanes, 2, change[2]);
+    _mm256_store_ps(block.impulse[1], impulseOne);
+    _mm256_store_ps(block.impulse[2], impulseTwo);
+
+    __m256 normalImpulse = _mm256_max_ps(_mm256_setzero_ps(), _mm256_add_ps(
+        _mm256_load_ps(block.impulse[0]),
+        _mm256_mul_ps(_mm256_load_ps(block.effectiveMass[0]), _mm256_sub_ps(
+            _mm256_load_ps(block.targetVelocity),
+            axisVelocityAvx(block, lanes, 0)
+        ))
+    ));
+    change[0] = _mm256_sub_ps(normalImpulse, _mm256_load_ps(block.impulse[0]));
+    applyAxisImpulseAvx(block, lanes, 0, change[0]);
+    _mm256_store_ps(block.impulse[0], normalImpulse);
+
+    __m256 sign = _mm256_set1_ps(-0.0f);
+    __m256 largestChange = _mm256_setzero_ps();
+    for (unsigned int axis = 0; axis < 3; axis++) {
+        __m256 mass = _mm256_load_ps(block.effectiveMass[axis]);
+        __m256 velocityChange = _mm256_and_ps(
+            _mm256_cmp_ps(mass, _mm256_setzero_ps(), _CMP_GT_OQ),
+            _mm256_div_ps(_mm256_andnot_ps(sign, change[axis]), mass)
+        );
+        largestChange = _mm256_max_ps(largestChange, velocityChange);
+    }
+    _mm256_store_ps(changes, largestChange);
+}
+
+#endif
+
+
+real pe::solveConstraintBlock(
+    ConstraintBlock& block,
+    BodyVelocity* velocities
+) {
+    VelocityLanes lanes;
+    gatherVelocities(block, velocities, lanes);
+
+    alignas(32) real changes[CONSTRAINT_LANES];
+    SIMD_LEVEL level = getSimdLevel();
+#ifdef PE_SIMD_X86
+    if (level == SIMD_LEVEL::AVX) {
+        solveLanesAvx(block, lanes, changes);
+    }
+    else if (level == SIMD_LEVEL::SSE) {
+        solveLanesSse(block, lanes, 0, changes);
+        solveLanesSse(block, lanes, 4, changes);
+    }
+#endif
+    if (level == SIMD_LEVEL::SCALAR) {
+        for (unsigned int lane = 0; lane < CONSTRAINT_LANES; lane++) {
+            changes[lane] = solveLane(block, lanes, lane);
+        }
+    }
+
+    scatterVelocities(block, lanes, velocities);
+
+    real largestChange = 0;
+    for (unsigned int lane = 0; lane < block.count; lane++) {
+        largestChange = std::max(largestChange, changes[lane]);
+    }
+    return largestChange;
+}
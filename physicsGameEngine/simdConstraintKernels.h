@@ -0,0 +1,91 @@
+/*
+    Header file for the SIMD kernels of the graph colored solver of the
+    collision resolver (see collisionResolver.h), which apply the
+    sequential impulses of 8 contacts at a time.
+    The contacts of a color share no body that can move, so the contacts
+    of a block can all be solved at once: the velocities of their bodies
+    are gathered into arrays of each component (structure of arrays),
+    their impulses are computed with SSE (4 contacts per instruction) or
+    AVX (8 contacts per instruction), and the velocities are written
+    back. The instruction set is the one used by the kernels of the
+    narrow phase (see simdContactKernels.h), and all of them do the same
+    operations in the same order, so they give the same impulses.
+*/
+
+#ifndef SIMD_CONSTRAINT_KERNELS_H
+#define SIMD_CONSTRAINT_KERNELS_H
+
+#include "vector3D.h"
+
+namespace pe {
+
+    // Number of contacts in a block
+    const unsigned int CONSTRAINT_LANES = 8;
+
+
+    // Velocities of a body while the solver works on them
+    struct BodyVelocity {
+        Vector3D linear;
+        Vector3D angular;
+    };
+
+
+    /*
+        The contacts of a block, with a separate array for each component
+        of each contact (a lane), in the contact basis: axis 0 is the
+        normal, and 1 and 2 are the tangents. The lanes after the last
+        contact are all zeros, which gives them no impulse.
+    */
+    struct ConstraintBlock {
+
+        // Axes of each contact, by axis, then component
+        alignas(32) real axis[3][3][CONSTRAINT_LANES];
+
+        /*
+            Torque of a unit impulse along each axis about each body
+            (the relative contact position times the axis), and the
+            change in angular velocity it makes, by body, axis, then
+            component.
+        */
+        alignas(32) real torque[2][3][3][CONSTRAINT_LANES];
+        alignas(32) real angularChange[2][3][3][CONSTRAINT_LANES];
+
+        // Zero for the bodies that can't move (or are missing)
+        alignas(32) real inverseMass[2][CONSTRAINT_LANES];
+
+        alignas(32) real effectiveMass[3][CONSTRAINT_LANES];
+        alignas(32) real friction[CONSTRAINT_LANES];
+        alignas(32) real targetVelocity[CONSTRAINT_LANES];
+
+        // Total impulse so far along each axis
+        alignas(32) real impulse[3][CONSTRAINT_LANES];
+
+        /*
+            Index of the velocities of the bodies of each contact, and
+            whether they are written back (only for the bodies that can
+            move, as a body that can't may be in any number of contacts
+            of the color).
+        */
+        unsigned int body[2][CONSTRAINT_LANES];
+        bool isMovable[2][CONSTRAINT_LANES];
+
+        // Index of each contact, and the number of lanes used
+        unsigned int contact[CONSTRAINT_LANES];
+        unsigned int count;
+    };
+
+
+    /*
+        Applies one iteration of sequential impulses to the contacts of
+        the block with the current instruction set, as the sequential
+        impulse solver does (friction first, then the normal impulse),
+        updating the velocities of their bodies. Returns the largest
+        change in velocity an impulse made.
+    */
+    real solveConstraintBlock(
+        ConstraintBlock& block,
+        BodyVelocity* velocities
+    );
+}
+
+#endif
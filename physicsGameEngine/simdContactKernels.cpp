@@ -0,0 +1,906 @@
+#include "simdContactKernels.h"
+#include "gjk.h"
+#include <cmath>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define PE_SIMD_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+/*
+    GCC and Clang only allow the intrinsics of an instruction set in the
+    functions compiled for it, while MSVC allows them anywhere.
+*/
+#if defined(PE_SIMD_X86) && (defined(__GNUC__) || defined(__clang__))
+#define PE_TARGET_SSE __attribute__((target("sse2")))
+#define PE_TARGET_AVX __attribute__((target("avx")))
+#else
+#define PE_TARGET_SSE
+#define PE_TARGET_AVX
+#endif
+
+// Hint to start loading the memory at the given address into the cache
+#if defined(__GNUC__) || defined(__clang__)
+#define PE_PREFETCH(address) __builtin_prefetch(address)
+#elif defined(PE_SIMD_X86)
+#define PE_PREFETCH(address) _mm_prefetch((const char*)(address), _MM_HINT_T0)
+#else
+#define PE_PREFETCH(address)
+#endif
+
+using namespace pe;
+
+// The kernels work on 32 bit floats
+static_assert(sizeof(real) == sizeof(float), "The kernels need real to be float");
+
+// Number of pairs gathered and tested at once
+static const unsigned int BLOCK_SIZE = 8;
+
+/*
+    Number of axes of the separating axis test of two boxes tested at
+    once, the 15 axes and an unused one.
+*/
+static const unsigned int AXIS_LANES = 16;
+
+
+static SIMD_LEVEL detectSimdLevel() {
+#ifdef PE_SIMD_X86
+#ifdef _MSC_VER
+    int info[4];
+    __cpuid(info, 1);
+    bool sse = (info[3] & (1 << 26)) != 0;
+    // AVX also needs the operating system to save its registers
+    bool avx = (info[2] & (1 << 28)) && (info[2] & (1 << 27)) &&
+        (_xgetbv(0) & 6) == 6;
+#else
+    __builtin_cpu_init();
+    bool sse = __builtin_cpu_supports("sse2");
+    bool avx = __builtin_cpu_supports("avx");
+#endif
+    if (avx) {
+        return SIMD_LEVEL::AVX;
+    }
+    if (sse) {
+        return SIMD_LEVEL::SSE;
+    }
+#endif
+    return SIMD_LEVEL::SCALAR;
+}
+
+
+static SIMD_LEVEL supportedLevel = detectSimdLevel();
+static SIMD_LEVEL currentLevel = supportedLevel;
+
+
+SIMD_LEVEL pe::getSupportedSimdLevel() {
+    return supportedLevel;
+}
+
+
+SIMD_LEVEL pe::getSimdLevel() {
+    return currentLevel;
+}
+
+
+void pe::setSimdLevel(SIMD_LEVEL level) {
+    currentLevel = (unsigned int)level <= (unsigned int)supportedLevel ?
+        level : supportedLevel;
+}
+
+
+/*
+    The data of a block of sphere and sphere pairs, with a separate array
+    for each component, followed by the results of the pairs that hit.
+*/
+struct SphereSphereBlock {
+    alignas(32) real positionOne[3][BLOCK_SIZE];
+    alignas(32) real positionTwo[3][BLOCK_SIZE];
+    alignas(32) real radiusOne[BLOCK_SIZE];
+    alignas(32) real radiusTwo[BLOCK_SIZE];
+
+    alignas(32) real normal[3][BLOCK_SIZE];
+    alignas(32) real point[3][BLOCK_SIZE];
+    alignas(32) real penetration[BLOCK_SIZE];
+};
+
+
+/*
+    Same for the box and sphere pairs, where the transform of the box is
+    stored as its twelve coefficients.
+*/
+struct BoxSphereBlock {
+    alignas(32) real transform[12][BLOCK_SIZE];
+    alignas(32) real halfSize[3][BLOCK_SIZE];
+    alignas(32) real centre[3][BLOCK_SIZE];
+    alignas(32) real radius[BLOCK_SIZE];
+
+    alignas(32) real normal[3][BLOCK_SIZE];
+    alignas(32) real point[3][BLOCK_SIZE];
+    alignas(32) real penetration[BLOCK_SIZE];
+};
+
+
+/*
+    Square of the length under which an axis (the cross product of two
+    almost parallel axes) is skipped, and the penetration it is given.
+*/
+static const real MIN_AXIS_SQUARED = (real)0.0001;
+static const real NO_PENETRATION = (real)REAL_MAX;
+
+
+/*
+    The axes of the separating axis test of a pair of boxes, in the order
+    of the scalar boxAndBox, each in the coordinates of box one and in
+    those of box two (with a separate array for each component), followed
+    by the penetration of the boxes along each axis.
+    The axes are only found from the rotation of box two relative to box
+    one, which is computed once: in the coordinates of box one, its own
+    axes are the unit vectors, the axes of box two are the columns of the
+    rotation, and the cross products of the two only swap and negate
+    their coefficients, and the other way around in the coordinates of
+    box two. The projections of the boxes onto an axis are then its
+    coefficients weighted by the half sizes, without any other product.
+*/
+struct BoxBoxAxes {
+    alignas(32) real axisOne[3][AXIS_LANES];
+    alignas(32) real axisTwo[3][AXIS_LANES];
+    alignas(32) real penetration[AXIS_LANES];
+
+    real halfSizeOne[3];
+    real halfSizeTwo[3];
+
+    // Vector between the centres, in the coordinates of box one
+    real toCentre[3];
+};
+
+
+#ifdef PE_SIMD_X86
+
+/*
+    Tests the four pairs of the block starting at the given lane, and
+    returns a mask with a bit set for each pair that hit, as the scalar
+    sphereAndSphere does.
+*/
+PE_TARGET_SSE static unsigned int sphereAndSphereSse(
+    SphereSphereBlock& block,
+    unsigned int lane
+) {
+    __m128 midline[3];
+    for (unsigned int i = 0; i < 3; i++) {
+        midline[i] = _mm_sub_ps(
+            _mm_load_ps(block.positionOne[i] + lane),
+            _mm_load_ps(block.positionTwo[i] + lane)
+        );
+    }
+    __m128 size = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(
+        _mm_mul_ps(midline[0], midline[0]),
+        _mm_mul_ps(midline[1], midline[1])),
+        _mm_mul_ps(midline[2], midline[2])
+    ));
+    __m128 radius = _mm_add_ps(
+        _mm_load_ps(block.radiusOne + lane),
+        _mm_load_ps(block.radiusTwo + lane)
+    );
+    __m128 hit = _mm_and_ps(
+        _mm_cmpgt_ps(size, _mm_setzero_ps()),
+        _mm_cmplt_ps(size, radius)
+    );
+
+    __m128 inverse = _mm_div_ps(_mm_set1_ps(1), size);
+    __m128 half = _mm_set1_ps((real)0.5);
+    for (unsigned int i = 0; i < 3; i++) {
+        _mm_store_ps(block.normal[i] + lane, _mm_mul_ps(midline[i], inverse));
+        _mm_store_ps(block.point[i] + lane, _mm_add_ps(
+            _mm_load_ps(block.positionTwo[i] + lane),
+            _mm_mul_ps(midline[i], half)
+        ));
+    }
+    _mm_store_ps(block.penetration + lane, _mm_sub_ps(radius, size));
+
+    return _mm_movemask_ps(hit);
+}
+
+
+// Same with the eight pairs of the block
+PE_TARGET_AVX static unsigned int sphereAndSphereAvx(
+    SphereSphereBlock& block
+) {
+    __m256 midline[3];
+    for (unsigned int i = 0; i < 3; i++) {
+        midline[i] = _mm256_sub_ps(
+            _mm256_load_ps(block.positionOne[i]),
+            _mm256_load_ps(block.positionTwo[i])
+        );
+    }
+    __m256 size = _mm256_sqrt_ps(_mm256_add_ps(_mm256_add_ps(
+        _mm256_mul_ps(midline[0], midline[0]),
+        _mm256_mul_ps(midline[1], midline[1])),
+        _mm256_mul_ps(midline[2], midline[2])
+    ));
+    __m256 radius = _mm256_add_ps(
+        _mm256_load_ps(block.radiusOne),
+        _mm256_load_ps(block.radiusTwo)
+    );
+    __m256 hit = _mm256_and_ps(
+        _mm256_cmp_ps(size, _mm256_setzero_ps(), _CMP_GT_OQ),
+        _mm256_cmp_ps(size, radius, _CMP_LT_OQ)
+    );
+
+    __m256 inverse = _mm256_div_ps(_mm256_set1_ps(1), size);
+    __m256 half = _mm256_set1_ps((real)0.5);
+    for (unsigned int i = 0; i < 3; i++) {
+        _mm256_store_ps(block.normal[i], _mm256_mul_ps(midline[i], inverse));
+        _mm256_store_ps(block.point[i], _mm256_add_ps(
+            _mm256_load_ps(block.positionTwo[i]),
+            _mm256_mul_ps(midline[i], half)
+        ));
+    }
+    _mm256_store_ps(block.penetration, _mm256_sub_ps(radius, size));
+
+    return _mm256_movemask_ps(hit);
+}
+
+
+/*
+    Tests the four pairs of the block starting at the given lane, as the
+    scalar boxAndSphere does: the centre of the sphere is moved to the
+    coordinates of the box, clamped to the box to find its closest point,
+    and the pair hits if that point is within the radius.
+*/
+PE_TARGET_SSE static unsigned int boxAndSphereSse(
+    BoxSphereBlock& block,
+    unsigned int lane
+) {
+    __m128 m[12];
+    for (unsigned int i = 0; i < 12; i++) {
+        m[i] = _mm_load_ps(block.transform[i] + lane);
+    }
+    __m128 centre[3], halfSize[3];
+    for (unsigned int i = 0; i < 3; i++) {
+        centre[i] = _mm_load_ps(block.centre[i] + lane);
+        halfSize[i] = _mm_load_ps(block.halfSize[i] + lane);
+    }
+    __m128 radius = _mm_load_ps(block.radius + lane);
+
+    // Centre in the coordinates of the box
+    __m128 translated[3] = {
+        _mm_sub_ps(centre[0], m[3]),
+        _mm_sub_ps(centre[1], m[7]),
+        _mm_sub_ps(centre[2], m[11])
+    };
+    __m128 relative[3];
+    for (unsigned int i = 0; i < 3; i++) {
+        relative[i] = _mm_add_ps(_mm_add_ps(
+            _mm_mul_ps(translated[0], m[i]),
+            _mm_mul_ps(translated[1], m[i + 4])),
+            _mm_mul_ps(translated[2], m[i + 8])
+        );
+    }
+
+    // Spheres outside of the box along one of its axes miss it
+    __m128 signMask = _mm_set1_ps(-0.0f);
+    __m128 miss = _mm_setzero_ps();
+    __m128 closest[3];
+    __m128 distance = _mm_setzero_ps();
+    for (unsigned int i = 0; i < 3; i++) {
+        miss = _mm_or_ps(miss, _mm_cmpgt_ps(
+            _mm_sub_ps(_mm_andnot_ps(signMask, relative[i]), radius),
+            halfSize[i]
+        ));
+        closest[i] = _mm_max_ps(
+            _mm_min_ps(relative[i], halfSize[i]),
+            _mm_sub_ps(_mm_setzero_ps(), halfSize[i])
+        );
+        __m128 offset = _mm_sub_ps(closest[i], relative[i]);
+        distance = _mm_add_ps(distance, _mm_mul_ps(offset, offset));
+    }
+    __m128 hit = _mm_andnot_ps(
+        miss, _mm_cmple_ps(distance, _mm_mul_ps(radius, radius))
+    );
+
+    // Closest point in world coordinates, and the normal towards the box
+    __m128 normal[3];
+    for (unsigned int i = 0; i < 3; i++) {
+        __m128 point = _mm_add_ps(_mm_add_ps(_mm_add_ps(
+            _mm_mul_ps(m[i * 4], closest[0]),
+            _mm_mul_ps(m[i * 4 + 1], closest[1])),
+            _mm_mul_ps(m[i * 4 + 2], closest[2])),
+            m[i * 4 + 3]
+        );
+        _mm_store_ps(block.point[i] + lane, point);
+        normal[i] = _mm_sub_ps(point, centre[i]);
+    }
+    __m128 length = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(
+        _mm_mul_ps(normal[0], normal[0]),
+        _mm_mul_ps(normal[1], normal[1])),
+        _mm_mul_ps(normal[2], normal[2])
+    ));
+    // A zero normal is left as it is, as Vector3D::normalize does
+    __m128 scale = _mm_div_ps(_mm_set1_ps(1), length);
+    __m128 nonZero = _mm_cmpgt_ps(length, _mm_setzero_ps());
+    for (unsigned int i = 0; i < 3; i++) {
+        __m128 scaled = _mm_mul_ps(normal[i], scale);
+        _mm_store_ps(block.normal[i] + lane, _mm_or_ps(
+            _mm_and_ps(nonZero, scaled), _mm_andnot_ps(nonZero, normal[i])
+        ));
+    }
+    _mm_store_ps(
+        block.penetration + lane, _mm_sub_ps(radius, _mm_sqrt_ps(distance))
+    );
+
+    return _mm_movemask_ps(hit);
+}
+
+
+// Same with the eight pairs of the block
+PE_TARGET_AVX static unsigned int boxAndSphereAvx(BoxSphereBlock& block) {
+    __m256 m[12];
+    for (unsigned int i = 0; i < 12; i++) {
+        m[i] = _mm256_load_ps(block.transform[i]);
+    }
+    __m256 centre[3], halfSize[3];
+    for (unsigned int i = 0; i < 3; i++) {
+        centre[i] = _mm256_load_ps(block.centre[i]);
+        halfSize[i] = _mm256_load_ps(block.halfSize[i]);
+    }
+    __m256 radius = _mm256_load_ps(block.radius);
+
+    __m256 translated[3] = {
+        _mm256_sub_ps(centre[0], m[3]),
+        _mm256_sub_ps(centre[1], m[7]),
+        _mm256_sub_ps(centre[2], m[11])
+    };
+    __m256 relative[3];
+    for (unsigned int i = 0; i < 3; i++) {
+        relative[i] = _mm256_add_ps(_mm256_add_ps(
+            _mm256_mul_ps(translated[0], m[i]),
+            _mm256_mul_ps(translated[1], m[i + 4])),
+            _mm256_mul_ps(translated[2], m[i + 8])
+        );
+    }
+
+    __m256 signMask = _mm256_set1_ps(-0.0f);
+    __m256 miss = _mm256_setzero_ps();
+    __m256 closest[3];
+    __m256 distance = _mm256_setzero_ps();
+    for (unsigned int i = 0; i < 3; i++) {
+        miss = _mm256_or_ps(miss, _mm256_cmp_ps(
+            _mm256_sub_ps(_mm256_andnot_ps(signMask, relative[i]), radius),
+            halfSize[i], _CMP_GT_OQ
+        ));
+        closest[i] = _mm256_max_ps(
+            _mm256_min_ps(relative[i], halfSize[i]),
+            _mm256_sub_ps(_mm256_setzero_ps(), halfSize[i])
+        );
+        __m256 offset = _mm256_sub_ps(closest[i], relative[i]);
+        distance = _mm256_add_ps(distance, _mm256_mul_ps(offset, offset));
+    }
+    __m256 hit = _mm256_andnot_ps(miss, _mm256_cmp_ps(
+        distance, _mm256_mul_ps(radius, radius), _CMP_LE_OQ
+    ));
+
+    __m256 normal[3];
+    for (unsigned int i = 0; i < 3; i++) {
+        __m256 point = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(
+            _mm256_mul_ps(m[i * 4], closest[0]),
+            _mm256_mul_ps(m[i * 4 + 1], closest[1])),
+            _mm256_mul_ps(m[i * 4 + 2], closest[2])),
+            m[i * 4 + 3]
+        );
+        _mm256_store_ps(block.point[i], point);
+        normal[i] = _mm256_sub_ps(point, centre[i]);
+    }
+    __m256 length = _mm256_sqrt_ps(_mm256_add_ps(_mm256_add_ps(
+        _mm256_mul_ps(normal[0], normal[0]),
+        _mm256_mul_ps(normal[1], normal[1])),
+        _mm256_mul_ps(normal[2], normal[2])
+    ));
+    __m256 scale = _mm256_div_ps(_mm256_set1_ps(1), length);
+    __m256 nonZero = _mm256_cmp_ps(length, _mm256_setzero_ps(), _CMP_GT_OQ);
+    for (unsigned int i = 0; i < 3; i++) {
+        _mm256_store_ps(block.normal[i], _mm256_blendv_ps(
+            normal[i], _mm256_mul_ps(normal[i], scale), nonZero
+        ));
+    }
+    _mm256_store_ps(
+        block.penetration, _mm256_sub_ps(radius, _mm256_sqrt_ps(distance))
+    );
+
+    return _mm256_movemask_ps(hit);
+}
+
+/*
+    Finds the penetration of the boxes along the four axes starting at
+    the given lane, as the scalar axisPenetration does, and returns a
+    mask with a bit set for each axis that separates them.
+*/
+PE_TARGET_SSE static unsigned int boxAndBoxSse(
+    BoxBoxAxes& axes,
+    unsigned int lane
+) {
+    __m128 signMask = _mm_set1_ps(-0.0f);
+    __m128 projectionOne = _mm_setzero_ps();
+    __m128 projectionTwo = _mm_setzero_ps();
+    __m128 distance = _mm_setzero_ps();
+    __m128 lengthSquared = _mm_setzero_ps();
+    for (unsigned int i = 0; i < 3; i++) {
+        __m128 axisOne = _mm_load_ps(axes.axisOne[i] + lane);
+        __m128 axisTwo = _mm_load_ps(axes.axisTwo[i] + lane);
+        projectionOne = _mm_add_ps(projectionOne, _mm_mul_ps(
+            _mm_set1_ps(axes.halfSizeOne[i]), _mm_andnot_ps(signMask, axisOne)
+        ));
+        projectionTwo = _mm_add_ps(projectionTwo, _mm_mul_ps(
+            _mm_set1_ps(axes.halfSizeTwo[i]), _mm_andnot_ps(signMask, axisTwo)
+        ));
+        distance = _mm_add_ps(
+            distance, _mm_mul_ps(_mm_set1_ps(axes.toCentre[i]), axisOne)
+        );
+        lengthSquared = _mm_add_ps(
+            lengthSquared, _mm_mul_ps(axisOne, axisOne)
+        );
+    }
+    __m128 penetration = _mm_div_ps(
+        _mm_sub_ps(
+            _mm_add_ps(projectionOne, projectionTwo),
+            _mm_andnot_ps(signMask, distance)
+        ),
+        _mm_sqrt_ps(lengthSquared)
+    );
+
+    // The axes too short to be normalized are skipped
+    __m128 valid = _mm_cmpge_ps(lengthSquared, _mm_set1_ps(MIN_AXIS_SQUARED));
+    penetration = _mm_or_ps(
+        _mm_and_ps(valid, penetration),
+        _mm_andnot_ps(valid, _mm_set1_ps(NO_PENETRATION))
+    );
+    _mm_store_ps(axes.penetration + lane, penetration);
+
+    return _mm_movemask_ps(_mm_cmplt_ps(penetration, _mm_setzero_ps()));
+}
+
+
+// Same with the eight axes starting at the given lane
+PE_TARGET_AVX static unsigned int boxAndBoxAvx(
+    BoxBoxAxes& axes,
+    unsigned int lane
+) {
+    __m256 signMask = _mm256_set1_ps(-0.0f);
+    __m256 projectionOne = _mm256_setzero_ps();
+    __m256 projectionTwo = _mm256_setzero_ps();
+    __m256 distance = _mm256_setzero_ps();
+    __m256 lengthSquared = _mm256_setzero_ps();
+    for (unsigned int i = 0; i < 3; i++) {
+        __m256 axisOne = _mm256_load_ps(axes.axisOne[i] + lane);
+        __m256 axisTwo = _mm256_load_ps(axes.axisTwo[i] + lane);
+        projectionOne = _mm256_add_ps(projectionOne, _mm256_mul_ps(
+            _mm256_set1_ps(axes.halfSizeOne[i]),
+            _mm256_andnot_ps(signMask, axisOne)
+        ));
+        projectionTwo = _mm256_add_ps(projectionTwo, _mm256_mul_ps(
+            _mm256_set1_ps(axes.halfSizeTwo[i]),
+            _mm256_andnot_ps(signMask, axisTwo)
+        ));
+        distance = _mm256_add_ps(
+            distance, _mm256_mul_ps(_mm256_set1_ps(axes.toCentre[i]), axisOne)
+        );
+        lengthSquared = _mm256_add_ps(
+            lengthSquared, _mm256_mul_ps(axisOne, axisOne)
+        );
+    }
+    __m256 penetration = _mm256_div_ps(
+        _mm256_sub_ps(
+            _mm256_add_ps(projectionOne, projectionTwo),
+            _mm256_andnot_ps(signMask, distance)
+        ),
+        _mm256_sqrt_ps(lengthSquared)
+    );
+
+    __m256 valid = _mm256_cmp_ps(
+        lengthSquared, _mm256_set1_ps(MIN_AXIS_SQUARED), _CMP_GE_OQ
+    );
+    penetration = _mm256_blendv_ps(
+        _mm256_set1_ps(NO_PENETRATION), penetration, valid
+    );
+    _mm256_store_ps(axes.penetration + lane, penetration);
+
+    return _mm256_movemask_ps(
+        _mm256_cmp_ps(penetration, _mm256_setzero_ps(), _CMP_LT_OQ)
+    );
+}
+
+#endif
+
+
+/*
+    Tests a gathered block with the current instruction set, returning
+    the mask of the pairs that hit.
+*/
+static unsigned int testBlock(SphereSphereBlock& block) {
+#ifdef PE_SIMD_X86
+    if (currentLevel == SIMD_LEVEL::AVX) {
+        return sphereAndSphereAvx(block);
+    }
+    return sphereAndSphereSse(block, 0) | (sphereAndSphereSse(block, 4) << 4);
+#else
+    return 0;
+#endif
+}
+
+
+static unsigned int testBlock(BoxSphereBlock& block) {
+#ifdef PE_SIMD_X86
+    if (currentLevel == SIMD_LEVEL::AVX) {
+        return boxAndSphereAvx(block);
+    }
+    return boxAndSphereSse(block, 0) | (boxAndSphereSse(block, 4) << 4);
+#else
+    return 0;
+#endif
+}
+
+
+/*
+    The objects of the pairs are spread out in memory, and their bounding
+    volumes even more so, which makes gathering them cost far more than
+    testing them. The objects of the block after the next one, and the
+    bodies and volumes of the next one, start loading while the current
+    block is processed.
+*/
+static void prefetchBlocks(
+    const PotentialContact* pairs,
+    unsigned int pairCount,
+    unsigned int start
+) {
+    unsigned int next = start + BLOCK_SIZE;
+    unsigned int nextEnd = std::min(next + BLOCK_SIZE, pairCount);
+    for (unsigned int i = next; i < nextEnd; i++) {
+        for (unsigned int j = 0; j < 2; j++) {
+            PE_PREFETCH(&pairs[i].object[j]->body.transformMatrix);
+            PE_PREFETCH(pairs[i].object[j]->boundingVolume);
+        }
+    }
+    unsigned int afterEnd = std::min(nextEnd + BLOCK_SIZE, pairCount);
+    for (unsigned int i = nextEnd; i < afterEnd; i++) {
+        PE_PREFETCH(pairs[i].object[0]);
+        PE_PREFETCH(pairs[i].object[1]);
+    }
+}
+
+
+/*
+    Creates the contacts of the pairs of the block that hit, leaving the
+    restitution and friction at their defaults (see Contact) for the
+    world to set.
+*/
+template <typename Block>
+static unsigned int addBlockContacts(
+    const Block& block,
+    const PotentialContact* pairs,
+    unsigned int hits,
+    std::vector<Contact>& contacts
+) {
+    unsigned int count = 0;
+    for (unsigned int lane = 0; hits != 0; lane++, hits >>= 1) {
+        if (hits & 1) {
+            Contact contact;
+            contact.contactNormal = Vector3D(
+                block.normal[0][lane],
+                block.normal[1][lane],
+                block.normal[2][lane]
+            );
+            contact.contactPoint = Vector3D(
+                block.point[0][lane],
+                block.point[1][lane],
+                block.point[2][lane]
+            );
+            contact.penetration = block.penetration[lane];
+            contact.body[0] = &pairs[lane].object[0]->body;
+            contact.body[1] = &pairs[lane].object[1]->body;
+            contacts.push_back(contact);
+            count++;
+        }
+    }
+    return count;
+}
+
+
+unsigned int pe::sphereAndSphereBatch(
+    const PotentialContact* pairs,
+    unsigned int pairCount,
+    std::vector<Contact>& contacts,
+    PairCache<SimplexCache>*
+) {
+    if (currentLevel == SIMD_LEVEL::SCALAR) {
+        unsigned int count = 0;
+        for (unsigned int i = 0; i < pairCount; i++) {
+            count += sphereAndSphere(
+                Ball(*pairs[i].object[0]), Ball(*pairs[i].object[1]),
+                contacts
+            );
+        }
+        return count;
+    }
+
+    unsigned int count = 0;
+    SphereSphereBlock block;
+    for (unsigned int start = 0; start < pairCount; start += BLOCK_SIZE) {
+        unsigned int size = std::min(BLOCK_SIZE, pairCount - start);
+        prefetchBlocks(pairs, pairCount, start);
+
+        /*
+            The centres are those the scalar routine uses (see Ball), and
+            the unused lanes are zero, and masked out below.
+        */
+        for (unsigned int lane = 0; lane < BLOCK_SIZE; lane++) {
+            if (lane < size) {
+                const RigidObject* one = pairs[start + lane].object[0];
+                const RigidObject* two = pairs[start + lane].object[1];
+                Vector3D positionOne = one->body.transformMatrix.getTranslation();
+                Vector3D positionTwo = two->body.transformMatrix.getTranslation();
+                for (unsigned int i = 0; i < 3; i++) {
+                    block.positionOne[i][lane] = positionOne[i];
+                    block.positionTwo[i][lane] = positionTwo[i];
+                }
+                block.radiusOne[lane] = static_cast<const BoundingSphere*>(
+                    one->boundingVolume)->getRadius();
+                block.radiusTwo[lane] = static_cast<const BoundingSphere*>(
+                    two->boundingVolume)->getRadius();
+            }
+            else {
+                for (unsigned int i = 0; i < 3; i++) {
+                    block.positionOne[i][lane] = 0;
+                    block.positionTwo[i][lane] = 0;
+                }
+                block.radiusOne[lane] = 0;
+                block.radiusTwo[lane] = 0;
+            }
+        }
+
+        unsigned int hits = testBlock(block) & ((1u << size) - 1);
+        count += addBlockContacts(block, pairs + start, hits, contacts);
+    }
+    return count;
+}
+
+
+unsigned int pe::boxAndSphereBatch(
+    const PotentialContact* pairs,
+    unsigned int pairCount,
+    std::vector<Contact>& contacts,
+    PairCache<SimplexCache>*
+) {
+    if (currentLevel == SIMD_LEVEL::SCALAR) {
+        unsigned int count = 0;
+        for (unsigned int i = 0; i < pairCount; i++) {
+            count += boxAndSphere(
+                Box(*pairs[i].object[0]), Ball(*pairs[i].object[1]),
+                contacts
+            );
+        }
+        return count;
+    }
+
+    unsigned int count = 0;
+    BoxSphereBlock block;
+    for (unsigned int start = 0; start < pairCount; start += BLOCK_SIZE) {
+        unsigned int size = std::min(BLOCK_SIZE, pairCount - start);
+        prefetchBlocks(pairs, pairCount, start);
+
+        // An unused lane is a box and sphere of size 0, masked out below
+        for (unsigned int lane = 0; lane < BLOCK_SIZE; lane++) {
+            if (lane < size) {
+                const RigidObject* box = pairs[start + lane].object[0];
+                const RigidObject* sphere = pairs[start + lane].object[1];
+                for (unsigned int i = 0; i < 12; i++) {
+                    block.transform[i][lane] =
+                        box->boundingVolumeTransform.data[i];
+                }
+                Vector3D halfSize = static_cast<const BoundingBox*>(
+                    box->boundingVolume)->getHalfsize();
+                Vector3D centre = sphere->body.transformMatrix.getTranslation();
+                for (unsigned int i = 0; i < 3; i++) {
+                    block.halfSize[i][lane] = halfSize[i];
+                    block.centre[i][lane] = centre[i];
+                }
+                block.radius[lane] = static_cast<const BoundingSphere*>(
+                    sphere->boundingVolume)->getRadius();
+            }
+            else {
+                for (unsigned int i = 0; i < 12; i++) {
+                    block.transform[i][lane] = 0;
+                }
+                for (unsigned int i = 0; i < 3; i++) {
+                    block.halfSize[i][lane] = 0;
+                    block.centre[i][lane] = 0;
+                }
+                block.radius[lane] = 0;
+            }
+        }
+
+        unsigned int hits = testBlock(block) & ((1u << size) - 1);
+        count += addBlockContacts(block, pairs + start, hits, contacts);
+    }
+    return count;
+}
+
+
+/*
+    Computes the rotation of box two relative to box one, and fills in
+    the axes of the pair. Returns the vector between the centres.
+*/
+static Vector3D gatherAxes(const Box& one, const Box& two, BoxBoxAxes& axes) {
+    Vector3D axesOne[3];
+    Vector3D axesTwo[3];
+    for (unsigned int i = 0; i < 3; i++) {
+        axesOne[i] = one.getAxis(i);
+        axesTwo[i] = two.getAxis(i);
+    }
+    Vector3D toCentre = two.getAxis(3) - one.getAxis(3);
+
+    // Coefficient (i, j) is axis i of box one against axis j of box two
+    real rotation[3][3];
+    for (unsigned int i = 0; i < 3; i++) {
+        for (unsigned int j = 0; j < 3; j++) {
+            rotation[i][j] = axesOne[i] * axesTwo[j];
+        }
+        axes.halfSizeOne[i] = one.halfSize[i];
+        axes.halfSizeTwo[i] = two.halfSize[i];
+        axes.toCentre[i] = axesOne[i] * toCentre;
+    }
+
+    for (unsigned int i = 0; i < 3; i++) {
+        for (unsigned int k = 0; k < 3; k++) {
+            // Axes of box one
+            axes.axisOne[k][i] = k == i ? 1 : 0;
+            axes.axisTwo[k][i] = rotation[i][k];
+
+            // Axes of box two
+            axes.axisOne[k][i + 3] = rotation[k][i];
+            axes.axisTwo[k][i + 3] = k == i ? 1 : 0;
+        }
+    }
+
+    /*
+        Axis i of box one crossed with axis j of box two: the cross
+        product of the unit vector i with a vector (of the other
+        coordinates) is 0 along i, and the vector's next two coefficients
+        swapped, with the first negated.
+    */
+    for (unsigned int i = 0; i < 3; i++) {
+        for (unsigned int j = 0; j < 3; j++) {
+            unsigned int lane = 6 + i * 3 + j;
+
+            unsigned int u = (i + 1) % 3;
+            unsigned int v = (i + 2) % 3;
+            axes.axisOne[i][lane] = 0;
+            axes.axisOne[u][lane] = -rotation[v][j];
+            axes.axisOne[v][lane] = rotation[u][j];
+
+            u = (j + 1) % 3;
+            v = (j + 2) % 3;
+            axes.axisTwo[j][lane] = 0;
+            axes.axisTwo[u][lane] = rotation[i][v];
+            axes.axisTwo[v][lane] = -rotation[i][u];
+        }
+    }
+
+    // The unused lane has a zero axis, which is skipped
+    for (unsigned int k = 0; k < 3; k++) {
+        axes.axisOne[k][15] = 0;
+        axes.axisTwo[k][15] = 0;
+    }
+
+    return toCentre;
+}
+
+
+/*
+    Penetration of the boxes along the axis of the given lane, as tryAxis
+    finds it: the projections of the half sizes, minus the projection of
+    the vector between the centres, divided by the length of the axis.
+    Axes too short to be normalized get NO_PENETRATION.
+*/
+static real axisPenetration(const BoxBoxAxes& axes, unsigned int lane) {
+    real projectionOne = 0;
+    real projectionTwo = 0;
+    real distance = 0;
+    real lengthSquared = 0;
+    for (unsigned int i = 0; i < 3; i++) {
+        real axisOne = axes.axisOne[i][lane];
+        real axisTwo = axes.axisTwo[i][lane];
+        projectionOne += axes.halfSizeOne[i] * std::abs(axisOne);
+        projectionTwo += axes.halfSizeTwo[i] * std::abs(axisTwo);
+        distance += axes.toCentre[i] * axisOne;
+        lengthSquared += axisOne * axisOne;
+    }
+    if (lengthSquared < MIN_AXIS_SQUARED) {
+        return NO_PENETRATION;
+    }
+    return (projectionOne + projectionTwo - std::abs(distance)) /
+        std::sqrt(lengthSquared);
+}
+
+
+/*
+    Finds the penetration along the axes with the current instruction
+    set, returning the mask of the axes that separate the boxes. Like
+    boxAndBox, it stops at the first group of axes (the face axes come
+    first) with a separating one, leaving the rest out of the mask.
+*/
+static unsigned int testAxes(BoxBoxAxes& axes) {
+#ifdef PE_SIMD_X86
+    if (currentLevel == SIMD_LEVEL::AVX) {
+        unsigned int separated = boxAndBoxAvx(axes, 0);
+        if (separated != 0) {
+            return separated;
+        }
+        return boxAndBoxAvx(axes, 8) << 8;
+    }
+    if (currentLevel == SIMD_LEVEL::SSE) {
+        for (unsigned int lane = 0; lane < AXIS_LANES; lane += 4) {
+            unsigned int separated = boxAndBoxSse(axes, lane);
+            if (separated != 0) {
+                return separated << lane;
+            }
+        }
+        return 0;
+    }
+#endif
+    for (unsigned int lane = 0; lane < AXIS_LANES; lane++) {
+        axes.penetration[lane] = axisPenetration(axes, lane);
+        if (axes.penetration[lane] < 0) {
+            return 1u << lane;
+        }
+    }
+    return 0;
+}
+
+
+unsigned int pe::boxAndBoxBatch(
+    const PotentialContact* pairs,
+    unsigned int pairCount,
+    std::vector<Contact>& contacts,
+    PairCache<SimplexCache>*
+) {
+    unsigned int count = 0;
+    BoxBoxAxes axes;
+    for (unsigned int i = 0; i < pairCount; i++) {
+        if (i % BLOCK_SIZE == 0) {
+            prefetchBlocks(pairs, pairCount, i);
+        }
+
+        RigidObject& objectOne = *pairs[i].object[0];
+        RigidObject& objectTwo = *pairs[i].object[1];
+        Box one(objectOne);
+        Box two(objectTwo);
+
+        Vector3D toCentre = gatherAxes(one, two, axes);
+        if (testAxes(axes) != 0) {
+            continue;
+        }
+
+        /*
+            The axis of least penetration, and the best of the face axes,
+            where the first one wins ties, as in boxAndBox.
+        */
+        unsigned int best = 0;
+        unsigned int bestSingleAxis = 0;
+        for (unsigned int lane = 1; lane < 15; lane++) {
+            if (axes.penetration[lane] < axes.penetration[best]) {
+                best = lane;
+            }
+            if (lane == 5) {
+                bestSingleAxis = best;
+            }
+        }
+
+        count += fillBoxAndBox(
+            one, two, toCentre, contacts,
+            best, axes.penetration[best], bestSingleAxis
+        );
+    }
+    return count;
+}
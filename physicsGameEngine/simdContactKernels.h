@@ -0,0 +1,87 @@
+/*
+    Header file for the SIMD batch kernels of the narrow phase, which
+    replace the sphere and sphere, and box and sphere entries of the
+    collision dispatch table (see fineCollisionDetection.h).
+    Scenes like ball pits generate tens of thousands of these pairs each
+    step, which the scalar routines process one at a time. The kernels
+    instead gather the data of 8 pairs at a time into arrays of each of
+    its components (structure of arrays), test all of them at once with
+    SSE (4 pairs per instruction) or AVX (8 pairs per instruction), and
+    only create the contacts of the pairs that hit.
+    The instruction set is chosen at runtime, as the best one supported
+    by the processor, so the same build runs on any x86 processor; other
+    processors use the scalar routines. The kernels do the same
+    operations in the same order as the scalar routines, so they generate
+    the same contacts.
+    The box and box entry works on one pair at a time, but tests its 15
+    separating axes together instead, 4 or 8 per instruction.
+*/
+
+#ifndef SIMD_CONTACT_KERNELS_H
+#define SIMD_CONTACT_KERNELS_H
+
+#include "fineCollisionDetection.h"
+
+namespace pe {
+
+    // Instruction sets the kernels can use, from the least to the most lanes
+    enum class SIMD_LEVEL {
+        SCALAR,
+        SSE,
+        AVX
+    };
+
+
+    // Best instruction set supported by the processor
+    SIMD_LEVEL getSupportedSimdLevel();
+
+
+    // Instruction set used by the kernels, the supported one by default
+    SIMD_LEVEL getSimdLevel();
+
+
+    /*
+        Makes the kernels use the given instruction set, or the supported
+        one if the processor doesn't support it (useful for comparing
+        them).
+    */
+    void setSimdLevel(SIMD_LEVEL level);
+
+
+    // Batch routine of the table for pairs of two spheres
+    unsigned int sphereAndSphereBatch(
+        const PotentialContact* pairs,
+        unsigned int pairCount,
+        std::vector<Contact>& contacts,
+        PairCache<SimplexCache>* simplexCaches
+    );
+
+
+    /*
+        Batch routine of the table for pairs of two boxes, which finds the
+        same contacts as boxAndBox (up to rounding) with a faster
+        separating axis test: the rotation of the second box relative to
+        the first is computed once, instead of the axes being projected
+        one by one, and all the axes are tested together, with a scalar
+        loop if there is no instruction set to test them with.
+        Pairs of boxes keep nothing between steps: finding a pair in the
+        simplex caches costs more than testing all of its axes.
+    */
+    unsigned int boxAndBoxBatch(
+        const PotentialContact* pairs,
+        unsigned int pairCount,
+        std::vector<Contact>& contacts,
+        PairCache<SimplexCache>* simplexCaches
+    );
+
+
+    // Batch routine of the table for pairs of a box and a sphere
+    unsigned int boxAndSphereBatch(
+        const PotentialContact* pairs,
+        unsigned int pairCount,
+        std::vector<Contact>& contacts,
+        PairCache<SimplexCache>* simplexCaches
+    );
+}
+
+#endif
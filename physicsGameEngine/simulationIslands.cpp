@@ -0,0 +1,198 @@
+// Source file for the simulation islands
+
+#include "simulationIslands.h"
+#include <algorithm>
+#include <numeric>
+
+using namespace pe;
+
+
+void SimulationIslands::indexBodies(const std::vector<RigidObject*>& objects) {
+	indexedObjects = objects;
+
+	indexedBodies.clear();
+	bodyIndices.clear();
+	for (RigidObject* object : objects) {
+		if (object->body.hasFiniteMass()) {
+			bodyIndices.push_back({ &object->body, indexedBodies.size() });
+			indexedBodies.push_back(&object->body);
+		}
+	}
+	std::sort(bodyIndices.begin(), bodyIndices.end());
+}
+
+
+unsigned int SimulationIslands::findIndex(const RigidBody* body) const {
+	if (!body || !body->hasFiniteMass()) {
+		return indexedBodies.size();
+	}
+	auto entry = std::lower_bound(
+		bodyIndices.begin(),
+		bodyIndices.end(),
+		body,
+		[](const std::pair<const RigidBody*, unsigned int>& entry,
+			const RigidBody* body) {
+			return entry.first < body;
+		}
+	);
+	return entry != bodyIndices.end() && entry->first == body ?
+		entry->second : indexedBodies.size();
+}
+
+
+unsigned int SimulationIslands::findRoot(unsigned int index) {
+	// Each body on the path is pointed to its grandparent (path halving)
+	while (parents[index] != index) {
+		parents[index] = parents[parents[index]];
+		index = parents[index];
+	}
+	return index;
+}
+
+
+void SimulationIslands::merge(unsigned int one, unsigned int two) {
+	one = findRoot(one);
+	two = findRoot(two);
+	if (one < two) {
+		parents[two] = one;
+	}
+	else {
+		parents[one] = two;
+	}
+}
+
+
+void SimulationIslands::build(
+	const std::vector<RigidObject*>& objects,
+	const std::vector<const Joint*>& joints,
+	std::vector<Contact>& contacts
+) {
+	// The bodies are only indexed again when objects were added or removed
+	if (objects != indexedObjects) {
+		indexBodies(objects);
+	}
+	unsigned int bodyCount = indexedBodies.size();
+
+	parents.resize(bodyCount);
+	std::iota(parents.begin(), parents.end(), 0);
+
+	contactIslands.resize(contacts.size());
+	for (unsigned int i = 0; i < contacts.size(); i++) {
+		unsigned int one = findIndex(contacts[i].body[0]);
+		unsigned int two = findIndex(contacts[i].body[1]);
+		if (one < bodyCount && two < bodyCount) {
+			merge(one, two);
+		}
+		// The contact is kept with one of its bodies for now
+		contactIslands[i] = one < bodyCount ? one : two;
+	}
+	for (const Joint* joint : joints) {
+		unsigned int one = findIndex(joint->body[0]);
+		unsigned int two = findIndex(joint->body[1]);
+		if (one < bodyCount && two < bodyCount) {
+			merge(one, two);
+		}
+	}
+
+	/*
+		The islands are numbered in the order of their first body, the
+		island of each set being first kept at the index of its root.
+	*/
+	islands.clear();
+	bodyIslands.assign(bodyCount, bodyCount);
+	for (unsigned int i = 0; i < bodyCount; i++) {
+		unsigned int root = findRoot(i);
+		if (bodyIslands[root] == bodyCount) {
+			bodyIslands[root] = islands.size();
+			islands.push_back(Island{ 0, 0, 0, 0, false });
+		}
+		bodyIslands[i] = bodyIslands[root];
+
+		Island& island = islands[bodyIslands[i]];
+		island.bodyCount++;
+		if (indexedBodies[i]->isAwake) {
+			island.isAwake = true;
+		}
+	}
+
+	// The bodies are placed by island
+	unsigned int first = 0;
+	for (Island& island : islands) {
+		island.firstBody = first;
+		first += island.bodyCount;
+		island.bodyCount = 0;
+	}
+	bodies.resize(bodyCount);
+	for (unsigned int i = 0; i < bodyCount; i++) {
+		Island& island = islands[bodyIslands[i]];
+		bodies[island.firstBody + island.bodyCount++] = indexedBodies[i];
+	}
+
+	// And so are the contacts, keeping their order within each island
+	for (unsigned int i = 0; i < contacts.size(); i++) {
+		if (contactIslands[i] < bodyCount) {
+			contactIslands[i] = bodyIslands[contactIslands[i]];
+			islands[contactIslands[i]].contactCount++;
+		}
+		else {
+			contactIslands[i] = islands.size();
+		}
+	}
+	first = 0;
+	for (Island& island : islands) {
+		island.firstContact = first;
+		first += island.contactCount;
+		island.contactCount = 0;
+	}
+	unsigned int unattached = first;
+	sortedContacts.resize(contacts.size());
+	for (unsigned int i = 0; i < contacts.size(); i++) {
+		if (contactIslands[i] < islands.size()) {
+			Island& island = islands[contactIslands[i]];
+			sortedContacts[island.firstContact + island.contactCount++] =
+				contacts[i];
+		}
+		else {
+			sortedContacts[unattached++] = contacts[i];
+		}
+	}
+	contacts.swap(sortedContacts);
+
+	// The bodies of the islands that are awake are woken up
+	for (const Island& island : islands) {
+		if (island.isAwake) {
+			for (unsigned int i = island.firstBody;
+				i < island.firstBody + island.bodyCount; i++) {
+				bodies[i]->setAwake(true);
+			}
+		}
+	}
+}
+
+
+unsigned int SimulationIslands::sleepIslands() {
+	unsigned int asleep = 0;
+
+	for (Island& island : islands) {
+		if (!island.isAwake) {
+			continue;
+		}
+
+		bool atRest = true;
+		for (unsigned int i = island.firstBody;
+			atRest && i < island.firstBody + island.bodyCount; i++) {
+			atRest = bodies[i]->isAtRest();
+		}
+
+		if (atRest) {
+			for (unsigned int i = island.firstBody;
+				i < island.firstBody + island.bodyCount; i++) {
+				bodies[i]->setAwake(false);
+			}
+			island.isAwake = false;
+			asleep += island.bodyCount;
+		}
+	}
+
+	return asleep;
+}
@@ -0,0 +1,118 @@
+/*
+	Header file for the simulation islands, which are the groups of bodies
+	connected to each other by contacts or joints, found each step with a
+	union-find over the bodies of the world.
+	Bodies with infinite mass (like the ground) are not part of any
+	island, as nothing they touch can push them, so they don't connect
+	the bodies resting on them. Each island can then be solved on its
+	own, and since a body at rest in a pile is only at rest if the rest
+	of the pile is, an island is put to sleep (or woken up) as a whole.
+	The contacts are reordered so that those of each island follow each
+	other, which lets the resolver take them as they are, and a body
+	that touches nothing is an island of its own.
+*/
+
+#ifndef SIMULATION_ISLANDS_H
+#define SIMULATION_ISLANDS_H
+
+#include "rigidObject.h"
+#include "contact.h"
+#include "joint.h"
+#include <vector>
+#include <utility>
+
+namespace pe {
+
+	class SimulationIslands {
+
+	public:
+
+		struct Island {
+
+			// Range of the contacts of the island in the contact array
+			unsigned int firstContact;
+			unsigned int contactCount;
+
+			// Range of the bodies of the island in the body array
+			unsigned int firstBody;
+			unsigned int bodyCount;
+
+			bool isAwake;
+		};
+
+	private:
+
+		/*
+			Objects the bodies were last indexed from, and the bodies
+			with finite mass, sorted by address, with their index (given
+			in the order of the objects).
+		*/
+		std::vector<RigidObject*> indexedObjects;
+		std::vector<std::pair<const RigidBody*, unsigned int>> bodyIndices;
+
+		// Bodies with finite mass, in the order of their index
+		std::vector<RigidBody*> indexedBodies;
+
+		// Parent of each body in the union-find
+		std::vector<unsigned int> parents;
+
+		// Island of each body, and of each contact
+		std::vector<unsigned int> bodyIslands;
+		std::vector<unsigned int> contactIslands;
+
+		// Buffer the contacts are reordered in
+		std::vector<Contact> sortedContacts;
+
+		std::vector<Island> islands;
+
+		// Bodies of the islands, those of each island following each other
+		std::vector<RigidBody*> bodies;
+
+
+		// Indexes the bodies with finite mass of the objects again
+		void indexBodies(const std::vector<RigidObject*>& objects);
+
+		/*
+			Returns the index of the given body, or the number of bodies
+			if it has infinite mass (or is null).
+		*/
+		unsigned int findIndex(const RigidBody* body) const;
+
+		// Root of the set of the body of the given index
+		unsigned int findRoot(unsigned int index);
+
+		void merge(unsigned int one, unsigned int two);
+
+	public:
+
+		/*
+			Finds the islands of the bodies of the given objects, from
+			the contacts and joints between them, and reorders the
+			contacts by island. Contacts between bodies with infinite
+			mass are placed after those of all the islands.
+			An island is awake if one of its bodies is, in which case the
+			others are woken up.
+		*/
+		void build(
+			const std::vector<RigidObject*>& objects,
+			const std::vector<const Joint*>& joints,
+			std::vector<Contact>& contacts
+		);
+
+		/*
+			Puts the awake islands whose bodies are all at rest to
+			sleep, returning the number of bodies put to sleep.
+		*/
+		unsigned int sleepIslands();
+
+		const std::vector<Island>& getIslands() const {
+			return islands;
+		}
+
+		const std::vector<RigidBody*>& getBodies() const {
+			return bodies;
+		}
+	};
+}
+
+#endif
@@ -5,7 +5,6 @@
 #include "mesh.h"
 #include "curvature.h"
 #include "softBody.h"
-#include "renderComponent.h"
 #include <unordered_map>
 
 namespace pe {
@@ -0,0 +1,246 @@
+#include "spatialHashGrid.h"
+
+using namespace pe;
+
+
+SpatialHashGrid::SpatialHashGrid(real cellSize, unsigned int tableSize) :
+	cellSize{ cellSize }, tableSize{ 1 }, maxRadius{ 0 }, currentQuery{ 0 } {
+	while (this->tableSize < tableSize) {
+		this->tableSize <<= 1;
+	}
+	bucketStart.assign(this->tableSize + 1, 0);
+	visitedBy.assign(this->tableSize, 0);
+}
+
+
+void SpatialHashGrid::getCell(const Vector3D& point, int cell[3]) const {
+	for (int axis = 0; axis < 3; axis++) {
+		cell[axis] = (int)std::floor(point[axis] / cellSize);
+	}
+}
+
+
+unsigned int SpatialHashGrid::getBucket(int x, int y, int z) const {
+	/*
+		The rows of cells along the x axis are scattered in the table by
+		multiplying the other coordinates with large primes, but the
+		cells of a row are kept next to each other, so the cells around
+		a point are read as a few contiguous runs of buckets.
+	*/
+	unsigned int hash = (unsigned int)x
+		+ (unsigned int)y * 73856093u
+		+ (unsigned int)z * 19349663u;
+	return hash & (tableSize - 1);
+}
+
+
+void SpatialHashGrid::startQuery() const {
+	currentQuery++;
+
+	// After a wrap around, old marks could match the new query
+	if (currentQuery == 0) {
+		std::fill(visitedBy.begin(), visitedBy.end(), 0);
+		currentQuery = 1;
+	}
+}
+
+
+bool SpatialHashGrid::visit(unsigned int bucket) const {
+	if (visitedBy[bucket] == currentQuery) {
+		return false;
+	}
+	visitedBy[bucket] = currentQuery;
+	return true;
+}
+
+
+template <typename CentreFunction, typename RadiusFunction>
+void SpatialHashGrid::sort(
+	unsigned int count,
+	const CentreFunction& getCentre,
+	const RadiusFunction& getRadius
+) {
+	bucketOf.resize(count);
+	sortedCentres.resize(count);
+	sortedRadii.resize(count);
+	sortedIndices.resize(count);
+	std::fill(bucketStart.begin(), bucketStart.end(), 0);
+	maxRadius = 0;
+
+	// Counts the points of each bucket
+	for (unsigned int i = 0; i < count; i++) {
+		int cell[3];
+		getCell(getCentre(i), cell);
+		bucketOf[i] = getBucket(cell[0], cell[1], cell[2]);
+		bucketStart[bucketOf[i] + 1]++;
+	}
+
+	// The start of each bucket is the number of points before it
+	for (unsigned int bucket = 0; bucket < tableSize; bucket++) {
+		bucketStart[bucket + 1] += bucketStart[bucket];
+	}
+
+	/*
+		Each point is placed at the next free position of its bucket,
+		using the start of the following bucket as a cursor, which ends up
+		at the start of the bucket once all its points are placed.
+	*/
+	for (unsigned int i = 0; i < count; i++) {
+		unsigned int position = bucketStart[bucketOf[i]]++;
+		sortedCentres[position] = getCentre(i);
+		sortedRadii[position] = getRadius(i);
+		sortedIndices[position] = i;
+		maxRadius = std::max(maxRadius, sortedRadii[position]);
+	}
+	for (unsigned int bucket = tableSize; bucket > 0; bucket--) {
+		bucketStart[bucket] = bucketStart[bucket - 1];
+	}
+	bucketStart[0] = 0;
+}
+
+
+void SpatialHashGrid::build(
+	std::span<const Vector3D> centres,
+	std::span<const real> radii
+) {
+	sort(
+		centres.size(),
+		[&](unsigned int i) -> const Vector3D& { return centres[i]; },
+		[&](unsigned int i) { return radii[i]; }
+	);
+}
+
+
+void SpatialHashGrid::build(std::span<const Vector3D> points, real radius) {
+	sort(
+		points.size(),
+		[&](unsigned int i) -> const Vector3D& { return points[i]; },
+		[radius](unsigned int) { return radius; }
+	);
+}
+
+
+void SpatialHashGrid::build(
+	std::span<const Particle> particles,
+	real radius
+) {
+	sort(
+		particles.size(),
+		[&](unsigned int i) -> const Vector3D& {
+			return particles[i].position;
+		},
+		[radius](unsigned int) { return radius; }
+	);
+}
+
+
+unsigned int SpatialHashGrid::getPairs(
+	std::vector<std::pair<unsigned int, unsigned int>>& pairs
+) const {
+	unsigned int count = 0;
+
+	for (unsigned int i = 0; i < sortedIndices.size(); i++) {
+		const Vector3D& centre = sortedCentres[i];
+		real radius = sortedRadii[i];
+
+		/*
+			Only the cells within the sum of the radii can hold a point
+			overlapping this one.
+		*/
+		real reach = radius + maxRadius;
+		int minimum[3], maximum[3];
+		getCell(centre - Vector3D(reach, reach, reach), minimum);
+		getCell(centre + Vector3D(reach, reach, reach), maximum);
+
+		startQuery();
+		for (int y = minimum[1]; y <= maximum[1]; y++) {
+			for (int z = minimum[2]; z <= maximum[2]; z++) {
+				unsigned int row = getBucket(minimum[0], y, z);
+				for (int x = 0; x <= maximum[0] - minimum[0]; x++) {
+
+					unsigned int bucket = (row + x) & (tableSize - 1);
+					if (!visit(bucket)) {
+						continue;
+					}
+
+					/*
+						Each pair is found from both of its points, so it
+						is only kept from the one that comes first.
+					*/
+					unsigned int start = std::max(bucketStart[bucket], i + 1);
+					for (unsigned int j = start; j < bucketStart[bucket + 1];
+						j++) {
+						real distance = radius + sortedRadii[j];
+						if ((sortedCentres[j] - centre).magnitudeSquared() <
+							distance * distance) {
+							pairs.push_back(std::make_pair(
+								std::min(sortedIndices[i], sortedIndices[j]),
+								std::max(sortedIndices[i], sortedIndices[j])
+							));
+							count++;
+						}
+					}
+				}
+			}
+		}
+	}
+
+	return count;
+}
+
+
+unsigned int SpatialHashGrid::query(
+	const Vector3D& centre,
+	real radius,
+	std::vector<unsigned int>& indices
+) const {
+	unsigned int count = 0;
+
+	real reach = radius + maxRadius;
+	int minimum[3], maximum[3];
+	getCell(centre - Vector3D(reach, reach, reach), minimum);
+	getCell(centre + Vector3D(reach, reach, reach), maximum);
+
+	auto check = [&](unsigned int j) {
+		real distance = radius + sortedRadii[j];
+		if ((sortedCentres[j] - centre).magnitudeSquared() <
+			distance * distance) {
+			indices.push_back(sortedIndices[j]);
+			count++;
+		}
+	};
+
+	/*
+		A sphere covering more cells than there are points is faster
+		checked against every point.
+	*/
+	double cells = 1;
+	for (int axis = 0; axis < 3; axis++) {
+		cells *= (double)maximum[axis] - minimum[axis] + 1;
+	}
+	if (cells > sortedIndices.size()) {
+		for (unsigned int j = 0; j < sortedIndices.size(); j++) {
+			check(j);
+		}
+		return count;
+	}
+
+	startQuery();
+	for (int y = minimum[1]; y <= maximum[1]; y++) {
+		for (int z = minimum[2]; z <= maximum[2]; z++) {
+			unsigned int row = getBucket(minimum[0], y, z);
+			for (int x = 0; x <= maximum[0] - minimum[0]; x++) {
+				unsigned int bucket = (row + x) & (tableSize - 1);
+				if (!visit(bucket)) {
+					continue;
+				}
+				for (unsigned int j = bucketStart[bucket];
+					j < bucketStart[bucket + 1]; j++) {
+					check(j);
+				}
+			}
+		}
+	}
+
+	return count;
+}
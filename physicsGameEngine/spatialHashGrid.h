@@ -0,0 +1,165 @@
+/*
+	Header file for the spatial hash grid, a broad phase for large numbers
+	of particles and small bodies, where building a tree or sorting
+	endpoints would cost more than the narrow phase it saves.
+	Space is divided into cubic cells of a fixed size, and each point (or
+	sphere, for small bodies) belongs to the cell containing its centre.
+	Since space is unbounded, the cells are not stored directly; instead
+	the integer coordinates of each cell are hashed into a table of a fixed
+	number of buckets, so different cells far apart can share a bucket,
+	which only costs a few extra distance checks.
+	The grid is rebuilt from scratch each step with a counting sort, which
+	is linear in the number of points and allocates nothing once the arrays
+	have grown: the points in each bucket are counted, the counts are
+	summed into the start of each bucket, and the points are then copied
+	into one contiguous array, ordered by bucket. The positions and radii
+	are copied along with the indices, so that a query reads the points of
+	a bucket one after the other in memory.
+	Two spheres can only overlap if the cell of one is among the cells
+	around the cell of the other, as long as the cells are at least as
+	large as the sum of their radii. So the cell size is best set to one
+	or two diameters of the particles (or of the largest small body); a
+	smaller size makes the queries visit more cells, and a much larger
+	one puts more points in each cell. Bodies much larger than the cells
+	(like the static level geometry) should not be added to the grid,
+	but can query it with their bounding sphere.
+*/
+
+#ifndef SPATIAL_HASH_GRID_H
+#define SPATIAL_HASH_GRID_H
+
+#include "particle.h"
+#include <vector>
+#include <span>
+#include <utility>
+#include <algorithm>
+
+namespace pe {
+
+	class SpatialHashGrid {
+
+	private:
+
+		// Size of the side of each cell
+		real cellSize;
+
+		// Number of buckets in the table, always a power of two
+		unsigned int tableSize;
+
+		/*
+			Index of the first point of each bucket in the sorted arrays,
+			with one more entry at the end, so that the points of a bucket
+			b are those between bucketStart[b] and bucketStart[b + 1].
+		*/
+		std::vector<unsigned int> bucketStart;
+
+		// Bucket of each point, in the order they were given
+		std::vector<unsigned int> bucketOf;
+
+		/*
+			Centres, radii and original indices of the points, sorted by
+			bucket.
+		*/
+		std::vector<Vector3D> sortedCentres;
+		std::vector<real> sortedRadii;
+		std::vector<unsigned int> sortedIndices;
+
+		// Largest radius of the points in the grid
+		real maxRadius;
+
+		/*
+			Query the bucket was last visited by, so that a bucket shared
+			by several of the cells around a point is only read once.
+		*/
+		mutable std::vector<unsigned int> visitedBy;
+		mutable unsigned int currentQuery;
+
+		// Integer coordinates of the cell containing a point
+		void getCell(const Vector3D& point, int cell[3]) const;
+
+		// Bucket of the table holding the cell of the given coordinates
+		unsigned int getBucket(int x, int y, int z) const;
+
+		/*
+			Starts a new query, after which each bucket is reported as
+			unvisited once by the visit function.
+		*/
+		void startQuery() const;
+		bool visit(unsigned int bucket) const;
+
+		/*
+			Counts the points in each bucket, then places them in the
+			sorted arrays. The centres and radii are given as functions of
+			the index of the point.
+		*/
+		template <typename CentreFunction, typename RadiusFunction>
+		void sort(
+			unsigned int count,
+			const CentreFunction& getCentre,
+			const RadiusFunction& getRadius
+		);
+
+	public:
+
+		/*
+			Creates a grid with the given cell size and number of buckets,
+			which is rounded up to a power of two. It is best to have at
+			least as many buckets as there are points.
+		*/
+		SpatialHashGrid(real cellSize, unsigned int tableSize = 1 << 16);
+
+		real getCellSize() const {
+			return cellSize;
+		}
+
+		// Takes effect the next time the grid is built
+		void setCellSize(real size) {
+			cellSize = size;
+		}
+
+		// Number of points in the grid
+		unsigned int getPointCount() const {
+			return sortedIndices.size();
+		}
+
+		/*
+			Builds the grid from the given spheres. The indices reported by
+			the queries are those of the spheres in these arrays.
+		*/
+		void build(
+			std::span<const Vector3D> centres,
+			std::span<const real> radii
+		);
+
+		// Builds the grid from the given points, all with the same radius
+		void build(std::span<const Vector3D> points, real radius);
+
+		/*
+			Builds the grid from the positions of the given particles, all
+			with the same radius.
+		*/
+		void build(std::span<const Particle> particles, real radius);
+
+		/*
+			Appends to the buffer all the pairs of points in the grid whose
+			spheres overlap, each pair once, with the smaller index first.
+			Returns the number of pairs added.
+		*/
+		unsigned int getPairs(
+			std::vector<std::pair<unsigned int, unsigned int>>& pairs
+		) const;
+
+		/*
+			Appends to the buffer the indices of all the points in the grid
+			whose spheres overlap the given sphere, which may be much larger
+			than the cells. Returns the number of indices added.
+		*/
+		unsigned int query(
+			const Vector3D& centre,
+			real radius,
+			std::vector<unsigned int>& indices
+		) const;
+	};
+}
+
+#endif
@@ -0,0 +1,233 @@
+#include "sweepAndPrune.h"
+
+using namespace pe;
+
+
+bool SweepAndPrune::overlaps(unsigned int one, unsigned int two) const {
+	const Box& first = boxes[one];
+	const Box& second = boxes[two];
+	for (int axis = 0; axis < 3; axis++) {
+		if (first.minimum[axis] >= second.maximum[axis] ||
+			second.minimum[axis] >= first.maximum[axis]) {
+			return false;
+		}
+	}
+	return true;
+}
+
+
+void SweepAndPrune::setBox(
+	unsigned int box,
+	const Vector3D& centre,
+	real radius
+) {
+	Box& current = boxes[box];
+	current.sphere = BVHSphere(centre, radius);
+	for (int axis = 0; axis < 3; axis++) {
+		current.minimum[axis] = centre[axis] - radius;
+		current.maximum[axis] = centre[axis] + radius;
+	}
+}
+
+
+void SweepAndPrune::insert(
+	RigidObject* object,
+	const Vector3D& centre,
+	real radius
+) {
+	auto existing = boxOf.find(object);
+	if (existing != boxOf.end()) {
+		setBox(existing->second, centre, radius);
+		return;
+	}
+
+	unsigned int box;
+	if (!freeBoxes.empty()) {
+		box = freeBoxes.back();
+		freeBoxes.pop_back();
+		boxes[box].object = object;
+	}
+	else {
+		box = boxes.size();
+		boxes.push_back(Box{ object, BVHSphere(centre, radius), {}, {} });
+	}
+	setBox(box, centre, radius);
+	boxOf[object] = box;
+
+	/*
+		The endpoints are added at the end of the arrays, and moved into
+		place by the next sort, which also finds the new pairs.
+	*/
+	for (int axis = 0; axis < 3; axis++) {
+		endpoints[axis].push_back(Endpoint{ 0, box, false });
+		endpoints[axis].push_back(Endpoint{ 0, box, true });
+	}
+	addedBoxes++;
+}
+
+
+void SweepAndPrune::remove(RigidObject* object) {
+	auto existing = boxOf.find(object);
+	if (existing == boxOf.end()) {
+		return;
+	}
+	unsigned int box = existing->second;
+
+	// Removing the endpoints keeps the others in order
+	for (int axis = 0; axis < 3; axis++) {
+		std::erase_if(endpoints[axis], [box](const Endpoint& endpoint) {
+			return endpoint.box == box;
+		});
+	}
+	std::erase_if(pairs, [box](unsigned long long key) {
+		return (key >> 32) == box || (key & 0xffffffff) == box;
+	});
+
+	boxes[box].object = nullptr;
+	freeBoxes.push_back(box);
+	boxOf.erase(existing);
+}
+
+
+void SweepAndPrune::update(
+	RigidObject* object,
+	const Vector3D& centre,
+	real radius
+) {
+	auto existing = boxOf.find(object);
+	if (existing != boxOf.end()) {
+		setBox(existing->second, centre, radius);
+	}
+}
+
+
+void SweepAndPrune::clear() {
+	for (int axis = 0; axis < 3; axis++) {
+		endpoints[axis].clear();
+	}
+	boxes.clear();
+	freeBoxes.clear();
+	boxOf.clear();
+	pairs.clear();
+	addedBoxes = 0;
+}
+
+
+void SweepAndPrune::sortAxis(int axis) {
+
+	std::vector<Endpoint>& array = endpoints[axis];
+
+	for (Endpoint& endpoint : array) {
+		const Box& box = boxes[endpoint.box];
+		endpoint.value = endpoint.isMaximum ?
+			box.maximum[axis] : box.minimum[axis];
+	}
+
+	for (unsigned int i = 1; i < array.size(); i++) {
+		Endpoint endpoint = array[i];
+		unsigned int j = i;
+
+		/*
+			The endpoint moves down the array past every endpoint with
+			a larger value.
+		*/
+		while (j > 0 && array[j - 1].value > endpoint.value) {
+			const Endpoint& other = array[j - 1];
+
+			/*
+				A minimum moving before a maximum means the two intervals
+				may now overlap, in which case we check the other axes.
+				A maximum moving before a minimum means the intervals
+				no longer overlap, and so neither do the boxes.
+			*/
+			if (!endpoint.isMaximum && other.isMaximum) {
+				if (overlaps(endpoint.box, other.box)) {
+					pairs.insert(getPairKey(endpoint.box, other.box));
+				}
+			}
+			else if (endpoint.isMaximum && !other.isMaximum) {
+				pairs.erase(getPairKey(endpoint.box, other.box));
+			}
+
+			array[j] = other;
+			j--;
+		}
+		array[j] = endpoint;
+	}
+}
+
+
+void SweepAndPrune::rebuild() {
+
+	for (int axis = 0; axis < 3; axis++) {
+		std::vector<Endpoint>& array = endpoints[axis];
+		for (Endpoint& endpoint : array) {
+			const Box& box = boxes[endpoint.box];
+			endpoint.value = endpoint.isMaximum ?
+				box.maximum[axis] : box.minimum[axis];
+		}
+		std::sort(array.begin(), array.end(),
+			[](const Endpoint& one, const Endpoint& two) {
+				// A box of zero width must still open before it closes
+				return one.value < two.value || (one.value == two.value &&
+					!one.isMaximum && two.isMaximum);
+			}
+		);
+	}
+
+	/*
+		Each box is checked against the boxes whose interval along the
+		first axis is still open when its own starts.
+	*/
+	pairs.clear();
+	std::vector<unsigned int> open;
+	for (const Endpoint& endpoint : endpoints[0]) {
+		if (endpoint.isMaximum) {
+			auto position = std::find(open.begin(), open.end(), endpoint.box);
+			*position = open.back();
+			open.pop_back();
+		}
+		else {
+			for (unsigned int other : open) {
+				if (overlaps(endpoint.box, other)) {
+					pairs.insert(getPairKey(endpoint.box, other));
+				}
+			}
+			open.push_back(endpoint.box);
+		}
+	}
+}
+
+
+unsigned int SweepAndPrune::getPotentialContacts(
+	std::vector<PotentialContact>& contacts
+) {
+	/*
+		A few new boxes are cheaper to move into place, but many of them
+		make the insertion sort quadratic.
+	*/
+	if (addedBoxes > REBUILD_THRESHOLD) {
+		rebuild();
+	}
+	else {
+		for (int axis = 0; axis < 3; axis++) {
+			sortAxis(axis);
+		}
+	}
+	addedBoxes = 0;
+
+	/*
+		The boxes of the spheres overlap whenever the spheres do, but not
+		the other way around, so the pairs are filtered with the spheres.
+	*/
+	unsigned int count = 0;
+	for (unsigned long long key : pairs) {
+		const Box& one = boxes[key >> 32];
+		const Box& two = boxes[key & 0xffffffff];
+		if (one.sphere.overlaps(&two.sphere)) {
+			contacts.push_back(PotentialContact{ { one.object, two.object } });
+			count++;
+		}
+	}
+	return count;
+}
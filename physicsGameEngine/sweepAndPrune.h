@@ -0,0 +1,156 @@
+/*
+	Header file for the sweep and prune broad phase, an alternative to the
+	bounding volume hierarchy for the coarse collision detection, which
+	finds the same potential contacts.
+	Each object is given an axis aligned box around its bounding sphere,
+	and the minimum and maximum of each box along each of the three axes
+	(its endpoints) are kept in three arrays, one per axis, sorted by value.
+	Two boxes overlap if and only if their intervals overlap along all
+	three axes, and two intervals start or stop overlapping exactly when
+	the minimum of one passes the maximum of the other in the sorted
+	array. So instead of testing every pair, we only need to keep the
+	arrays sorted, and test the pairs whose endpoints swap places while
+	sorting, adding the pair to the set of overlapping pairs when a
+	minimum moves before a maximum and the boxes now overlap, and removing
+	it when a maximum moves before a minimum.
+	Because the objects only move a little from one step to the next
+	(temporal coherence), the arrays are almost sorted at the start of
+	each step, and an insertion sort puts them back in order in close to
+	linear time, with few swaps. Many objects added at once are instead
+	sorted along with the others from scratch. This makes sweep and prune very fast for
+	scenes of many similarly sized objects spread on a plane, like ball
+	pits and debris, where a tree of spheres does more work. It is slower
+	when objects move a lot, or when the boxes of many objects overlap
+	along an axis (like objects stacked in a column), which causes many
+	swaps for few actual overlaps.
+	The boxes are only used to maintain the set of pairs; the pairs that
+	are returned are those whose spheres overlap, which are exactly the
+	potential contacts the bounding volume hierarchy would return for the
+	same spheres.
+*/
+
+#ifndef SWEEP_AND_PRUNE_H
+#define SWEEP_AND_PRUNE_H
+
+#include "BVHNode.h"
+#include <vector>
+#include <unordered_map>
+#include <unordered_set>
+#include <algorithm>
+
+namespace pe {
+
+	class SweepAndPrune {
+
+	private:
+
+		// The minimum or maximum of a box along one axis
+		struct Endpoint {
+			real value;
+			unsigned int box;
+			bool isMaximum;
+		};
+
+		// Box of an object, along with the sphere it was made from
+		struct Box {
+			RigidObject* object;
+			BVHSphere sphere;
+			real minimum[3];
+			real maximum[3];
+		};
+
+		// Sorted endpoints of the boxes along each axis
+		std::vector<Endpoint> endpoints[3];
+
+		/*
+			Boxes of the objects, some of which are unused (their index is
+			then in the free boxes array).
+		*/
+		std::vector<Box> boxes;
+		std::vector<unsigned int> freeBoxes;
+
+		// Box of each object
+		std::unordered_map<RigidObject*, unsigned int> boxOf;
+
+		/*
+			Pairs of boxes overlapping, each stored as a single key made
+			of the two box indices, the smaller one first.
+		*/
+		std::unordered_set<unsigned long long> pairs;
+
+		/*
+			Number of boxes added since the last sort, whose endpoints are
+			still at the end of the arrays.
+		*/
+		unsigned int addedBoxes = 0;
+
+		// Number of added boxes above which the arrays are sorted again
+		static constexpr unsigned int REBUILD_THRESHOLD = 64;
+
+
+		static unsigned long long getPairKey(unsigned int one, unsigned int two) {
+			if (one > two) {
+				std::swap(one, two);
+			}
+			return ((unsigned long long)one << 32) | two;
+		}
+
+		// Checks if two boxes overlap along all three axes
+		bool overlaps(unsigned int one, unsigned int two) const;
+
+		// Sets the box of the given index around the given sphere
+		void setBox(unsigned int box, const Vector3D& centre, real radius);
+
+		/*
+			Copies the new values of the boxes in the endpoints of the axis,
+			and sorts them back in order with an insertion sort, updating
+			the pairs whenever a minimum and a maximum swap places.
+		*/
+		void sortAxis(int axis);
+
+		/*
+			Sorts the endpoints from scratch, and finds all the pairs again
+			by sweeping along the first axis, used when many boxes were
+			added at once (like when loading a level), as moving each of
+			their endpoints into place one by one would take quadratic time.
+		*/
+		void rebuild();
+
+	public:
+
+		/*
+			Adds an object with the given bounding sphere. If the object
+			was already added, its sphere is updated instead.
+		*/
+		void insert(RigidObject* object, const Vector3D& centre, real radius);
+
+		// Removes an object, if it was added
+		void remove(RigidObject* object);
+
+		/*
+			Gives the current sphere of an object already added. The
+			arrays are only sorted again when the potential contacts are
+			requested, so all the objects should be updated first.
+		*/
+		void update(RigidObject* object, const Vector3D& centre, real radius);
+
+		// Removes all the objects
+		void clear();
+
+		// Number of objects
+		unsigned int getObjectCount() const {
+			return boxOf.size();
+		}
+
+		/*
+			Sorts the endpoints again based on the new spheres, and appends
+			all of the potential contacts to the given buffer, which grows
+			as needed. Returns the number of potential contacts added.
+		*/
+		unsigned int getPotentialContacts(
+			std::vector<PotentialContact>& contacts
+		);
+	};
+}
+
+#endif
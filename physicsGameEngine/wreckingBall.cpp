@@ -7,9 +7,7 @@
 #include "polyhedra.h"
 #include "rigidBodyGravity.h"
 #include "rigidBodySpringForce.h"
-#include "fineCollisionDetection.h"
-#include "collisionResolver.h"
-#include "boundingVolumeHierarchy.h"
+#include "rigidBodyWorld.h"
 #include "faceBufferGenerator.h"
 #include "boundingVolumeRenderer.h"
 
@@ -125,6 +123,20 @@ void pe::runWreckingBall() {
     b.position = Vector3D(800, 700, 0);
     RigidBodySpringForce f(sphere.mesh->getVertex(0), &b, Vector3D(), 0.3, 300);
 
+    // World
+
+    RigidBodyWorld world(1, 1, 0.25, 0.0);
+    // The swinging sphere is stopped before it passes through the prisms
+    world.setContinuousCollision(true);
+    for (CuboidObject* prism : prisms) {
+        world.addObject(prism);
+    }
+    world.addObject(&ground);
+    RigidBodyWorld::ObjectHandle sphereHandle = world.addObject(&sphere);
+
+    world.addGlobalForce(&g);
+    world.addForce(sphereHandle, &f);
+
     // Renderer for bounding boxes
     BoundingVolumeRenderer renderer(20, colorWhite);
 
@@ -164,72 +176,12 @@ void pe::runWreckingBall() {
             sphere.body.position.y = worldPos.y * 4;
         }
 
-        int numSteps = 2;
+        int numSteps = 1;
         real substep = deltaT / numSteps;
 
         
         while (numSteps--) {
-
-            // Applying the forces
-
-            for (CuboidObject* prism : prisms) {
-                g.updateForce(&(prism->body), substep);
-            }
-            g.updateForce(&(sphere.body), substep);
-            f.updateForce(&(sphere.body), substep);
-
-            // Coarse collision detection
-
-            BoundingVolumeHierarchy BVH;
-            for (int i = 0; i < prisms.size(); i++) {
-                BVH.insert(
-                    prisms[i], 
-                    prisms[i]->boundingVolumeTransform.getTranslation(),
-                    prisms[i]->boundingVolume->getBVHSphereRadius()
-                );
-            }
-            BVH.insert(
-                &ground, 
-                ground.boundingVolumeTransform.getTranslation(),
-                ground.boundingVolume->getBVHSphereRadius()
-            );
-            BVH.insert(
-                &sphere, 
-                sphere.boundingVolumeTransform.getTranslation(),
-                sphere.boundingVolume->getBVHSphereRadius()
-            );
-
-            PotentialContact con[1000];
-            int size = BVH.getPotentialContacts(con, 1000);
-
-            // Fine collision detection/resolution
-            
-            std::vector<Contact> contacts;
-            for (int i = 0; i < size; i++) {
-                generateContacts(
-                    *con[i].object[0], *con[i].object[1], 
-                    contacts, 0.25, 0.0
-                );
-            }
-
-            CollisionResolver resolver(1, 1);
-            resolver.resolveContacts(contacts.data(), contacts.size(), substep);
-
-            // Integrating the bodies
-
-            for (CuboidObject* prism : prisms) {
-                prism->body.integrate(substep);
-            }
-            ground.body.integrate(substep);
-            sphere.body.integrate(substep);
-
-            // Updating the objects
-
-            for (CuboidObject* prism : prisms) {
-                prism->update();
-            }
-            ground.update();
-            sphere.update();
+            world.runPhysics(substep);
             b.calculateDerivedData();
         }
 